@@ -27,10 +27,16 @@ extern "C" {
 #include "openphy/sigvec.h"
 }
 
-#include "../src/Resampler.h"
+#include "../src/Decimator.h"
 
 #define OFFSET_LIMIT	64
 
+/*
+ * Amplitude scaling of sc16 samples, applied by the PSS resampler as it
+ * filters the raw samples and on PBCH subframe conversion
+ */
+#define SC16_SCALE	(1.0f / 127.0f)
+
 /*
  * Decimation factor for a given number of resource blocks
  *
@@ -75,10 +81,8 @@ static int use_fft_1536(int rbs)
 }
 
 io_subframe::io_subframe(size_t chans)
-	 : raw(chans, NULL), base(chans, NULL), pss(chans, NULL),
-	   pbch(chans, NULL), convert_on(false), pss_on(false),
-	   history(chans, NULL), pss_resampler(chans, NULL),
-	   pbch_resampler(chans, NULL)
+	 : raw(chans, NULL), pss(chans, NULL), pss_on(false),
+	   pbch_buf(NULL), history(chans, NULL), pss_resampler(chans, NULL)
 {
 	this->chans = chans;
 }
@@ -86,117 +90,110 @@ io_subframe::io_subframe(size_t chans)
 io_subframe::~io_subframe()
 {
 	for (size_t i = 0; i < chans; i++) {
-		cxvec_free(base[i]);
 		cxvec_free(pss[i]);
-		cxvec_free(pbch[i]);
 
 		delete[] history[i];
 		delete pss_resampler[i];
-		delete pbch_resampler[i];
 	}
+
+	delete[] pbch_buf;
 }
 
-bool io_subframe::init(size_t rbs, size_t taps)
+bool io_subframe::init(size_t rbs, size_t taps, int stages)
 {
 	unsigned flags = CXVEC_FLG_FFT_ALIGN;
 
 	/* Subframe lengths */
 	int pdsch_len = lte_subframe_len(rbs);
 	int pss_len = LTE_BASE_SUBFRAME_LEN / 32;
-	int pbch_len = lte_subframe_len(6);
 
-	int p = 1;
 	int base_q = get_decim(rbs);
 	if (base_q < 0)
 		return false;
 
 	int pss_q = use_fft_1536(rbs) ? 32 * 3 / 4 / base_q : 32 / base_q;
-	int pbch_q = pss_q / 2;
 
+	/*
+	 * Half-band stages change the PSS filter delay, which the delayed
+	 * subframes are padded to match
+	 */
 	for (size_t i = 0; i < chans; i++) {
-		history[i] = new short[2 * (taps / 2 + OFFSET_LIMIT)];
-		base[i] = cxvec_alloc(pdsch_len, taps, 0, NULL, flags);
-		pss[i] = cxvec_alloc(pss_len, 0, 0, NULL, flags);
-		pbch[i] = cxvec_alloc(pbch_len, 0, 0, NULL, flags);
-
-		pss_resampler[i] = new Resampler(p, pss_q, taps, 0, 1.0);
-		pbch_resampler[i] = new Resampler(p, pbch_q, taps, 0, 1.0);
-		pss_resampler[i]->init();
-		pbch_resampler[i]->init();
+		pss_resampler[i] = new Decimator(pss_q, taps, stages);
+		if (!pss_resampler[i]->init(pdsch_len))
+			return false;
 	}
 
-	this->hlen = taps / 2 + OFFSET_LIMIT;
-	this->len = pdsch_len;
-	this->taps = taps;
-
-	return true;
-}
-
-/* Converters and amplitude scaling */
-void io_subframe::convert(size_t start, size_t len)
-{
-	float scale = 1.0 / 127.0;
+	int delay = pss_resampler[0]->delay();
 
 	for (size_t i = 0; i < chans; i++) {
-		short *_raw = &raw[i][2 * start];
-		float *_base = (float *) cxvec_data(base[i]) + 2 * start;
-
-		convert_short_float(_base, _raw, 2 * len, scale);
+		history[i] = new short[2 * (delay + OFFSET_LIMIT)];
+		pss[i] = cxvec_alloc(pss_len, 0, 0, NULL, flags);
 	}
-}
-
-bool io_subframe::convert()
-{
-	if (convert_on)
-		return false;
 
-	convert(0, this->len);
+	pbch_buf = new short[2 * pdsch_len];
 
-	convert_on = true;
+	this->hlen = delay + OFFSET_LIMIT;
+	this->dlen = delay;
+	this->len = pdsch_len;
+	this->taps = taps;
 
 	return true;
 }
 
 void io_subframe::reset()
 {
-	convert_on = false;
 	pss_on = false;
 }
 
 bool io_subframe::preprocess_pss()
+{
+	return preprocess_pss(0, cxvec_len(pss[0]));
+}
+
+/*
+ * Resample only the PSS samples from 'start' for 'len' samples, leaving the
+ * rest of the PSS subframe stale. Only the first call on a subframe filters.
+ */
+bool io_subframe::preprocess_pss(int start, int len)
 {
 	if (pss_on)
 		return false;
 
-	if (!convert_on)
-		convert();
-
-	for (size_t i = 0; i < chans; i++)
-		pss_resampler[i]->rotate(base[i], pss[i]);
+	for (size_t i = 0; i < chans; i++) {
+		pss_resampler[i]->rotate(raw[i], this->len, pss[i],
+					 SC16_SCALE, start, len);
+	}
 
 	pss_on = true;
 
 	return true;
 }
 
-bool io_subframe::preprocess_pbch(size_t chan, struct cxvec *vec)
+/*
+ * Fill a full bandwidth subframe with the delayed samples of the PDSCH path.
+ * The PBCH is taken from the center resource blocks after the OFDM
+ * conversion, so no separate PBCH filter is run.
+ */
+bool io_subframe::preprocess_pbch(size_t chan, struct cxvec *vec, int offset)
 {
-	if (!convert_on)
-		convert();
+	if (cxvec_len(vec) != (int) this->len)
+		return false;
 
-	pbch_resampler[chan]->rotate(base[chan], vec);
+	if (!delay(chan, pbch_buf, this->len, offset))
+		return false;
 
-	return 0;
+	convert_short_float((float *) cxvec_data(vec), pbch_buf,
+			    2 * this->len, SC16_SCALE);
+
+	return true;
 }
 
 bool io_subframe::update()
 {
-	if (!convert_on)
-		convert(this->len - taps, taps);
-
 	if (!pss_on) {
 		for (size_t i = 0; i < chans; i++)
-			pss_resampler[i]->update(base[i]);
+			pss_resampler[i]->update(raw[i], this->len,
+						 SC16_SCALE);
 	}
 
 	for (size_t i = 0; i < chans; i++) {
@@ -204,7 +201,6 @@ bool io_subframe::update()
 		int size = this->hlen * 2 * sizeof(short);
 
 		memcpy(history[i], &raw[i][index], size);
-		pbch_resampler[i]->update(base[i]);
 	}
 
 	return true;
@@ -225,7 +221,7 @@ static void interp_sample(short *buf, int index)
 
 bool io_subframe::delay(size_t chan, short *buf, size_t len, int offset)
 {
-	int head, body, delay = taps / 2;
+	int head, body, delay = dlen;
 	short *_history = history[chan] + 2 * OFFSET_LIMIT;
 	short *_buf = buf;
 
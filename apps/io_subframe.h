@@ -3,42 +3,44 @@
 
 
 struct cxvec;
-struct Resampler;
+class Decimator;
 
 class io_subframe {
 public:
 	io_subframe(size_t chans = 1);
 	~io_subframe();
 
-	bool init(size_t rbs, size_t taps = 384);
+	bool init(size_t rbs, size_t taps = 384, int stages = 0);
 
 	bool preprocess_pss();
-	bool preprocess_pbch(size_t chan, struct cxvec *vec);
+	bool preprocess_pss(int start, int len);
+	bool preprocess_pbch(size_t chan, struct cxvec *vec, int offset);
 	bool update();
 
 	bool delay(size_t chan, short *buf, size_t len, int offset);
 
+	/*
+	 * Samples of history placed ahead of each delayed subframe, which is
+	 * the group delay of the PSS filter
+	 */
+	size_t delay_len() const { return dlen; }
+
 	void reset();
 
 	short **get_raw();
 	const struct cxvec **get_pss();
-	const struct cxvec **get_pbch();
 
 	size_t len;
 	size_t chans;
 	std::vector<short *> raw;
 	std::vector<struct cxvec *> pss;
-	std::vector<struct cxvec *> pbch;
 
 private:
-	void convert(size_t start, size_t len);
-	bool convert();
+	size_t taps, hlen, dlen;
+	bool pss_on;
 
-	size_t taps, hlen;
-	std::vector<struct cxvec *> base;
-	bool convert_on, pss_on;
+	short *pbch_buf;
 
 	std::vector<short *> history;
-	std::vector<Resampler *> pss_resampler;
-	std::vector<Resampler *> pbch_resampler;
+	std::vector<Decimator *> pss_resampler;
 };
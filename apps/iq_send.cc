@@ -0,0 +1,289 @@
+/*
+ * LTE Network IQ Stream Sender
+ *
+ * Copyright (C) 2015 Ettus Research LLC
+ * Author Tom Tsou <tom.tsou@ettus.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <vector>
+#include <string>
+#include <chrono>
+#include <thread>
+
+#include "../src/net.h"
+
+extern "C" {
+#include "../src/slot.h"
+}
+
+/* Datagrams sent per sendmmsg() call */
+#define SEND_BATCH_PKTS		32
+
+/* Socket send buffer */
+#define SEND_SOCK_BUFLEN	(4 << 20)
+
+typedef std::chrono::steady_clock send_clock;
+
+struct send_config {
+	std::string file;
+	std::string url;
+	double speed;
+	int chans;
+	int rbs;
+	int spp;
+};
+
+static void print_help()
+{
+	fprintf(stdout, "\nOptions:\n"
+		"  -h    This text\n"
+		"  -i    sc16 capture file to replay\n"
+		"  -d    Destination udp://host:port or tcp://host:port\n"
+		"  -c    Number of channels in the capture (default = 1)\n"
+		"  -b    Number of LTE resource blocks of the capture\n"
+		"  -s    Replay speed relative to real time (0 = unthrottled)\n"
+		"  -n    Samples per packet (default = fit 1500 byte MTU)\n\n");
+}
+
+static int handle_options(int argc, char **argv, struct send_config *config)
+{
+	int option;
+
+	config->speed = 1.0;
+	config->chans = 1;
+	config->rbs = 0;
+	config->spp = 0;
+
+	while ((option = getopt(argc, argv, "hi:d:c:b:s:n:")) != -1) {
+		switch (option) {
+		case 'i':
+			config->file = optarg;
+			break;
+		case 'd':
+			config->url = optarg;
+			break;
+		case 'c':
+			config->chans = atoi(optarg);
+			break;
+		case 'b':
+			config->rbs = atoi(optarg);
+			break;
+		case 's':
+			config->speed = atof(optarg);
+			break;
+		case 'n':
+			config->spp = atoi(optarg);
+			break;
+		case 'h':
+		default:
+			print_help();
+			return -1;
+		}
+	}
+
+	if (config->file.empty() || config->url.empty() ||
+	    (config->chans < 1) || (lte_subframe_len(config->rbs) <= 0)) {
+		print_help();
+		return -1;
+	}
+
+	int max = (NET_IQ_PKT_MAX - NET_IQ_HDR_LEN) / (4 * config->chans);
+	if (max > 0xffff)
+		max = 0xffff;
+
+	if (!config->spp)
+		config->spp = (NET_IQ_PKT_MTU - NET_IQ_HDR_LEN) /
+			      (4 * config->chans);
+
+	if ((config->spp < 1) || (config->spp > max)) {
+		printf("Invalid samples per packet, maximum %i\n", max);
+		return -1;
+	}
+
+	return 0;
+}
+
+static int open_socket(const std::string &url)
+{
+	enum net_proto proto;
+	struct sockaddr_in addr;
+
+	if (!net_parse_url(url, &proto, &addr)) {
+		fprintf(stderr, "Invalid destination %s\n", url.c_str());
+		return -1;
+	}
+
+	int fd = socket(AF_INET, proto == NET_PROTO_UDP ?
+			SOCK_DGRAM : SOCK_STREAM, 0);
+	if (fd < 0)
+		return -1;
+
+	net_set_bufsize(fd, SO_SNDBUF, SEND_SOCK_BUFLEN);
+
+	if (connect(fd, (struct sockaddr *) &addr, sizeof(addr)) < 0) {
+		fprintf(stderr, "Failed to connect to %s: %s\n",
+			url.c_str(), strerror(errno));
+		close(fd);
+		return -1;
+	}
+
+	return fd;
+}
+
+/* Datagrams are sent whole, streams may take partial writes */
+static bool send_pkts(int fd, std::vector<struct mmsghdr> &msgs, int num)
+{
+	for (int sent = 0; sent < num;) {
+		int rc = sendmmsg(fd, &msgs[sent], num - sent, 0);
+		if (rc < 0) {
+			if (errno == EINTR)
+				continue;
+
+			/* Receiver not listening yet */
+			if (errno == ECONNREFUSED)
+				return true;
+
+			fprintf(stderr, "Send error: %s\n", strerror(errno));
+			return false;
+		}
+
+		for (int i = sent; i < sent + rc; i++) {
+			struct iovec *iov = msgs[i].msg_hdr.msg_iov;
+			size_t len = msgs[i].msg_len;
+
+			while (len < iov->iov_len) {
+				ssize_t n = send(fd, (char *) iov->iov_base + len,
+						 iov->iov_len - len, 0);
+				if (n <= 0)
+					return false;
+				len += n;
+			}
+		}
+
+		sent += rc;
+	}
+
+	return true;
+}
+
+static int send_file(struct send_config *config)
+{
+	FILE *file = fopen(config->file.c_str(), "rb");
+	if (!file) {
+		fprintf(stderr, "Failed to open %s\n", config->file.c_str());
+		return -1;
+	}
+
+	int fd = open_socket(config->url);
+	if (fd < 0) {
+		fclose(file);
+		return -1;
+	}
+
+	size_t smpl_len = 2 * config->chans * sizeof(int16_t);
+	size_t pkt_len = NET_IQ_HDR_LEN + config->spp * smpl_len;
+	double rate = lte_subframe_len(config->rbs) * 1000.0;
+
+	std::vector<char> bufs(SEND_BATCH_PKTS * pkt_len);
+	std::vector<struct iovec> iovs(SEND_BATCH_PKTS);
+	std::vector<struct mmsghdr> msgs(SEND_BATCH_PKTS);
+
+	for (int i = 0; i < SEND_BATCH_PKTS; i++) {
+		iovs[i].iov_base = &bufs[i * pkt_len];
+		memset(&msgs[i], 0, sizeof(msgs[i]));
+		msgs[i].msg_hdr.msg_iov = &iovs[i];
+		msgs[i].msg_hdr.msg_iovlen = 1;
+	}
+
+	struct net_iq_hdr hdr;
+	memset(&hdr, 0, sizeof(hdr));
+	hdr.chans = config->chans;
+	hdr.rate = rate;
+
+	printf("Sending %s to %s at %f Hz, %i samples per packet\n",
+	       config->file.c_str(), config->url.c_str(), rate, config->spp);
+
+	auto start = send_clock::now();
+	bool done = false;
+	int rc = 0;
+
+	while (!done) {
+		int num;
+
+		for (num = 0; num < SEND_BATCH_PKTS; num++) {
+			char *buf = (char *) iovs[num].iov_base;
+
+			size_t len = fread(buf + NET_IQ_HDR_LEN, smpl_len,
+					   config->spp, file);
+			if (!len) {
+				done = true;
+				hdr.flags = NET_IQ_FLAG_EOS;
+			}
+
+			hdr.len = len;
+			net_iq_pack(&hdr, buf);
+			iovs[num].iov_len = NET_IQ_HDR_LEN + len * smpl_len;
+
+			hdr.seq++;
+			hdr.ts += len;
+
+			if (done) {
+				num++;
+				break;
+			}
+		}
+
+		if (!send_pkts(fd, msgs, num)) {
+			rc = -1;
+			break;
+		}
+
+		/* Pace against the wall clock unless unthrottled */
+		if (config->speed > 0.0) {
+			std::chrono::duration<double> due(hdr.ts / rate /
+							  config->speed);
+			std::this_thread::sleep_until(start +
+				std::chrono::duration_cast<send_clock::duration>(due));
+		}
+	}
+
+	double elapsed = std::chrono::duration<double>(send_clock::now() -
+						       start).count();
+
+	printf("Sent %lli samples in %u packets, %f s\n",
+	       (long long) hdr.ts, hdr.seq, elapsed);
+
+	close(fd);
+	fclose(file);
+
+	return rc;
+}
+
+int main(int argc, char **argv)
+{
+	struct send_config config;
+
+	if (handle_options(argc, argv, &config) < 0)
+		return -1;
+
+	return send_file(&config);
+}
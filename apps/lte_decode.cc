@@ -20,13 +20,23 @@
 
 #include <vector>
 #include <thread>
+#include <chrono>
 #include <cstdio>
 #include <string>
 #include <math.h>
 //#include <string.h>
 #include <stdlib.h>
+#include <strings.h>
 #include <stdint.h>
 #include <unistd.h>
+#include <signal.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <algorithm>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <sys/prctl.h>
 #include <complex>
 
 #include "../src/Resampler.h"
@@ -39,6 +49,7 @@ extern "C" {
 #include "openphy/ref.h"
 #include "openphy/sync.h"
 #include "openphy/fft.h"
+#include "openphy/hugepage.h"
 #include "../src/pcfich.h"
 #include "../src/pdsch.h"
 #include "../src/pbch.h"
@@ -54,6 +65,8 @@ extern "C" {
 }
 
 #include "openphy/io.h"
+#include "../src/record.h"
+#include "../src/index.h"
 
 /*
  * Number of LTE subframe buffers passed between PDSCH processing threads
@@ -61,15 +74,22 @@ extern "C" {
 #define NUM_RECV_SUBFRAMES		64
 
 uint16_t g_rnti;
+int g_pss_stages;
+float g_pss_margin;
 
 /* PDSCH queue */
 lte_buffer_q *pdsch_q = NULL;
 lte_buffer_q *pdsch_return_q = NULL;
 
 /* Externals */
-int sync_loop(int q, int chans, bool mib);
+int sync_loop(int q, int chans, bool mib,
+	      const struct sync_index_entry *seed = NULL);
 int pdsch_loop();
 void rrc_loop();
+int stage_start(const std::string &grid, const std::string &soft);
+void stage_close();
+void stage_stop();
+int stage_replay(const std::string &path);
 
 void enable_prio(float prio)
 {
@@ -90,13 +110,36 @@ void enable_prio(float prio)
 
 struct lte_config {
 	std::string args;
+	enum sample_format wire;
+	std::string file;
+	std::string record;
+	enum sample_format record_format;
+	std::string capture;
+	unsigned capture_events;
+	int capture_pre;
+	int capture_post;
+	std::string grid;
+	std::string soft;
+	std::string stage;
+	bool index;
+	double start;
+	double end;
+	int segments;
+	int workers;
+	bool batch;
+	std::vector<double> offsets;
+	double speed;
 	double freq;
+	int stats;
 	double gain;
 	int chans;
 	int rbs;
 	int threads;
 	uint16_t rnti;
+	int pss_stages;
+	double pss_margin;
 	enum dev_ref_type ref;
+	enum hugepage_size hugepages;
 };
 
 static void print_help()
@@ -111,7 +154,50 @@ static void print_help()
 		"  -b    Number of LTE resource blocks (default = auto)\n"
 		"  -r    LTE RNTI (default = 0xFFFF)\n"
 		"  -x    Enable external device reference (default = off)\n"
-		"  -p    Enable GPSDO reference (default = off)\n\n");
+		"  -p    Enable GPSDO reference (default = off)\n"
+		"  -W    Device wire format sc16 or sc8 (default = sc16)\n"
+		"  -i    Replay sc16 samples from file, or receive a stream on\n"
+		"        udp://host:port or tcp://host:port (requires -b)\n"
+		"        A directory replays every capture in it unthrottled\n"
+		"  -P    Number of parallel replays of a directory\n"
+		"        (default = number of processors)\n"
+		"  -s    Replay speed relative to real time (0 = unthrottled)\n"
+		"  -X    Index sync state of the replay file for seeking\n"
+		"  -t    Replay time range in seconds, start[,end]\n"
+		"  -J    Decode an indexed replay file in parallel segments\n"
+		"  -w    Record received sc16 samples to file\n"
+		"  -F    Record format sc16, sc12 (12-bit packed), bfp8\n"
+		"        (8-bit block floating point) or sc8 (default = sc16)\n"
+		"  -e    Capture samples around events to files with prefix\n"
+		"  -E    Comma separated capture events crc, sync and drop\n"
+		"        (default = all)\n"
+		"  -T    Capture milliseconds before and after an event\n"
+		"        (default = 10,10)\n"
+		"  -G    Capture post-FFT resource grids to file\n"
+		"  -B    Capture PDSCH transport block soft bits to file\n"
+		"  -R    Replay a resource grid or soft bit capture\n"
+		"  -C    Comma separated carrier offsets in Hz for wideband\n"
+		"        capture centered on the downlink frequency (requires -b)\n"
+		"  -S    Receive telemetry interval in seconds (default = off)\n"
+		"        Telemetry is also reported on SIGUSR1\n"
+		"  -H    Huge page size for sample and FFT buffers, 2M or 1G\n"
+		"        (default = off)\n"
+		"  -D    Maximum half-band stages ahead of the PSS filter\n"
+		"        (default = 0, single stage)\n"
+		"  -M    PSS detection margin, the correlation magnitude\n"
+		"        required to acquire sync (default = 900)\n\n");
+}
+
+static const char *hugepage_str(enum hugepage_size size)
+{
+	switch (size) {
+	case HUGEPAGE_2M:
+		return "2 MB";
+	case HUGEPAGE_1G:
+		return "1 GB";
+	default:
+		return "Off";
+	}
 }
 
 static void print_config(struct lte_config *config)
@@ -135,6 +221,7 @@ static void print_config(struct lte_config *config)
 	fprintf(stdout,
 		"Config:\n"
 		"    Device args.............. \"%s\"\n"
+		"    Device wire format....... %s\n"
 		"    Downlink frequency....... %.3f MHz\n"
 		"    Receive gain............. %.2f dB\n"
 		"    Receive antennas......... %i\n"
@@ -142,15 +229,100 @@ static void print_config(struct lte_config *config)
 		"    PDSCH decoding threads... %i\n"
 		"    LTE resource blocks...... %i\n"
 		"    LTE RNTI................. 0x%04x\n"
+		"    PSS half-band stages..... %i\n"
+		"    PSS detection margin..... %.1f\n"
+		"    Huge pages............... %s\n"
 		"\n",
 		config->args.c_str(),
+		sample_format_str(config->wire),
 		config->freq / 1e6,
 		config->gain,
 		config->chans,
 		refstr.c_str(),
 		config->threads,
 		config->rbs,
-		config->rnti);
+		config->rnti,
+		config->pss_stages,
+		config->pss_margin,
+		hugepage_str(config->hugepages));
+
+	if (!config->file.empty()) {
+		fprintf(stdout,
+			"    Replay file.............. \"%s\"\n"
+			"    Replay speed............. %.2f\n"
+			"\n",
+			config->file.c_str(),
+			config->speed);
+	}
+
+	if (config->batch) {
+		fprintf(stdout,
+			"    Parallel replays......... %i\n"
+			"\n",
+			config->workers);
+	}
+
+	if (config->index || config->start || config->end ||
+	    (config->segments > 1)) {
+		fprintf(stdout,
+			"    Sync index............... %s\n"
+			"    Replay range............. %.3f s to ",
+			config->index ? "Write" : "Read",
+			config->start);
+
+		if (config->end)
+			fprintf(stdout, "%.3f s\n", config->end);
+		else
+			fprintf(stdout, "end\n");
+
+		fprintf(stdout,
+			"    Replay segments.......... %i\n"
+			"\n",
+			config->segments);
+	}
+
+	for (size_t i = 0; i < config->offsets.size(); i++) {
+		fprintf(stdout,
+			"    Carrier %zu offset........ %.3f MHz\n",
+			i, config->offsets[i] / 1e6);
+	}
+
+	if (!config->offsets.empty())
+		fprintf(stdout, "\n");
+
+	if (!config->record.empty()) {
+		fprintf(stdout,
+			"    Record file.............. \"%s\"\n"
+			"    Record format............ %s\n"
+			"\n",
+			config->record.c_str(),
+			sample_format_str(config->record_format));
+	}
+
+	if (!config->capture.empty()) {
+		fprintf(stdout,
+			"    Capture prefix........... \"%s\"\n"
+			"    Capture events........... %s%s%s\n"
+			"    Capture window........... %i ms, %i ms\n"
+			"\n",
+			config->capture.c_str(),
+			config->capture_events & CAPTURE_CRC ? "crc " : "",
+			config->capture_events & CAPTURE_SYNC ? "sync " : "",
+			config->capture_events & CAPTURE_DROP ? "drop " : "",
+			config->capture_pre, config->capture_post);
+	}
+
+	if (!config->grid.empty() || !config->soft.empty() ||
+	    !config->stage.empty()) {
+		fprintf(stdout,
+			"    Grid capture............. \"%s\"\n"
+			"    Soft bit capture......... \"%s\"\n"
+			"    Stage replay............. \"%s\"\n"
+			"\n",
+			config->grid.c_str(),
+			config->soft.c_str(),
+			config->stage.c_str());
+	}
 }
 
 static bool valid_rbs(int rbs)
@@ -168,6 +340,52 @@ static bool valid_rbs(int rbs)
 	return false;
 }
 
+static bool parse_offsets(const char *str, std::vector<double> &offsets)
+{
+	char *end;
+
+	for (;;) {
+		offsets.push_back(strtod(str, &end));
+		if (end == str)
+			return false;
+		if (*end != ',')
+			break;
+
+		str = end + 1;
+	}
+
+	return !*end;
+}
+
+static bool parse_events(const char *str, unsigned *events)
+{
+	std::string list(str);
+	size_t pos = 0;
+
+	*events = 0;
+
+	for (;;) {
+		size_t end = list.find(',', pos);
+		std::string event = list.substr(pos, end - pos);
+
+		if (event == "crc")
+			*events |= CAPTURE_CRC;
+		else if (event == "sync")
+			*events |= CAPTURE_SYNC;
+		else if (event == "drop")
+			*events |= CAPTURE_DROP;
+		else
+			return false;
+
+		if (end == std::string::npos)
+			break;
+
+		pos = end + 1;
+	}
+
+	return true;
+}
+
 static int handle_options(int argc, char **argv, struct lte_config *config)
 {
 	int option;
@@ -178,9 +396,25 @@ static int handle_options(int argc, char **argv, struct lte_config *config)
 	config->rbs = 0;
 	config->threads = 1;
 	config->rnti = 0xffff;
+	config->pss_stages = 0;
+	config->pss_margin = 900.0;
 	config->ref = REF_INTERNAL;
+	config->speed = 1.0;
+	config->stats = 0;
+	config->hugepages = HUGEPAGE_NONE;
+	config->wire = FORMAT_SC16;
+	config->record_format = FORMAT_SC16;
+	config->capture_events = CAPTURE_CRC | CAPTURE_SYNC | CAPTURE_DROP;
+	config->capture_pre = 10;
+	config->capture_post = 10;
+	config->index = false;
+	config->start = 0.0;
+	config->end = 0.0;
+	config->segments = 1;
+	config->workers = sysconf(_SC_NPROCESSORS_ONLN);
+	config->batch = false;
 
-	while ((option = getopt(argc, argv, "ha:c:f:g:j:b:r:xp")) != -1) {
+	while ((option = getopt(argc, argv, "ha:c:f:g:j:b:r:xpW:i:P:s:Xt:J:w:F:e:E:T:G:B:R:C:S:H:D:M:")) != -1) {
 		switch (option) {
 		case 'h':
 			print_help();
@@ -216,6 +450,114 @@ static int handle_options(int argc, char **argv, struct lte_config *config)
 		case 'p':
 			config->ref = REF_GPSDO;
 			break;
+		case 'W':
+			if (!sample_format_parse(optarg, &config->wire) ||
+			    ((config->wire != FORMAT_SC16) &&
+			     (config->wire != FORMAT_SC8))) {
+				printf("Invalid wire format\n");
+				return -1;
+			}
+			break;
+		case 'i':
+			config->file = optarg;
+			break;
+		case 'P':
+			config->workers = atoi(optarg);
+			if (config->workers < 1) {
+				printf("Invalid number of parallel replays\n");
+				return -1;
+			}
+			break;
+		case 's':
+			config->speed = atof(optarg);
+			break;
+		case 'X':
+			config->index = true;
+			break;
+		case 't':
+			if ((sscanf(optarg, "%lf,%lf", &config->start,
+				    &config->end) < 1) || (config->start < 0.0) ||
+			    (config->end && (config->end <= config->start))) {
+				printf("Invalid replay time range\n");
+				return -1;
+			}
+			break;
+		case 'J':
+			config->segments = atoi(optarg);
+			if (config->segments < 1) {
+				printf("Invalid number of replay segments\n");
+				return -1;
+			}
+			break;
+		case 'w':
+			config->record = optarg;
+			break;
+		case 'F':
+			if (!sample_format_parse(optarg, &config->record_format)) {
+				printf("Invalid record format\n");
+				return -1;
+			}
+			break;
+		case 'e':
+			config->capture = optarg;
+			break;
+		case 'E':
+			if (!parse_events(optarg, &config->capture_events)) {
+				printf("Invalid capture events\n");
+				return -1;
+			}
+			break;
+		case 'T':
+			if ((sscanf(optarg, "%i,%i", &config->capture_pre,
+				    &config->capture_post) != 2) ||
+			    (config->capture_pre < 0) ||
+			    (config->capture_post < 0)) {
+				printf("Invalid capture window\n");
+				return -1;
+			}
+			break;
+		case 'G':
+			config->grid = optarg;
+			break;
+		case 'B':
+			config->soft = optarg;
+			break;
+		case 'R':
+			config->stage = optarg;
+			break;
+		case 'C':
+			if (!parse_offsets(optarg, config->offsets)) {
+				printf("Invalid carrier offsets\n");
+				return -1;
+			}
+			break;
+		case 'S':
+			config->stats = atoi(optarg);
+			break;
+		case 'H':
+			if (!strcasecmp(optarg, "2M")) {
+				config->hugepages = HUGEPAGE_2M;
+			} else if (!strcasecmp(optarg, "1G")) {
+				config->hugepages = HUGEPAGE_1G;
+			} else {
+				printf("Invalid huge page size\n");
+				return -1;
+			}
+			break;
+		case 'D':
+			config->pss_stages = atoi(optarg);
+			if (config->pss_stages < 0) {
+				printf("Invalid number of half-band stages\n");
+				return -1;
+			}
+			break;
+		case 'M':
+			config->pss_margin = atof(optarg);
+			if (config->pss_margin <= 0.0) {
+				printf("Invalid PSS detection margin\n");
+				return -1;
+			}
+			break;
 		default:
 			print_help();
 			return -1;
@@ -228,7 +570,55 @@ static int handle_options(int argc, char **argv, struct lte_config *config)
 		return -1;
 	}
 
-	if (config->freq < 0.0) {
+	if (!config->offsets.empty() && !config->rbs) {
+		print_help();
+		printf("\nPlease specify resource blocks for wideband capture\n");
+		return -1;
+	}
+
+	if ((config->index || config->start || config->end ||
+	     (config->segments > 1)) &&
+	    (config->file.empty() || !config->offsets.empty())) {
+		print_help();
+		printf("\nIndexing and seeking require a replay file\n");
+		return -1;
+	}
+
+	if (config->index && (config->start || config->end ||
+			      (config->segments > 1))) {
+		print_help();
+		printf("\nIndexing requires a full single replay\n");
+		return -1;
+	}
+
+	if (!config->stage.empty() &&
+	    (!config->file.empty() || !config->offsets.empty() ||
+	     !config->grid.empty())) {
+		print_help();
+		printf("\nStage replay decodes the capture without samples\n");
+		return -1;
+	}
+
+	struct stat st;
+	if (!config->file.empty() && !stat(config->file.c_str(), &st) &&
+	    S_ISDIR(st.st_mode)) {
+		if ((config->segments > 1) || !config->offsets.empty()) {
+			print_help();
+			printf("\nDirectory replay decodes whole captures\n");
+			return -1;
+		}
+
+		config->batch = true;
+		config->speed = 0.0;
+	}
+
+	if (!config->file.empty()) {
+		if (!config->rbs) {
+			print_help();
+			printf("\nPlease specify resource blocks for replay\n");
+			return -1;
+		}
+	} else if ((config->freq < 0.0) && config->stage.empty()) {
 		print_help();
 		printf("\nPlease specify downlink frequency\n");
 		return -1;
@@ -253,23 +643,583 @@ static int handle_options(int argc, char **argv, struct lte_config *config)
 
 int mib_search(int chans);
 
+/*
+ * Report receive telemetry on SIGUSR1 and optionally at a fixed interval.
+ * The signal is blocked in all other threads.
+ */
+static void stats_loop(int interval)
+{
+	sigset_t set;
+	struct timespec timeout = { interval, 0 };
+
+	sigemptyset(&set);
+	sigaddset(&set, SIGUSR1);
+
+	for (;;) {
+		int sig;
+
+		if (interval > 0)
+			sig = sigtimedwait(&set, NULL, &timeout);
+		else
+			sig = sigwaitinfo(&set, NULL);
+
+		if ((sig < 0) && (errno != EAGAIN))
+			continue;
+
+		LOG_DEV(lte_iface_stats().c_str());
+	}
+}
+
+/*
+ * Finalize recordings, event captures, the sync index and stage captures on
+ * SIGINT or SIGTERM, then exit. A live receiver only returns from the sync
+ * loop if it fails, so this is its orderly shutdown. The signals are blocked
+ * in all other threads.
+ */
+static void shutdown_loop()
+{
+	sigset_t set;
+	int sig;
+
+	sigemptyset(&set);
+	sigaddset(&set, SIGINT);
+	sigaddset(&set, SIGTERM);
+
+	while (sigwait(&set, &sig))
+		;
+
+	fprintf(stdout, "Shutdown: Caught signal %i\n", sig);
+
+	LOG_DEV(lte_iface_stats().c_str());
+	lte_record_stop();
+	lte_capture_stop();
+	lte_index_stop();
+	stage_close();
+
+	fflush(stdout);
+	_exit(0);
+}
+
+/* Threads are not inherited across fork(), so start one in every process */
+static void start_shutdown()
+{
+	static pid_t pid = 0;
+
+	if (pid == getpid())
+		return;
+
+	pid = getpid();
+	std::thread(shutdown_loop).detach();
+}
+
+/* Number the output files of one of several decoding processes */
+static void suffix_outputs(struct lte_config *config, size_t n)
+{
+	std::string *paths[] = {
+		&config->record, &config->capture, &config->grid, &config->soft,
+	};
+
+	for (size_t i = 0; i < sizeof(paths) / sizeof(paths[0]); i++) {
+		if (!paths[i]->empty())
+			*paths[i] += "." + std::to_string(n);
+	}
+}
+
+/*
+ * Run the decoding pipeline on the initialized receive interface, optionally
+ * resuming from indexed sync state
+ */
+static int decode(struct lte_config *config,
+		  const struct sync_index_entry *seed = NULL)
+{
+	std::vector<std::thread> threads;
+
+	start_shutdown();
+
+	if (!config->record.empty() &&
+	    (lte_record_start(config->record, config->freq, config->gain,
+			      config->record_format) < 0)) {
+		fprintf(stderr, "Record: Failed to initialize\n");
+		return -1;
+	}
+
+	if (!config->capture.empty() &&
+	    (lte_capture_start(config->capture, config->freq, config->gain,
+			       config->record_format, config->capture_events,
+			       config->capture_pre, config->capture_post) < 0)) {
+		fprintf(stderr, "Capture: Failed to initialize\n");
+		return -1;
+	}
+
+	if (config->index &&
+	    (lte_index_start(sync_index_path(config->file)) < 0)) {
+		fprintf(stderr, "Index: Failed to initialize\n");
+		return -1;
+	}
+
+	if ((!config->grid.empty() || !config->soft.empty()) &&
+	    (stage_start(config->grid, config->soft) < 0)) {
+		fprintf(stderr, "Stage: Failed to initialize\n");
+		return -1;
+	}
+
+	pdsch_q = new lte_buffer_q();
+	pdsch_return_q = new lte_buffer_q();
+
+	/* Prime the interthread queue */
+	for (int i = 0; i < NUM_RECV_SUBFRAMES; i++)
+		pdsch_return_q->write(new lte_buffer(config->chans));
+
+	/* Launch threads */
+	threads.push_back(std::thread(rrc_loop));
+
+	for (int i = 0; i < config->threads; i++)
+		threads.push_back(std::thread(pdsch_loop));
+
+	std::thread(stats_loop, config->stats).detach();
+
+	sync_loop(config->rbs, config->chans, false, seed);
+
+	/*
+	 * The sync loop returns once a replay or channelizer source is
+	 * exhausted, or when a live receiver fails. Decoding threads block on
+	 * their queues, so drain them and finalize the outputs here.
+	 */
+	while (pdsch_return_q->size() < NUM_RECV_SUBFRAMES)
+		usleep(1000);
+
+	LOG_DEV(lte_iface_stats().c_str());
+	lte_record_stop();
+	lte_capture_stop();
+	lte_index_stop();
+	stage_stop();
+
+	for (auto &thread : threads)
+		thread.detach();
+
+	if (config->file.empty() && config->offsets.empty()) {
+		fprintf(stderr, "Radio: Receiver stopped\n");
+		return -1;
+	}
+
+	return 0;
+}
+
+/*
+ * Replay the capture from a sample offset up to an end offset, or to the end
+ * of the capture if zero. With sync state from the index, replay starts one
+ * subframe ahead of the indexed frame and skips cell acquisition.
+ */
+static int replay(struct lte_config *config, int64_t start, int64_t end,
+		  const struct sync_index_entry *seed)
+{
+	if (lte_file_iface_init(config->file, config->chans,
+				config->rbs, config->speed) < 0) {
+		fprintf(stderr, "File: Failed to initialize\n");
+		return -1;
+	}
+
+	if (seed)
+		start = seed->ts - lte_subframe_len(config->rbs);
+
+	if ((start || end) && (lte_file_iface_seek(start, end) < 0)) {
+		fprintf(stderr, "File: Failed to seek\n");
+		return -1;
+	}
+
+	return decode(config, seed);
+}
+
+/* Index entries usable as a starting point for the configured bandwidth */
+static bool read_index(struct lte_config *config,
+		       std::vector<sync_index_entry> &index)
+{
+	std::string path = sync_index_path(config->file);
+	int len = lte_subframe_len(config->rbs);
+
+	if (!sync_index_read(path, index))
+		return false;
+
+	for (size_t i = 0; i < index.size(); i++) {
+		if (index[i].rbs != config->rbs) {
+			fprintf(stderr, "Index: %s was built for %i resource "
+				"blocks\n", path.c_str(), index[i].rbs);
+			index.clear();
+			return false;
+		}
+	}
+
+	/* Entries without a preceding subframe cannot be resumed */
+	while (!index.empty() && (index.front().ts < len))
+		index.erase(index.begin());
+
+	return !index.empty();
+}
+
+/*
+ * Replay the configured time range. Decoding resumes from the last indexed
+ * frame at or before the start when the capture is indexed.
+ */
+static int decode_range(struct lte_config *config)
+{
+	std::vector<sync_index_entry> index;
+	const sync_index_entry *seed = NULL;
+	double rate = lte_subframe_len(config->rbs) * 1000.0;
+	int64_t start = config->start * rate;
+	int64_t end = config->end * rate;
+
+	if ((start || end) && read_index(config, index))
+		seed = sync_index_find(index, start);
+
+	return replay(config, start, end, seed);
+}
+
+/*
+ * Split an indexed capture at frame boundaries and decode each segment in
+ * its own process. Every segment resumes from indexed sync state, so no
+ * segment waits on cell acquisition or on the segments before it.
+ */
+static int decode_segments(struct lte_config *config)
+{
+	std::vector<sync_index_entry> index;
+	std::vector<pid_t> pids;
+	double rate = lte_subframe_len(config->rbs) * 1000.0;
+	int64_t start = config->start * rate;
+	int64_t end = config->end * rate;
+	int rc = 0;
+
+	if (!read_index(config, index)) {
+		fprintf(stderr, "Segments: No usable index for %s, "
+			"index with -X first\n", config->file.c_str());
+		return -1;
+	}
+
+	/* Restrict to frames within the time range */
+	const sync_index_entry *first = sync_index_find(index, start);
+	if (first)
+		index.erase(index.begin(), index.begin() + (first - &index[0]));
+	while (end && !index.empty() && (index.back().ts >= end))
+		index.pop_back();
+
+	if (index.empty()) {
+		fprintf(stderr, "Segments: No indexed frames in range\n");
+		return -1;
+	}
+
+	size_t num = config->segments;
+	if (num > index.size())
+		num = index.size();
+
+	for (size_t i = 0; i < num; i++) {
+		size_t n = i * index.size() / num;
+		size_t next = (i + 1) * index.size() / num;
+
+		/*
+		 * The next segment starts one subframe before its first frame
+		 * to prime the subframe delay history, and leaves decoding of
+		 * that subframe to this segment. Reading half a subframe past
+		 * the frame lets the final subframe follow timing drift.
+		 */
+		int64_t seg_end = end;
+		if (next < index.size())
+			seg_end = index[next].ts + lte_subframe_len(config->rbs) / 2;
+
+		pid_t pid = fork();
+		if (pid < 0) {
+			fprintf(stderr, "Segments: Failed to fork segment %zu\n", i);
+			rc = -1;
+			break;
+		}
+
+		if (!pid) {
+			prctl(PR_SET_PDEATHSIG, SIGTERM);
+
+			fprintf(stdout, "Segment %zu: Decoding from %.3f s, "
+				"SFN %i in process %i\n", i, index[n].ts / rate,
+				index[n].sfn, (int) getpid());
+
+			suffix_outputs(config, i);
+
+			exit(replay(config, 0, seg_end, &index[n]) < 0 ? 1 : 0);
+		}
+
+		pids.push_back(pid);
+	}
+
+	for (size_t i = 0; i < pids.size(); i++) {
+		int status;
+
+		if ((waitpid(pids[i], &status, 0) < 0) ||
+		    !WIFEXITED(status) || WEXITSTATUS(status))
+			rc = -1;
+	}
+
+	return rc;
+}
+
+/* Sidecar files written next to captures are not replayed */
+static bool is_capture(const std::string &name)
+{
+	const char *sidecars[] = { ".meta", ".idx", ".log" };
+
+	if (name.empty() || (name[0] == '.'))
+		return false;
+
+	for (size_t i = 0; i < sizeof(sidecars) / sizeof(sidecars[0]); i++) {
+		std::string suffix(sidecars[i]);
+
+		if ((name.size() > suffix.size()) &&
+		    !name.compare(name.size() - suffix.size(),
+				  suffix.size(), suffix))
+			return false;
+	}
+
+	return true;
+}
+
+static bool list_captures(const std::string &dir,
+			  std::vector<std::string> &files)
+{
+	DIR *d = opendir(dir.c_str());
+	if (!d)
+		return false;
+
+	struct dirent *ent;
+	while ((ent = readdir(d))) {
+		std::string path = dir + "/" + ent->d_name;
+		struct stat st;
+
+		if (is_capture(ent->d_name) && !stat(path.c_str(), &st) &&
+		    S_ISREG(st.st_mode))
+			files.push_back(path);
+	}
+
+	closedir(d);
+	std::sort(files.begin(), files.end());
+
+	return true;
+}
+
+/*
+ * Replay one capture of a directory with output sent to a log file next to
+ * the capture
+ */
+static int decode_batch_file(struct lte_config *config,
+			     const std::string &path, size_t n)
+{
+	std::string log = path + ".log";
+
+	int fd = open(log.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if (fd < 0) {
+		fprintf(stderr, "Batch: Failed to open %s\n", log.c_str());
+		return -1;
+	}
+
+	dup2(fd, STDOUT_FILENO);
+	dup2(fd, STDERR_FILENO);
+	close(fd);
+
+	config->file = path;
+
+	suffix_outputs(config, n);
+
+	return decode_range(config);
+}
+
+/*
+ * Replay every capture in a directory with a pool of decoding processes.
+ * FFT plans are measured once before the pool is forked and are inherited
+ * through FFTW wisdom along with the tables built at startup, so each
+ * capture only pays for its own acquisition and decoding.
+ */
+static int decode_batch(struct lte_config *config)
+{
+	std::vector<std::string> files;
+	std::vector<std::pair<pid_t, size_t> > running;
+	int failed = 0;
+
+	if (!list_captures(config->file, files) || files.empty()) {
+		fprintf(stderr, "Batch: No captures in %s\n",
+			config->file.c_str());
+		return -1;
+	}
+
+	lte_ofdm_plan(6);
+	lte_ofdm_plan(config->rbs);
+
+	fprintf(stdout, "Batch: Decoding %zu captures with %i processes\n",
+		files.size(), config->workers);
+
+	auto start = std::chrono::steady_clock::now();
+	size_t next = 0;
+
+	while ((next < files.size()) || !running.empty()) {
+		if ((next < files.size()) &&
+		    (running.size() < (size_t) config->workers)) {
+			fflush(stdout);
+
+			pid_t pid = fork();
+			if (pid < 0) {
+				fprintf(stderr, "Batch: Failed to fork\n");
+				return -1;
+			}
+
+			if (!pid) {
+				prctl(PR_SET_PDEATHSIG, SIGTERM);
+				exit(decode_batch_file(config, files[next],
+						       next) < 0 ? 1 : 0);
+			}
+
+			running.push_back(std::make_pair(pid, next++));
+			continue;
+		}
+
+		int status;
+		pid_t pid = wait(&status);
+		if (pid < 0)
+			break;
+
+		for (size_t i = 0; i < running.size(); i++) {
+			if (running[i].first != pid)
+				continue;
+
+			bool ok = WIFEXITED(status) && !WEXITSTATUS(status);
+			if (!ok)
+				failed++;
+
+			fprintf(stdout, "Batch: %s %s\n",
+				files[running[i].second].c_str(),
+				ok ? "done" : "failed");
+
+			running.erase(running.begin() + i);
+			break;
+		}
+	}
+
+	double elapsed = std::chrono::duration<double>(
+		std::chrono::steady_clock::now() - start).count();
+
+	fprintf(stdout, "Batch: Decoded %zu captures in %.1f s, %i failed\n",
+		files.size(), elapsed, failed);
+
+	return failed ? -1 : 0;
+}
+
+/*
+ * Fork one decoding process per carrier, then capture wideband samples and
+ * channelize in the parent process. Carrier processes share only the
+ * channelizer output rings, so each runs an independent pipeline.
+ */
+static int decode_carriers(struct lte_config *config)
+{
+	std::vector<pid_t> pids;
+	int rc;
+
+	int decim = lte_chan_iface_init(config->offsets,
+					config->chans, config->rbs);
+	if (decim < 0) {
+		fprintf(stderr, "Channelizer: Failed to initialize\n");
+		return -1;
+	}
+
+	for (size_t i = 0; i < config->offsets.size(); i++) {
+		pid_t pid = fork();
+		if (pid < 0) {
+			fprintf(stderr, "Channelizer: Failed to fork carrier %zu\n", i);
+			break;
+		}
+
+		if (!pid) {
+			prctl(PR_SET_PDEATHSIG, SIGTERM);
+
+			fprintf(stdout, "Carrier %zu: Decoding in process %i\n",
+				i, (int) getpid());
+
+			if (lte_chan_iface_select(i, config->chans,
+						  config->rbs) < 0)
+				exit(1);
+
+			suffix_outputs(config, i);
+
+			exit(decode(config) < 0 ? 1 : 0);
+		}
+
+		pids.push_back(pid);
+	}
+
+	std::thread(stats_loop, config->stats).detach();
+
+	if (!config->file.empty()) {
+		rc = lte_chan_file_run(config->file, config->chans,
+				       config->rbs, config->speed, decim);
+	} else {
+		rc = lte_chan_iface_run(config->freq, config->chans,
+					config->gain, config->rbs,
+					config->ref, config->args, decim,
+					config->wire);
+	}
+
+	for (size_t i = 0; i < pids.size(); i++)
+		waitpid(pids[i], NULL, 0);
+
+	return rc;
+}
+
+/*
+ * Decode a stage capture. Soft bits of transport blocks decoded from
+ * resource grids can be captured again for a later stage.
+ */
+static int decode_stages(struct lte_config *config)
+{
+	if (!config->soft.empty() && (stage_start("", config->soft) < 0)) {
+		fprintf(stderr, "Stage: Failed to initialize\n");
+		return -1;
+	}
+
+	int rc = stage_replay(config->stage);
+
+	stage_stop();
+
+	return rc;
+}
+
 int main(int argc, char **argv)
 {
 	struct lte_config config;
-	struct lte_buffer *buf;
-	std::vector<std::thread> threads;
 
 	if (handle_options(argc, argv, &config) < 0)
 		return -1;
 
+	/* Buffer placement must be selected before any allocation */
+	hugepage_init(config.hugepages);
+
+	/* Telemetry and shutdown requests are handled by dedicated threads */
+	sigset_t set;
+	sigemptyset(&set);
+	sigaddset(&set, SIGUSR1);
+	sigaddset(&set, SIGINT);
+	sigaddset(&set, SIGTERM);
+	pthread_sigmask(SIG_BLOCK, &set, NULL);
+
+	/* Forked decoding processes exit with the parent */
+	start_shutdown();
+
 	g_rnti = config.rnti;
+	g_pss_stages = config.pss_stages;
+	g_pss_margin = config.pss_margin;
 
 	print_config(&config);
 
+	if (!config.stage.empty())
+		return decode_stages(&config);
+
+	if (!config.offsets.empty())
+		return decode_carriers(&config);
+
 	if (!config.rbs) {
 		if (lte_radio_iface_init(config.freq, config.chans,
 					 config.gain, 6, config.ref,
-					 config.args) < 0) {
+					 config.args, config.wire) < 0) {
 			fprintf(stderr, "Radio: Failed to initialize\n");
 			return -1;
 		}
@@ -278,33 +1228,22 @@ int main(int argc, char **argv)
 		lte_radio_iface_reset();
 	}
 
+	if (!config.file.empty()) {
+		if (config.batch)
+			return decode_batch(&config);
+		if (config.segments > 1)
+			return decode_segments(&config);
+
+		return decode_range(&config);
+	}
+
 	if (lte_radio_iface_init(config.freq, config.chans,
 				 config.gain, config.rbs,
-				 config.ref, config.args) < 0) {
+				 config.ref, config.args,
+				 config.wire) < 0) {
 		fprintf(stderr, "Radio: Failed to initialize\n");
 		return -1;
 	}
 
-	pdsch_q = new lte_buffer_q();
-	pdsch_return_q = new lte_buffer_q();
-
-	/* Prime the interthread queue */
-	for (int i = 0; i < NUM_RECV_SUBFRAMES; i++)
-		pdsch_return_q->write(new lte_buffer(config.chans));
-
-	/* Launch threads */
-	threads.push_back(std::thread(rrc_loop));
-
-	for (int i = 0; i < config.threads; i++)
-		threads.push_back(std::thread(pdsch_loop));
-
-	sync_loop(config.rbs, config.chans, false);
-
-	for (auto &thread : threads)
-		thread.join();
-
-	delete pdsch_q;
-	delete pdsch_return_q;
-
-	return 0;
+	return decode(&config);
 }
@@ -0,0 +1,132 @@
+/*
+ * PSS Decimator Benchmark
+ *
+ * Copyright (C) 2015 Ettus Research LLC
+ * Author Tom Tsou <tom.tsou@ettus.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <vector>
+#include <chrono>
+#include <algorithm>
+
+extern "C" {
+#include "../src/slot.h"
+#include "openphy/sigvec.h"
+}
+
+#include "../src/Decimator.h"
+
+/* Matches the subframe conversion of the PSS path */
+#define SC16_SCALE	(1.0f / 127.0f)
+
+/* PSS samples per subframe at 1.92 Msps */
+#define PSS_LEN		(LTE_BASE_SUBFRAME_LEN / 32)
+
+/* Decimation factors of the supported bandwidths */
+static const int pss_qs[] = { 4, 12, 16, 24, 32 };
+
+/*
+ * Median time in microseconds to decimate one subframe to PSS_LEN samples,
+ * after a warm up pass over every iteration
+ */
+static double bench(Decimator *dec, int q, int iters, int *stages)
+{
+	int len = PSS_LEN * q;
+	std::vector<short> in(2 * len);
+	std::vector<double> usecs(iters);
+
+	srand(q);
+	for (int i = 0; i < 2 * len; i++)
+		in[i] = rand() % 4096 - 2048;
+
+	if (!dec->init(len))
+		return -1.0;
+
+	*stages = dec->halfbands();
+
+	struct cxvec *out = cxvec_alloc(PSS_LEN, 0, 0, NULL,
+					CXVEC_FLG_FFT_ALIGN);
+
+	for (int i = 0; i < iters; i++)
+		dec->rotate(&in[0], len, out, SC16_SCALE);
+
+	for (int i = 0; i < iters; i++) {
+		auto start = std::chrono::steady_clock::now();
+		dec->rotate(&in[0], len, out, SC16_SCALE);
+		auto end = std::chrono::steady_clock::now();
+
+		usecs[i] = std::chrono::duration<double, std::micro>(end -
+								   start).count();
+	}
+
+	cxvec_free(out);
+
+	std::sort(usecs.begin(), usecs.end());
+
+	return usecs[iters / 2];
+}
+
+/*
+ * Compare the single-stage PSS filter against the multistage decimator for
+ * each decimation factor in use, as selected with -D in lte_decode
+ */
+int main(int argc, char **argv)
+{
+	int taps = 384, max_stages = 4, iters = 10000;
+
+	if (argc > 4) {
+		printf("%s [half-band stages] [taps] [iterations]\n", argv[0]);
+		return 0;
+	}
+
+	if (argc > 1)
+		max_stages = atoi(argv[1]);
+	if (argc > 2)
+		taps = atoi(argv[2]);
+	if (argc > 3)
+		iters = atoi(argv[3]);
+
+	if ((max_stages < 1) || (taps < 1) || (iters < 1)) {
+		printf("Invalid arguments\n");
+		return 1;
+	}
+
+	printf("One subframe to %i PSS samples, %i taps, median of %i\n\n",
+	       PSS_LEN, taps, iters);
+	printf("  Q    stages   single-stage   multistage\n");
+
+	for (size_t i = 0; i < sizeof(pss_qs) / sizeof(pss_qs[0]); i++) {
+		int q = pss_qs[i], single_stages, multi_stages;
+
+		Decimator single(q, taps, 0);
+		Decimator multi(q, taps, max_stages);
+
+		double single_us = bench(&single, q, iters, &single_stages);
+		double multi_us = bench(&multi, q, iters, &multi_stages);
+
+		if ((single_us < 0.0) || (multi_us < 0.0)) {
+			printf("Decimator initialization failed for Q=%i\n", q);
+			return 1;
+		}
+
+		printf("  %-4i   %i      %6.1f us      %6.1f us\n",
+		       q, multi_stages, single_us, multi_us);
+	}
+
+	return 0;
+}
@@ -8,14 +8,16 @@
 
 extern "C" {
 #include "openphy/lte.h"
-#include "../src/buffer.h"
+#include "openphy/hugepage.h"
 }
 
+#include "../src/buffer.h"
+
 struct lte_subframe;
 
 struct lte_buffer {
 	lte_buffer(size_t chans)
-	 : tx_ants(0), rx_ants(chans), rbs(0), n_id_cell(0), ng(0),
+	 : tx_ants(0), rx_ants(chans), rbs(0), n_id_cell(0), ng(0), ts(-1),
 	   bufs(chans, NULL), crc_pass(false), subframe(chans, NULL)
 	{
 	}
@@ -23,7 +25,7 @@ struct lte_buffer {
 	~lte_buffer()
 	{
 		for (size_t i = 0; i < bufs.size(); i++) {
-			free(bufs[i]);
+			hugepage_free(bufs[i]);
 			free(subframe[i]);
 		}
 	}
@@ -34,6 +36,9 @@ struct lte_buffer {
 	int ng;
 	struct lte_time time;
 
+	/* Receive timestamp of the subframe or negative if unknown */
+	int64_t ts;
+
 	bool crc_pass;
 	std::vector<short *> bufs;
 	std::vector<struct lte_subframe *> subframe;
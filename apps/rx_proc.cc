@@ -27,6 +27,7 @@ extern "C" {
 }
 
 #include "openphy/io.h"
+#include "../src/stage.h"
 
 #define LTE_PDCCH_MAX_BITS		6269
 
@@ -44,6 +45,10 @@ static float favg2[AVG_FREQ2];
 extern uint16_t g_rnti;
 extern int gn_id_cell;
 
+/* Decoder stage captures */
+static stage_writer *grid_cap = NULL;
+static stage_writer *soft_cap = NULL;
+
 static void log_ofdm_comp_offset(float offset)
 {
 	char sbuf[80];
@@ -94,6 +99,126 @@ static int preprocess_pdcch(short *buf, struct cxvec *vec)
 	return 0;
 }
 
+static void capture_soft(const struct lte_pdsch_soft *soft)
+{
+	struct stage_soft hdr;
+
+	hdr.tbs = soft->tbs;
+	hdr.G = soft->G;
+	hdr.mod = soft->mod;
+	hdr.rv = soft->rv;
+	hdr.rnti = soft->rnti;
+	hdr.dci_type = soft->dci_type;
+	hdr.frame = soft->frame;
+	hdr.subframe = soft->subframe;
+	hdr.n_id_cell = soft->n_id_cell;
+	hdr.reserved = 0;
+
+	soft_cap->write(hdr, soft->f);
+}
+
+/* Write the converted resource grid of every receive antenna */
+static void capture_grid(lte_buffer *lbuf, std::vector<float> &grid)
+{
+	struct stage_grid hdr;
+	size_t len = 2 * lte_subframe_grid_len(lbuf->rbs);
+
+	grid.resize(lbuf->rx_ants * len);
+
+	for (size_t i = 0; i < lbuf->rx_ants; i++) {
+		if (lte_subframe_grid_save(lbuf->subframe[i], &grid[i * len]) < 0)
+			return;
+	}
+
+	hdr.rbs = lbuf->rbs;
+	hdr.n_id_cell = lbuf->n_id_cell;
+	hdr.ng = lbuf->ng;
+	hdr.tx_ants = lbuf->tx_ants;
+	hdr.rx_ants = lbuf->rx_ants;
+	hdr.frame = lbuf->time.frame;
+	hdr.subframe = lbuf->time.subframe;
+	hdr.reserved = 0;
+	hdr.ts = lbuf->ts;
+
+	grid_cap->write(hdr, &grid.front(), grid.size());
+}
+
+/*
+ * Finalize stage captures while decoding threads may still be running. The
+ * writers remain allocated and discard later records.
+ */
+void stage_close()
+{
+	if (grid_cap)
+		grid_cap->close();
+	if (soft_cap)
+		soft_cap->close();
+}
+
+void stage_stop()
+{
+	lte_pdsch_set_tap(NULL);
+
+	delete grid_cap;
+	delete soft_cap;
+
+	grid_cap = NULL;
+	soft_cap = NULL;
+}
+
+/*
+ * Open stage captures for the post-FFT resource grid and the transport
+ * block soft bits. Either path may be empty.
+ */
+int stage_start(const std::string &grid, const std::string &soft)
+{
+	if (!grid.empty()) {
+		grid_cap = new stage_writer();
+		if (!grid_cap->open(grid)) {
+			stage_stop();
+			return -1;
+		}
+	}
+
+	if (!soft.empty()) {
+		soft_cap = new stage_writer();
+		if (!soft_cap->open(soft)) {
+			stage_stop();
+			return -1;
+		}
+
+		lte_pdsch_set_tap(capture_soft);
+	}
+
+	return 0;
+}
+
+/*
+ * Decode control and shared channels of subframes with converted resource
+ * grids. Returns the number of transport blocks that passed CRC.
+ */
+static int decode_dci(struct lte_subframe **subframe, int rx_ants, int cfi,
+		      int n_id_cell, int ng, struct lte_time *time,
+		      struct lte_pdsch_blk *pdsch_blk, int64_t ts)
+{
+	int num_dci, rc, pass = 0;
+
+	num_dci = lte_decode_pdcch(subframe, rx_ants, cfi, n_id_cell, ng,
+				   g_rnti, pdcch_scram_seq[time->subframe]);
+
+	for (int i = 0; i < num_dci; i++) {
+		lte_log_time(time);
+		rc = lte_decode_pdsch(subframe, rx_ants, pdsch_blk,
+				      cfi, i, time);
+		if (rc > 0)
+			pass++;
+		else if (!rc)
+			lte_capture_trigger(CAPTURE_CRC, ts);
+	}
+
+	return pass;
+}
+
 int pdsch_loop()
 {
 	int i, rc;
@@ -103,6 +228,7 @@ int pdsch_loop()
 	struct lte_time time;
 	struct lte_dci dci;
 	struct lte_pcfich_info info;
+	std::vector<float> grid;
 
 	struct lte_pdsch_blk *pdsch_blk = lte_pdsch_blk_alloc();
 
@@ -161,6 +287,9 @@ int pdsch_loop()
 				       lbuf->n_id_cell,
 				       pcfich_scram_seq[time.subframe], lbuf->rx_ants);
 
+		if (grid_cap)
+			capture_grid(lbuf, grid);
+
 		float offset = 0.0f;
 		float offsets[lbuf->rx_ants];
 
@@ -185,28 +314,13 @@ int pdsch_loop()
 			log_ofdm_comp_offset(avg);
 			lte_offset_freq(avg);
 		}
-#if 1
+
 		if ((rc > 0) && (info.cfi > 0) && (info.cfi < 4)) {
-			int num_dci;
-			num_dci = lte_decode_pdcch(lbuf->subframe.data(),
-					     lbuf->rx_ants,
-					     info.cfi,
-					     lbuf->n_id_cell,
-					     lbuf->ng,
-					     g_rnti,
-					     pdcch_scram_seq[time.subframe]);
-#if 1
-			for (int i = 0; i < num_dci; i++) {
-				lte_log_time(&time);
-				rc = lte_decode_pdsch(&lbuf->subframe[0],
-						      lbuf->rx_ants, pdsch_blk,
-						      info.cfi, i, &time);
-				if (rc > 0)
-					lbuf->crc_pass = true;
-			}
-#endif
+			if (decode_dci(lbuf->subframe.data(), lbuf->rx_ants,
+				       info.cfi, lbuf->n_id_cell, lbuf->ng,
+				       &time, pdsch_blk, lbuf->ts) > 0)
+				lbuf->crc_pass = true;
 		}
-#endif
 #endif
 		pdsch_return_q->write(lbuf);
 	}
@@ -217,3 +331,141 @@ int pdsch_loop()
 }
 
 
+
+/* Restart decoding of a captured subframe after the FFT */
+static int replay_grid(const struct stage_record &rec,
+		       std::vector<struct lte_subframe *> &subframe,
+		       struct lte_pdsch_blk *pdsch_blk)
+{
+	const struct stage_grid &hdr = rec.grid;
+	struct lte_pcfich_info info;
+	struct lte_time time;
+	int rc, len = 2 * lte_subframe_grid_len(hdr.rbs);
+
+	if ((len <= 0) || (hdr.rx_ants < 1) || (hdr.rx_ants > 2) ||
+	    (hdr.subframe < 0) || (hdr.subframe > 9) ||
+	    (rec.data.size() != hdr.rx_ants * len * sizeof(float))) {
+		fprintf(stderr, "Stage: Invalid resource grid record\n");
+		return -1;
+	}
+
+	bool change = (subframe.size() != (size_t) hdr.rx_ants) ||
+		      (subframe[0]->rbs != hdr.rbs) ||
+		      (subframe[0]->cell_id != hdr.n_id_cell) ||
+		      (subframe[0]->tx_ants != hdr.tx_ants);
+
+	if (change) {
+		for (size_t i = 0; i < subframe.size(); i++)
+			lte_subframe_free(subframe[i]);
+
+		subframe.clear();
+		gen_pdcch_refs(hdr.n_id_cell, hdr.rbs);
+		gen_sequences(hdr.n_id_cell);
+	}
+
+	for (int i = 0; i < hdr.rx_ants; i++) {
+		if (change) {
+			subframe.push_back(lte_subframe_alloc(hdr.rbs,
+				hdr.n_id_cell, hdr.tx_ants,
+				pdcch_map[hdr.subframe * 2 + 0],
+				pdcch_map[hdr.subframe * 2 + 1]));
+			if (!subframe.back())
+				return -1;
+		} else {
+			lte_subframe_reset(subframe[i],
+				pdcch_map[hdr.subframe * 2 + 0],
+				pdcch_map[hdr.subframe * 2 + 1]);
+		}
+
+		const float *grid = (const float *) &rec.data[i * len * sizeof(float)];
+		lte_subframe_grid_load(subframe[i], grid);
+
+		subframe[i]->time.subframe = hdr.subframe;
+	}
+
+	time.frame = hdr.frame;
+	time.subframe = hdr.subframe;
+
+	rc = lte_decode_pcfich(&info, subframe.data(), hdr.n_id_cell,
+			       pcfich_scram_seq[hdr.subframe], hdr.rx_ants);
+	if ((rc <= 0) || (info.cfi < 1) || (info.cfi > 3))
+		return 0;
+
+	return decode_dci(subframe.data(), hdr.rx_ants, info.cfi,
+			  hdr.n_id_cell, hdr.ng, &time, pdsch_blk, hdr.ts);
+}
+
+/* Restart decoding of a captured transport block at turbo decoding */
+static int replay_soft(const struct stage_record &rec,
+		       struct lte_pdsch_blk *pdsch_blk)
+{
+	const struct stage_soft &hdr = rec.soft;
+	struct lte_pdsch_soft soft;
+	struct lte_time time;
+
+	if ((hdr.G <= 0) || (rec.data.size() != (size_t) hdr.G)) {
+		fprintf(stderr, "Stage: Invalid soft bit record\n");
+		return -1;
+	}
+
+	soft.tbs = hdr.tbs;
+	soft.G = hdr.G;
+	soft.mod = hdr.mod;
+	soft.rv = hdr.rv;
+	soft.rnti = hdr.rnti;
+	soft.dci_type = hdr.dci_type;
+	soft.frame = hdr.frame;
+	soft.subframe = hdr.subframe;
+	soft.n_id_cell = hdr.n_id_cell;
+	soft.f = (const int8_t *) &rec.data.front();
+
+	time.frame = hdr.frame;
+	time.subframe = hdr.subframe;
+	lte_log_time(&time);
+
+	return lte_decode_pdsch_soft(pdsch_blk, &soft);
+}
+
+/*
+ * Replay a stage capture without the receive front end. Resource grids
+ * resume with control channel decoding after the FFT and channel estimation,
+ * and soft bits resume with turbo decoding of the transport block.
+ */
+int stage_replay(const std::string &path)
+{
+	stage_reader reader;
+	stage_record rec;
+	std::vector<struct lte_subframe *> subframe;
+	unsigned grids = 0, blocks = 0, pass = 0;
+	int rc = 0;
+
+	if (!reader.open(path))
+		return -1;
+
+	struct lte_pdsch_blk *pdsch_blk = lte_pdsch_blk_alloc();
+
+	while (reader.next(rec)) {
+		if (rec.tag == STAGE_GRID_TAG) {
+			rc = replay_grid(rec, subframe, pdsch_blk);
+			grids++;
+		} else {
+			rc = replay_soft(rec, pdsch_blk);
+			blocks++;
+		}
+
+		if (rc < 0)
+			break;
+
+		pass += rc;
+	}
+
+	for (size_t i = 0; i < subframe.size(); i++)
+		lte_subframe_free(subframe[i]);
+
+	lte_pdsch_blk_free(pdsch_blk);
+
+	fprintf(stdout, "Stage: Replayed %u subframe grids and %u transport "
+		"blocks, %u blocks passed CRC\n", grids, blocks, pass);
+
+	return rc < 0 ? -1 : 0;
+}
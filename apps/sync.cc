@@ -30,6 +30,7 @@
 #include "queue.h"
 #include "rrc.h"
 #include "io_subframe.h"
+#include "../src/index.h"
 
 extern "C" {
 #include "openphy/lte.h"
@@ -57,6 +58,32 @@ extern "C" {
 #define AVG_FREQ			2
 #define HIST_LEN			220
 
+/* PSS misses while tracking before a capture is triggered */
+#define CAPTURE_MISS_STREAK		4
+
+/* Receive gaps up to this many subframes are tracked from the last timing */
+#define GAP_RETRACK_MAX			100
+
+/*
+ * PSS samples read by fine synchronization and frequency domain detection
+ * while tracking, the correlation window and the sequence ahead of it
+ */
+#define PSS_TRACK_START			(LTE_PSS_FINE_START - LTE_N0_SYM_LEN + 1)
+#define PSS_TRACK_LEN			(LTE_PSS_FINE_START + LTE_PSS_FINE_LEN - \
+					 PSS_TRACK_START)
+
+/* Cell configuration decoded from the MIB or restored from an index */
+static struct lte_mib cell_mib;
+
+/* Set while PSS tracking holds frame timing */
+static bool pss_lock;
+
+/* Set for the subframe that primes a resumed replay */
+static bool seed_prime;
+
+/* Set while the current subframe contains zero filled samples */
+static bool gap_overlap;
+
 static int favg_cnt;
 static float favg[AVG_FREQ];
 static float fwid[AVG_FREQ];
@@ -76,6 +103,10 @@ extern lte_buffer_q *pdsch_q;
 extern lte_buffer_q *pdsch_return_q;
 extern struct subframe_state subframe_table[10];
 
+extern uint16_t g_rnti;
+extern int g_pss_stages;
+extern float g_pss_margin;
+
 struct type_string {
         int type;
         const char *str;
@@ -119,22 +150,26 @@ static void log_sss_comp_offset(float offset)
 	LOG_SYNC(sbuf);
 }
 
-static int gen_pbch_refs(int n_id_cell)
+/*
+ * PBCH is decoded from the full bandwidth subframe, so reference maps span
+ * all resource blocks
+ */
+static int gen_pbch_refs(int n_id_cell, int rbs)
 {
 	for (int i = 0; i < 4; i++) {
 		lte_free_ref_map(pbch_map[0][i]);
 		lte_free_ref_map(pbch_map[1][i]);
 	}
 
-	pbch_map[0][0] = lte_gen_ref_map(n_id_cell, 0, 0, 0, 6);
-	pbch_map[0][1] = lte_gen_ref_map(n_id_cell, 1, 0, 0, 6);
-	pbch_map[0][2] = lte_gen_ref_map(n_id_cell, 0, 0, 4, 6);
-	pbch_map[0][3] = lte_gen_ref_map(n_id_cell, 1, 0, 4, 6);
+	pbch_map[0][0] = lte_gen_ref_map(n_id_cell, 0, 0, 0, rbs);
+	pbch_map[0][1] = lte_gen_ref_map(n_id_cell, 1, 0, 0, rbs);
+	pbch_map[0][2] = lte_gen_ref_map(n_id_cell, 0, 0, 4, rbs);
+	pbch_map[0][3] = lte_gen_ref_map(n_id_cell, 1, 0, 4, rbs);
 
-	pbch_map[1][0] = lte_gen_ref_map(n_id_cell, 0, 1, 0, 6);
-	pbch_map[1][1] = lte_gen_ref_map(n_id_cell, 1, 1, 0, 6);
-	pbch_map[1][2] = lte_gen_ref_map(n_id_cell, 0, 1, 4, 6);
-	pbch_map[1][3] = lte_gen_ref_map(n_id_cell, 1, 1, 4, 6);
+	pbch_map[1][0] = lte_gen_ref_map(n_id_cell, 0, 1, 0, rbs);
+	pbch_map[1][1] = lte_gen_ref_map(n_id_cell, 1, 1, 0, rbs);
+	pbch_map[1][2] = lte_gen_ref_map(n_id_cell, 0, 1, 4, rbs);
+	pbch_map[1][3] = lte_gen_ref_map(n_id_cell, 1, 1, 4, rbs);
 
 	return 0;
 }
@@ -189,7 +224,8 @@ static bool preprocess_pdsch(struct io_subframe *subframe,
 
 	for (size_t i = 0; i < subframe->chans; i++) {
 		if (!lbuf->bufs[i])
-			lbuf->bufs[i] = (short *) malloc(lbuf_len * 2 * sizeof(short));
+			lbuf->bufs[i] = (short *)
+				hugepage_malloc(lbuf_len * 2 * sizeof(short));
 
 		if (!subframe->delay(i, lbuf->bufs[i], lbuf_len, adjust))
 			return false;
@@ -206,7 +242,7 @@ static bool pss_sync(struct lte_rx *rx, struct lte_sync *sync,
 	subframe->preprocess_pss();
 
 	lte_pss_search(rx, &subframe->pss[0], subframe->chans, sync);
-	if (sync->mag > 900) {
+	if (sync->mag > g_pss_margin) {
 		if (sync->coarse < target)
 			sync->coarse += LTE_N0_SLOT_LEN * 10;
 
@@ -299,23 +335,24 @@ static int sss_sync(struct lte_rx *rx, struct lte_sync *sync,
 static void set_global_cell_id(int n_id_cell, int rbs)
 {
 	LOG_PBCH_ARG("Setting Cell ID to ", n_id_cell);
-	gen_pbch_refs(n_id_cell);
+	gen_pbch_refs(n_id_cell, rbs);
 	gen_pdcch_refs(n_id_cell, rbs);
 	gen_sequences(n_id_cell);
 	gn_id_cell = n_id_cell;
 }
 
 static int handle_pbch(struct lte_rx *rx, struct lte_time *ltime,
-		       struct io_subframe *subframe, struct lte_mib *mib)
+		       struct io_subframe *subframe, struct lte_mib *mib,
+		       int adjust)
 {
 	int rc;
 	struct lte_subframe *lsub[subframe->chans];
 
 	for (int i = 0; i < subframe->chans; i++) {
-		lsub[i] = lte_subframe_alloc(6, gn_id_cell, 2,
+		lsub[i] = lte_subframe_alloc(rx->rbs, gn_id_cell, 2,
 					     pbch_map[0], pbch_map[1]);
 
-		subframe->preprocess_pbch(i, lsub[i]->samples);
+		subframe->preprocess_pbch(i, lsub[i]->samples, adjust);
 	}
 
 	rc = lte_decode_pbch(mib, lsub, subframe->chans);
@@ -385,7 +422,11 @@ static int pdsch_sync(struct lte_rx *rx,
 	int min = target - 4;
 	int max = target + 4;
 
-	subframe->preprocess_pss();
+	/* Resample the whole subframe again after a miss */
+	if (pss_lock)
+		subframe->preprocess_pss(PSS_TRACK_START, PSS_TRACK_LEN);
+	else
+		subframe->preprocess_pss();
 
 	lte_pss_fine_sync(rx, &subframe->pss[0], subframe->chans,
 			  &sync, rx->sync.n_id_2);
@@ -497,12 +538,18 @@ int drive_pbch(struct lte_rx *rx, struct io_subframe *subframe, int adjust)
 	if (!ltime->subframe)
 		ltime->frame = (ltime->frame + 1) % 1024;
 
+	/* Lost samples would count as detection failures */
+	if (gap_overlap && (rx->state != LTE_STATE_PSS_SYNC)) {
+		subframe->update();
+		return 0;
+	}
+
 	drive_common(rx, subframe, ltime, adjust);
 
 	switch (rx->state) {
 	case LTE_STATE_PBCH:
 		if (lte_subframe_pbch(ltime)) {
-			if (handle_pbch(rx, ltime, subframe, &mib) <= 0) {
+			if (handle_pbch(rx, ltime, subframe, &mib, adjust) <= 0) {
 				pss_miss_cnt++;
 				if (pss_miss_cnt > 10) {
 					rx->state = LTE_STATE_PSS_SYNC;
@@ -524,24 +571,113 @@ int drive_pbch(struct lte_rx *rx, struct io_subframe *subframe, int adjust)
 	return mib_found;
 }
 
+/*
+ * Queue subframes still held by the receive interface for PDSCH decoding.
+ * Lookback takes at most half of the free decode buffers so that live
+ * subframes keep decoding, which also bounds the copies made on the sync
+ * thread. The newest subframes that fit are kept and read back oldest
+ * first so that control channel state is recovered in order.
+ */
+static int lookback_pdsch(struct lte_rx *rx, struct io_subframe *subframe,
+			  struct lte_mib *mib)
+{
+	struct lte_time *ltime = &rx->time;
+	int count = 0, offset = -(int) subframe->delay_len();
+	int now = ltime->frame * 10 + ltime->subframe;
+	int avail = lte_lookback_avail();
+	size_t limit = pdsch_return_q->size() / 2;
+	std::vector<int> backs;
+
+	for (int back = 1; back <= avail; back++) {
+		int n = (now - back + 10240) % 10240;
+		struct lte_time time;
+
+		time.frame = n / 10;
+		time.subframe = n % 10;
+
+		if (!lte_subframe_pdcch(&time))
+			continue;
+		if (backs.size() >= limit) {
+			LOG_ERR("SYNC  : Lookback limited by free buffers");
+			break;
+		}
+
+		backs.push_back(back);
+	}
+
+	while (!backs.empty()) {
+		int back = backs.back();
+		int n = (now - back + 10240) % 10240;
+		struct lte_time time;
+
+		backs.pop_back();
+
+		time.frame = n / 10;
+		time.subframe = n % 10;
+
+		lte_buffer *lbuf = pdsch_return_q->read();
+		if (!lbuf) {
+			LOG_ERR("SYNC  : Lookback stopped, no free buffers");
+			break;
+		}
+
+		for (size_t i = 0; i < subframe->chans; i++) {
+			if (!lbuf->bufs[i])
+				lbuf->bufs[i] = (short *)
+					hugepage_malloc(subframe->len *
+							2 * sizeof(short));
+		}
+
+		if (lte_lookback_subframe(lbuf->bufs, back, offset) < 0) {
+			pdsch_return_q->write(lbuf);
+			continue;
+		}
+
+		lbuf->rbs = rx->rbs;
+		lbuf->n_id_cell = gn_id_cell;
+		lbuf->ng = mib->phich_ng;
+		lbuf->tx_ants = mib->ant;
+		lbuf->time.subframe = time.subframe;
+		lbuf->time.frame = time.frame;
+		lbuf->ts = -1;
+
+		pdsch_q->write(lbuf);
+		count++;
+	}
+
+	char sbuf[80];
+	snprintf(sbuf, 80, "SYNC  : Lookback queued %i subframes", count);
+	LOG_APP(sbuf);
+
+	return count;
+}
+
 int drive_pdsch(struct lte_rx *rx, struct io_subframe *subframe, int adjust)
 {
 	struct lte_time *ltime = &rx->time;
+	struct lte_mib &mib = cell_mib;
 
-	static struct lte_mib mib;
 	static int pss_miss_cnt = 0;
 	static int sss_miss_cnt = 0;
+	static uint16_t rnti = 0;
+	bool prime = false;
 
 	ltime->subframe = (ltime->subframe + 1) % 10;
 	if (!ltime->subframe)
 		ltime->frame = (ltime->frame + 1) % 1024;
 
+	/* Lost samples would count as sync misses or decode failures */
+	if (gap_overlap && (rx->state != LTE_STATE_PSS_SYNC)) {
+		subframe->update();
+		return 0;
+	}
+
 	drive_common(rx, subframe, ltime, adjust);
 
 	switch (rx->state) {
 	case LTE_STATE_PBCH:
 		if (lte_subframe_pbch(ltime)) {
-			int rc = handle_pbch(rx, ltime, subframe, &mib);
+			int rc = handle_pbch(rx, ltime, subframe, &mib, adjust);
 			if (rc <= 0) {
 				pss_miss_cnt++;
 				if (pss_miss_cnt > 10) {
@@ -549,6 +685,8 @@ int drive_pdsch(struct lte_rx *rx, struct io_subframe *subframe, int adjust)
 					pss_miss_cnt = 0;
 					log_state_chg(LTE_STATE_PBCH_SYNC,
 						      LTE_STATE_PSS_SYNC);
+					lte_capture_trigger(CAPTURE_SYNC,
+							    lte_subframe_ts());
 					lte_offset_reset();
 				}
 				break;
@@ -556,9 +694,14 @@ int drive_pdsch(struct lte_rx *rx, struct io_subframe *subframe, int adjust)
 
 			rx->state = LTE_STATE_PDSCH_SYNC;
 			pss_miss_cnt = 0;
+			pss_lock = true;
 
 			lte_log_time(ltime);
 			log_state_chg(LTE_STATE_PBCH, LTE_STATE_PDSCH);
+
+			/* Recover subframes received before the MIB */
+			rnti = g_rnti;
+			lookback_pdsch(rx, subframe, &mib);
 		}
 		break;
 	case LTE_STATE_PDSCH_SYNC:
@@ -571,23 +714,49 @@ int drive_pdsch(struct lte_rx *rx, struct io_subframe *subframe, int adjust)
 				sss_miss_cnt++;
 			} else if (rc < 0) {
 				pss_miss_cnt++;
+				pss_lock = false;
+				if (pss_miss_cnt == CAPTURE_MISS_STREAK)
+					lte_capture_trigger(CAPTURE_SYNC,
+							    lte_subframe_ts());
 			}
 
+			if (rc > 0)
+				pss_lock = true;
+
 			if ((pss_miss_cnt > 100) || (sss_miss_cnt > 5)) {
 				rx->state = LTE_STATE_PSS_SYNC;
 				pss_miss_cnt = 0;
 				sss_miss_cnt = 0;
 				log_state_chg(LTE_STATE_PDSCH_SYNC,
 					      LTE_STATE_PSS_SYNC);
+				lte_capture_trigger(CAPTURE_SYNC,
+						    lte_subframe_ts());
 				lte_offset_reset();
+				pss_lock = false;
 				break;
 			}
 		}
 	case LTE_STATE_PDSCH:
+		prime = seed_prime;
+		seed_prime = false;
+
+		/* Index frame boundaries while timing is tracked */
+		if (!ltime->subframe && pss_lock)
+			lte_index_push(ltime->frame, gn_id_cell, mib.ant,
+				       mib.phich_dur, mib.phich_ng);
+
+		/* Decode buffered subframes again for a newly assigned RNTI */
+		if (g_rnti != rnti) {
+			rnti = g_rnti;
+			lookback_pdsch(rx, subframe, &mib);
+		}
+
 		if (lte_subframe_pdcch(ltime)) {
 			lte_buffer *lbuf = pdsch_return_q->read();
 			if (!lbuf) {
 				LOG_ERR("SYNC  : Dropped frame");
+				lte_capture_trigger(CAPTURE_DROP,
+						    lte_subframe_ts());
 				break;
 			}
 
@@ -603,9 +772,16 @@ int drive_pdsch(struct lte_rx *rx, struct io_subframe *subframe, int adjust)
 			lbuf->tx_ants = mib.ant;
 			lbuf->time.subframe = ltime->subframe;
 			lbuf->time.frame = ltime->frame;
+			lbuf->ts = lte_subframe_ts();
 
 			preprocess_pdsch(subframe, lbuf, adjust);
 
+			/* Priming subframes only fill the delay history */
+			if (prime) {
+				pdsch_return_q->write(lbuf);
+				break;
+			}
+
 			pdsch_q->write(lbuf);
 		}
 	}
@@ -615,6 +791,77 @@ int drive_pdsch(struct lte_rx *rx, struct io_subframe *subframe, int adjust)
 	return 0;
 }
 
+/*
+ * Resume PDSCH decoding from indexed sync state without cell acquisition.
+ * Replay starts one subframe ahead of the indexed frame, which primes the
+ * subframe delay history and is not decoded. A segment before this one
+ * decodes that subframe in full.
+ */
+static void seed_pdsch(struct lte_rx *rx, const struct sync_index_entry *seed)
+{
+	rx->state = LTE_STATE_PDSCH_SYNC;
+	rx->sync.n_id_cell = seed->n_id_cell;
+	rx->sync.n_id_1 = seed->n_id_cell / 3;
+	rx->sync.n_id_2 = seed->n_id_cell % 3;
+	rx->time.frame = (seed->sfn + 1023) % 1024;
+	rx->time.subframe = 8;
+
+	cell_mib.ant = seed->ant;
+	cell_mib.rbs = seed->rbs;
+	cell_mib.fn = seed->sfn;
+	cell_mib.phich_dur = seed->phich_dur;
+	cell_mib.phich_ng = seed->phich_ng;
+
+	set_global_cell_id(seed->n_id_cell, rx->rbs);
+
+	pss_lock = true;
+	seed_prime = true;
+
+	char sbuf[80];
+	snprintf(sbuf, 80, "SYNC  : Resuming cell %i at SFN %i",
+		 seed->n_id_cell, seed->sfn);
+	LOG_APP(sbuf);
+}
+
+/*
+ * Sample timestamps are kept across receive gaps, so frame timing and the
+ * frequency correction survive a short gap and tracking resumes from the
+ * last timing. Timing may drift beyond the tracking range over a long gap,
+ * which restarts cell search while keeping the cell configuration and
+ * FFT plans.
+ */
+static void handle_gap(struct lte_rx *rx)
+{
+	struct lte_gap gap;
+	char sbuf[80];
+
+	lte_subframe_gap(&gap);
+	gap_overlap = gap.overlap;
+
+	if (!gap.len)
+		return;
+
+	rx->time.frame = (rx->time.frame + gap.frames) % 1024;
+	pss_lock = false;
+
+	if (rx->state == LTE_STATE_PSS_SYNC)
+		return;
+
+	if (gap.len <= GAP_RETRACK_MAX) {
+		snprintf(sbuf, 80, "SYNC  : Receive gap of %i subframes, "
+			 "tracking from last timing", gap.len);
+		LOG_APP(sbuf);
+		return;
+	}
+
+	snprintf(sbuf, 80, "SYNC  : Receive gap of %i subframes, "
+		 "restarting cell search", gap.len);
+	LOG_APP(sbuf);
+
+	log_state_chg(rx->state, LTE_STATE_PSS_SYNC);
+	rx->state = LTE_STATE_PSS_SYNC;
+}
+
 /* External hacks */
 void enable_prio(float prio);
 
@@ -627,6 +874,11 @@ static int pdsch_loop(struct lte_rx *rx, io_subframe *subframe)
 					      rx->sync.coarse,
 					      rx->sync.fine,
 					      rx->state == LTE_STATE_PDSCH_SYNC);
+		if (shift == LTE_IO_EOF)
+			break;
+
+		handle_gap(rx);
+
 		rx->sync.coarse = 0;
 		rx->sync.fine = 0;
 
@@ -644,6 +896,8 @@ static int pdsch_loop(struct lte_rx *rx, io_subframe *subframe)
 
 		cnt = (cnt + 1) % 10;
 	}
+
+	return 0;
 }
 
 static int pbch_loop(struct lte_rx *rx, io_subframe *subframe)
@@ -654,6 +908,13 @@ static int pbch_loop(struct lte_rx *rx, io_subframe *subframe)
 		int shift = lte_read_subframe(subframe->raw, cnt,
 					      rx->sync.coarse,
 					      rx->sync.fine, 0);
+		if (shift == LTE_IO_EOF) {
+			rc = -1;
+			break;
+		}
+
+		handle_gap(rx);
+
 		rx->sync.coarse = 0;
 		rx->sync.fine = 0;
 
@@ -682,7 +943,8 @@ static int pbch_loop(struct lte_rx *rx, io_subframe *subframe)
 		return rbs;
 }
 
-int sync_loop(int rbs, int chans, bool mib)
+int sync_loop(int rbs, int chans, bool mib,
+	      const struct sync_index_entry *seed)
 {
 	struct lte_rx *rx;
 	struct io_subframe subframe(chans);
@@ -690,7 +952,7 @@ int sync_loop(int rbs, int chans, bool mib)
 	if (mib)
 		rbs = 6;
 
-	subframe.init(rbs);
+	subframe.init(rbs, 384, g_pss_stages);
 
 	rx = lte_init();
 	rx->state = LTE_STATE_PSS_SYNC;
@@ -705,6 +967,12 @@ int sync_loop(int rbs, int chans, bool mib)
 	memset(favg, 0, sizeof(float) * AVG_FREQ);
 	memset(fwid, 0, sizeof(float) * AVG_FREQ);
 
+	pss_lock = false;
+	gap_overlap = false;
+
+	if (seed)
+		seed_pdsch(rx, seed);
+
 	enable_prio(0.7f);
 
 	if (mib)
@@ -8,5 +8,11 @@ int cxvec_convolve(const struct cxvec *in,
 int cxvec_convolve_nodelay(const struct cxvec *in,
 			   const struct cxvec *h, struct cxvec *out);
 int single_convolve(const float *in, const struct cxvec *h, float *out);
+int decim_convolve(const float *in, const struct cxvec *h,
+		   float *out, int len, int decim);
+int decim_convolve_short(const short *in, const struct cxvec *h,
+			 float *out, int len, int decim, float scale);
+int halfband_convolve(const float *in, const float *h, int h_len,
+		      float center, float *out, int len);
 
 #endif /* _CONVOLVE_H_ */
@@ -0,0 +1,22 @@
+#ifndef _HUGEPAGE_H_
+#define _HUGEPAGE_H_
+
+#include <stddef.h>
+
+enum hugepage_size {
+	HUGEPAGE_NONE,
+	HUGEPAGE_2M,
+	HUGEPAGE_1G,
+};
+
+/* Select huge page size before allocating any buffers */
+int hugepage_init(enum hugepage_size size);
+size_t hugepage_len(void);
+int hugepage_memfd_flags(void);
+
+/* Buffers fall back to malloc() when huge pages are disabled */
+void *hugepage_malloc(size_t size);
+void hugepage_free(void *buf);
+int hugepage_owns(const void *buf);
+
+#endif /* _HUGEPAGE_H_ */
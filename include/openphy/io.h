@@ -2,7 +2,9 @@
 #define _LTE_IO_
 
 #include <stdint.h>
+#include <limits.h>
 #include <vector>
+#include <string>
 
 enum dev_ref_type {
 	REF_INTERNAL,
@@ -10,24 +12,103 @@ enum dev_ref_type {
 	REF_GPSDO,
 };
 
+/*
+ * Sample file formats
+ *
+ * sc12 keeps the 12 most significant bits of each sc16 value, lossless for
+ * 12-bit converters. bfp8 stores 8-bit values with one shared exponent per
+ * block of 32 complex samples. sc8 keeps the 8 most significant bits, lossless
+ * for devices streaming sc8 over the wire.
+ */
+enum sample_format {
+	FORMAT_SC16,
+	FORMAT_SC12,
+	FORMAT_BFP8,
+	FORMAT_SC8,
+};
+
+/* Events that trigger a sample capture, combined as a mask */
+enum capture_event {
+	CAPTURE_CRC	= 1 << 0,
+	CAPTURE_SYNC	= 1 << 1,
+	CAPTURE_DROP	= 1 << 2,
+};
+
+/*
+ * Receive gap state of the most recently read subframe
+ *
+ * Samples lost by the source are zero filled in place. When the reader
+ * falls so far behind that samples are overwritten, whole frames are
+ * skipped to catch up, which keeps the subframe and slot timing.
+ */
+struct lte_gap {
+	int len;	/* Subframes spanned by newly reported gaps */
+	int frames;	/* Frames skipped before this subframe */
+	bool overlap;	/* Subframe contains zero filled samples */
+};
+
 struct lte_dbuf;
 
+/* Returned by lte_read_subframe() when a replay source is exhausted */
+#define LTE_IO_EOF		INT_MIN
+
 void lte_radio_iface_reset();
 
 int lte_radio_iface_init(double freq, int chans, double gain,
-			 int rbs, int ref, const std::string &args);
+			 int rbs, int ref, const std::string &args,
+			 enum sample_format wire = FORMAT_SC16);
+
+int lte_file_iface_init(const std::string &path, int chans,
+			int rbs, double speed);
+int lte_file_iface_seek(int64_t start, int64_t end);
+
+int lte_chan_iface_init(const std::vector<double> &offsets,
+			int chans, int rbs);
+int lte_chan_iface_select(int carrier, int chans, int rbs);
+int lte_chan_iface_run(double freq, int chans, double gain,
+		       int rbs, int ref, const std::string &args, int decim,
+		       enum sample_format wire = FORMAT_SC16);
+int lte_chan_file_run(const std::string &path, int chans,
+		      int rbs, double speed, int decim);
+
+int lte_record_start(const std::string &path, double freq, double gain,
+		     enum sample_format format = FORMAT_SC16);
+void lte_record_stop();
+
+/* Capture windows around events, pre and post lengths in milliseconds */
+int lte_capture_start(const std::string &prefix, double freq, double gain,
+		      enum sample_format format, unsigned events,
+		      int pre_ms, int post_ms);
+void lte_capture_stop();
+void lte_capture_trigger(enum capture_event event, int64_t ts);
+
+/* Index sync state per frame for seeking and segmented replay */
+int lte_index_start(const std::string &path);
+void lte_index_stop();
+void lte_index_push(int sfn, int n_id_cell, int ant,
+		    int phich_dur, int phich_ng);
 
 int lte_read_subframe_burst(std::vector<short *> buf,
 			    int num, int coarse, int fine);
 
 int lte_read_subframe(std::vector<short *> &bufs, int num,
 		      int coarse, int fine, int state);
+int64_t lte_subframe_ts();
+void lte_subframe_gap(struct lte_gap *gap);
 int lte_offset_freq(double offset);
 int lte_offset_reset();
 void lte_set_freq(double freq);
 
+/* Receive interface telemetry */
+std::string lte_iface_stats();
+void lte_iface_reset_stats();
+
 int lte_commit_subframe(std::vector<short *> &bufs);
 
+/* Re-read subframes already passed by lte_commit_subframe() */
+int lte_lookback_avail();
+int lte_lookback_subframe(std::vector<short *> &bufs, int back, int offset);
+
 int lte_write_subframe(int16_t *buf, int len, int dec, int zero);
 
 #endif /* _LTE_IO_ */
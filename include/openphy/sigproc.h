@@ -8,6 +8,7 @@ extern "C" {
 #include "sigvec.h"
 #include "convolve.h"
 #include "fft.h"
+#include "hugepage.h"
 
 #ifdef __cplusplus
 }
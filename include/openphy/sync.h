@@ -5,6 +5,10 @@ struct lte_rx;
 struct lte_sync;
 struct cxvec;
 
+/* Correlation window of fine PSS synchronization in a PSS subframe */
+#define LTE_PSS_FINE_START	464
+#define LTE_PSS_FINE_LEN	40
+
 int lte_pss_search(struct lte_rx *rx, struct cxvec **subframe,
 		   int chans, struct lte_sync *sync);
 
@@ -0,0 +1,309 @@
+/*
+ * Multistage Integer Decimator
+ *
+ * Copyright (C) 2015 Ettus Research LLC
+ * Author Tom Tsou <tom.tsou@ettus.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <math.h>
+#include <string.h>
+#include <iostream>
+#include <complex>
+#include <algorithm>
+
+#include "Decimator.h"
+#include "Resampler.h"
+
+extern "C" {
+#include "openphy/sigproc.h"
+#include "sigproc/convert.h"
+}
+
+/* Half-band taps per side searched for the stopband attenuation */
+#define HALFBAND_MIN_TAPS	2
+#define HALFBAND_MAX_TAPS	16
+
+/* Input samples run through all half-band stages at a time */
+#define HALFBAND_CHUNK		2048
+
+/* Frequency points evaluated across the half-band stopband */
+#define HALFBAND_GRID		64
+
+typedef std::complex<float> _complex;
+
+static _complex *_cxvec_data(struct cxvec *vec)
+{
+	return (_complex *) cxvec_data(vec);
+}
+
+/*
+ * Half-band stage of 4 * taps - 1 coefficients. Only the center tap and the
+ * taps at odd offsets from the center are nonzero, and the odd offset taps
+ * are stored for one side, innermost first. The input buffer holds one
+ * chunk of stage input preceded by the history the filter reaches back
+ * into, and the stage before writes its output directly after the history.
+ */
+struct HalfbandStage {
+	int taps;
+	int hist;
+	float center;
+	std::vector<float> h;
+	std::vector<_complex> in;
+};
+
+/*
+ * Generate a Blackman-harris windowed half-band filter with unity DC gain
+ */
+static void design_halfband(struct HalfbandStage *stage)
+{
+	int len = 4 * stage->taps - 1;
+	int mid = 2 * stage->taps - 1;
+
+	float a0 = 0.35875;
+	float a1 = 0.48829;
+	float a2 = 0.14128;
+	float a3 = 0.01168;
+
+	float proto[len];
+	float sum = 0.0f;
+
+	for (int i = 0; i < len; i++) {
+		proto[i] = 0.5f * cxvec_sinc(((float) i - mid) / 2.0f);
+		proto[i] *= a0 -
+			    a1 * cos(2 * M_PI * i / (len - 1)) +
+			    a2 * cos(4 * M_PI * i / (len - 1)) -
+			    a3 * cos(6 * M_PI * i / (len - 1));
+
+		sum += proto[i];
+	}
+
+	stage->center = proto[mid] / sum;
+	stage->h.resize(stage->taps);
+
+	for (int i = 0; i < stage->taps; i++)
+		stage->h[i] = proto[mid + 2 * i + 1] / sum;
+}
+
+/* Peak magnitude response from the stopband edge to half the input rate */
+static float stopband_peak(const struct HalfbandStage *stage, float edge)
+{
+	float peak = 0.0f;
+
+	for (int i = 0; i <= HALFBAND_GRID; i++) {
+		float f = edge + (0.5f - edge) * i / HALFBAND_GRID;
+		float a = stage->center;
+
+		for (int n = 0; n < stage->taps; n++)
+			a += 2.0f * stage->h[n] * cos(2 * M_PI * f * (2 * n + 1));
+
+		peak = std::max(peak, fabsf(a));
+	}
+
+	return peak;
+}
+
+/*
+ * Input sample the half-band stages run from for final filter input 'n'
+ * onward, early enough that every stage computes the outputs the next stage
+ * keeps as history from valid input, and aligned so that it falls on an
+ * output of every stage
+ */
+int Decimator::firstInput(int n) const
+{
+	int num = stages.size();
+
+	for (int i = num - 1; i >= 0; i--)
+		n = 2 * n - stages[i]->hist;
+
+	n = std::max(n, 0) & ~((1 << num) - 1);
+	if (num && (n < stages[0]->hist))
+		n = 0;
+
+	return n;
+}
+
+/*
+ * Select the number of half-band stages and size every stage. A stage whose
+ * output rate is 'ratio' times the final output rate must reject the band
+ * within half the final output rate of its output rate, which folds onto
+ * the final passband.
+ */
+bool Decimator::initStages()
+{
+	int num = 0;
+
+	while ((num < mStages) && !(mQ % (4 << num)))
+		num++;
+
+	int decim = mQ >> num;
+	float limit = powf(10.0f, -mAtten / 20.0f);
+
+	mDelay = mFiltLen / 2;
+
+	for (int i = 0; i < num; i++) {
+		struct HalfbandStage *stage = new HalfbandStage();
+		int ratio = decim << (num - 1 - i);
+		float edge = (ratio - 0.5f) / (2 * ratio);
+
+		for (stage->taps = HALFBAND_MIN_TAPS;; stage->taps++) {
+			design_halfband(stage);
+			if ((stage->taps == HALFBAND_MAX_TAPS) ||
+			    (stopband_peak(stage, edge) <= limit))
+				break;
+		}
+
+		stage->hist = 4 * stage->taps - 2;
+		stage->in.resize(stage->hist + (HALFBAND_CHUNK >> i));
+
+		mDelay += (2 * stage->taps - 1) << i;
+		stages.push_back(stage);
+	}
+
+	/* Update only fills the final filter history */
+	mTail = firstInput((mLen >> num) - (mFiltLen >> num));
+
+	final = new Resampler(1, decim, mFiltLen >> num);
+	if (!final->init())
+		return false;
+
+	if (num) {
+		int flags = CXVEC_FLG_FFT_ALIGN;
+
+		finalIn = cxvec_alloc(mLen >> num, mFiltLen >> num,
+				      0, NULL, flags);
+	}
+
+	return true;
+}
+
+/*
+ * Run the half-band stages over a block from input sample 'start' onward,
+ * one chunk at a time through all stages so that the intermediate samples
+ * stay in cache. The first stage scales the sc16 input into its buffer, and
+ * each stage writes its output into the buffer of the next stage or into
+ * the final filter input. After each chunk the last samples of every stage
+ * input are kept as history for the next.
+ *
+ * Starting past the beginning of the block, the first stage history is
+ * taken from the input while later stages run on stale history, whose
+ * outputs are never kept.
+ */
+void Decimator::filter(const short *in, float scale, int start)
+{
+	int num = stages.size();
+	_complex *y = _cxvec_data(finalIn);
+
+	if (start) {
+		struct HalfbandStage *stage = stages[0];
+
+		convert_short_float((float *) &stage->in.front(),
+				    (short *) &in[2 * (start - stage->hist)],
+				    2 * stage->hist, scale);
+	}
+
+	for (int n = start; n < mLen; n += HALFBAND_CHUNK) {
+		int len = std::min(HALFBAND_CHUNK, mLen - n);
+		float *x = (float *) &stages[0]->in[stages[0]->hist];
+
+		convert_short_float(x, (short *) &in[2 * n], 2 * len, scale);
+
+		for (int i = 0; i < num; i++) {
+			struct HalfbandStage *stage = stages[i];
+			_complex *out;
+
+			if (i < num - 1)
+				out = &stages[i + 1]->in[stages[i + 1]->hist];
+			else
+				out = &y[n >> num];
+
+			halfband_convolve((float *) &stage->in[stage->hist],
+					  &stage->h.front(), stage->taps,
+					  stage->center, (float *) out,
+					  len >> (i + 1));
+
+			memmove(&stage->in[0], &stage->in[len >> i],
+				stage->hist * sizeof(_complex));
+		}
+	}
+}
+
+int Decimator::rotate(const short *in, int ilen, struct cxvec *out,
+		      float scale, int start, int len)
+{
+	if (stages.empty())
+		return final->rotate(in, ilen, out, scale, start, len);
+
+	if ((ilen != mLen) || (cxvec_len(out) * mQ != ilen) ||
+	    (start < 0) || (len < 0) || (start + len > cxvec_len(out))) {
+		std::cout << "Invalid decimation of " << ilen
+			  << " samples" << std::endl;
+		return -1;
+	}
+
+	/* Final filter input reached back to by the first output */
+	int num = stages.size();
+	int n = start * (mQ >> num) - ((mFiltLen >> num) - 1);
+
+	filter(in, scale, std::min(firstInput(n), mTail));
+
+	return final->rotate(finalIn, out, start, len);
+}
+
+int Decimator::rotate(const short *in, int ilen, struct cxvec *out, float scale)
+{
+	return rotate(in, ilen, out, scale, 0, cxvec_len(out));
+}
+
+int Decimator::update(const short *in, int ilen, float scale)
+{
+	if (stages.empty())
+		return final->update(in, ilen);
+
+	if (ilen != mLen)
+		return -1;
+
+	filter(in, scale, mTail);
+
+	return final->update(finalIn);
+}
+
+bool Decimator::init(int wLen)
+{
+	if ((wLen <= 0) || (wLen % mQ)) {
+		std::cout << "Invalid decimator block length " << wLen
+			  << std::endl;
+		return false;
+	}
+
+	mLen = wLen;
+
+	return initStages();
+}
+
+Decimator::Decimator(int wQ, int wFiltLen, int wStages, float wAtten)
+	: mQ(wQ), mFiltLen(wFiltLen), mStages(wStages), mAtten(wAtten),
+	  mLen(0), mDelay(wFiltLen / 2), mTail(0), final(NULL), finalIn(NULL)
+{
+}
+
+Decimator::~Decimator()
+{
+	for (size_t i = 0; i < stages.size(); i++)
+		delete stages[i];
+
+	delete final;
+	cxvec_free(finalIn);
+}
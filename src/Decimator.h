@@ -0,0 +1,113 @@
+/*
+ * Multistage Integer Decimator
+ *
+ * Copyright (C) 2015 Ettus Research LLC
+ * Author Tom Tsou <tom.tsou@ettus.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _DECIMATOR_H_
+#define _DECIMATOR_H_
+
+#include <vector>
+
+struct cxvec;
+class Resampler;
+struct HalfbandStage;
+
+/*
+ * Integer decimation of sc16 samples through a cascade of half-band stages,
+ * each decimating by two, followed by a final polyphase filter for the
+ * remaining factor. The final filter keeps the bandwidth and transition of
+ * a single-stage filter of the given length at the input rate, shortened by
+ * the factor already taken by the half-band stages. Each half-band stage
+ * gets the fewest taps that reach the stopband attenuation over the band
+ * that aliases into the final passband, so early stages at the highest
+ * rates are the shortest.
+ *
+ * With no half-band stages the decimator is a single-stage Resampler.
+ */
+class Decimator {
+private:
+	int mQ;
+	int mFiltLen;
+	int mStages;
+	float mAtten;
+	int mLen;
+	int mDelay;
+	int mTail;
+
+	std::vector<HalfbandStage *> stages;
+	Resampler *final;
+	struct cxvec *finalIn;
+
+	bool initStages();
+	int firstInput(int n) const;
+	void filter(const short *in, float scale, int start);
+
+public:
+	/** Constructor for integer decimator
+	    @param wQ decimation factor
+	    @param wFiltLen equivalent single-stage filter length
+	    @param wStages maximum number of half-band stages
+	    @param wAtten half-band stopband attenuation in dB
+	*/
+	Decimator(int wQ, int wFiltLen, int wStages = 0, float wAtten = 90.0f);
+	~Decimator();
+
+	/** Initialize filters and buffers
+	    @param wLen input block length
+	    @return false on error
+	 */
+	bool init(int wLen);
+
+	/** Decimate a block of sc16 samples
+	    @param in interleaved sc16 input samples
+	    @param ilen number of input samples, equal to the block length
+	    @param out output vector of the block length over decimation
+	    @param scale output scaling applied to the filtered samples
+	    @return number of samples outputted, negative value on error
+	 */
+	int rotate(const short *in, int ilen, struct cxvec *out, float scale);
+
+	/** Decimate a window of outputs and advance history over the block
+	    @param start first output computed
+	    @param len number of outputs computed
+	    @return number of samples outputted, negative value on error
+
+	    Outputs outside of the window are left untouched. Half-band
+	    stages run from the input the window reaches back to.
+	 */
+	int rotate(const short *in, int ilen, struct cxvec *out, float scale,
+		   int start, int len);
+
+	/** Advance filter history without output
+	    @param in interleaved sc16 input samples
+	    @param ilen number of input samples, equal to the block length
+	    @param scale output scaling as passed to rotate
+	    @return negative value on error, zero otherwise
+
+	    Only the tail of the block that fills the filter history is run.
+	 */
+	int update(const short *in, int ilen, float scale);
+
+	/** Group delay in input samples */
+	int delay() const { return mDelay; }
+
+	/** Number of half-band stages in use */
+	int halfbands() const { return stages.size(); }
+};
+
+#endif /* _DECIMATOR_H_ */
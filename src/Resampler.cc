@@ -161,7 +161,8 @@ void Resampler::computePath()
 	}
 }
 
-int Resampler::rotate(struct cxvec *in, struct cxvec *out, int len)
+int Resampler::rotate(struct cxvec *in, struct cxvec *out,
+		      int start, int len)
 {
 	int n, path;
 	int hlen = cxvec_len(history);
@@ -170,18 +171,30 @@ int Resampler::rotate(struct cxvec *in, struct cxvec *out, int len)
 	if (!check_vec_len(in, out, mP, mQ))
 		return -1;
 
+	if ((start < 0) || (len < 0) || (start + len > cxvec_len(out))) {
+		std::cout << "Invalid output window" << std::endl;
+		return -1;
+	}
+
 	/* Insert history */
 	memcpy(_cxvec_data(in) - hlen,
 	       _cxvec_data(history), hlen * 2 * sizeof(float));
 
-	/* Generate output from precomputed input/output paths */
-	for (int i = 0; i < len; i++) {
-		n = inputIndex[i];
-		path = outputPath[i];
-
-		single_convolve((float *) &_cxvec_data(in)[n - mDelay],
-				partitions[path],
-				(float *) &_cxvec_data(out)[i]);
+	/* Integer decimation only computes the retained outputs */
+	if (mP == 1) {
+		decim_convolve((float *) &_cxvec_data(in)[start * mQ - mDelay],
+			       partitions[0],
+			       (float *) &_cxvec_data(out)[start], len, mQ);
+	} else {
+		/* Generate output from precomputed input/output paths */
+		for (int i = start; i < start + len; i++) {
+			n = inputIndex[i];
+			path = outputPath[i];
+
+			single_convolve((float *) &_cxvec_data(in)[n - mDelay],
+					partitions[path],
+					(float *) &_cxvec_data(out)[i]);
+		}
 	}
 
 	/* Save history */
@@ -189,7 +202,7 @@ int Resampler::rotate(struct cxvec *in, struct cxvec *out, int len)
 	       &_cxvec_data(in)[ilen - hlen],
 	       hlen * 2 * sizeof(float));
 
-	return cxvec_len(out);
+	return len;
 }
 
 int Resampler::update(struct cxvec *in)
@@ -208,9 +221,76 @@ int Resampler::update(struct cxvec *in)
 	return 0;
 }
 
+/*
+ * Integer decimation of sc16 input. Outputs whose filter span reaches back
+ * into the previous block are computed from a short buffer holding the
+ * history and the head of the input. All later outputs read the input in
+ * place, so the input is never copied or converted as a whole.
+ */
+int Resampler::rotate(const short *in, int ilen, struct cxvec *out,
+		      float scale, int start, int len)
+{
+	int end = start + len;
+	int hlen = mFiltLen + mDelay;
+	int head = (mDelay + mFiltLen - 1 + mQ - 1) / mQ;
+	float *y = (float *) _cxvec_data(out);
+
+	if ((mP != 1) || (ilen % mQ) || (ilen / mQ != cxvec_len(out)) ||
+	    (ilen < hlen) || (start < 0) || (len < 0) ||
+	    (end > cxvec_len(out))) {
+		std::cout << "Invalid sc16 decimation of " << ilen
+			  << " samples" << std::endl;
+		return -1;
+	}
+
+	if (head > end)
+		head = end;
+
+	if (start < head) {
+		memcpy(&shortBuffer[2 * hlen], in,
+		       head * mQ * 2 * sizeof(short));
+
+		decim_convolve_short(&shortBuffer[2 * (hlen - mDelay +
+						       start * mQ)],
+				     partitions[0], &y[2 * start],
+				     head - start, mQ, scale);
+		start = head;
+	}
+
+	decim_convolve_short(&in[2 * (start * mQ - mDelay)], partitions[0],
+			     &y[2 * start], end - start, mQ, scale);
+
+	update(in, ilen);
+
+	return len;
+}
+
+int Resampler::rotate(const short *in, int ilen, struct cxvec *out, float scale)
+{
+	return rotate(in, ilen, out, scale, 0, cxvec_len(out));
+}
+
+int Resampler::update(const short *in, int ilen)
+{
+	int hlen = mFiltLen + mDelay;
+
+	if ((mP != 1) || (ilen < hlen))
+		return -1;
+
+	/* Save history */
+	memcpy(shortBuffer, &in[2 * (ilen - hlen)], hlen * 2 * sizeof(short));
+
+	return 0;
+}
+
+int Resampler::rotate(struct cxvec *in, struct cxvec *out, int len)
+{
+	return rotate(in, out, 0, len);
+}
+
 int Resampler::rotate(struct cxvec *in, struct cxvec *out)
 {
-	return rotate(in, out, cxvec_len(out));
+	return rotate(in, out, 0, cxvec_len(out));
 }
 
 bool Resampler::init()
@@ -225,10 +305,20 @@ bool Resampler::init()
 	history = cxvec_alloc_simple(mFiltLen + mDelay);
 	cxvec_reset(history);
 
-	/* Precompute filterbank path */
-	inputIndex = (int *) malloc(sizeof(int) * MAX_OUTPUT_LEN);
-	outputPath = (int *) malloc(sizeof(int) * MAX_OUTPUT_LEN);
-	computePath();
+	/* History and input head for sc16 decimation */
+	if (mP == 1) {
+		int hlen = mFiltLen + mDelay;
+		int head = (mDelay + mFiltLen - 1 + mQ - 1) / mQ;
+
+		shortBuffer = new short[2 * (hlen + head * mQ)]();
+	}
+
+	/* Precompute filterbank path, unused for integer decimation */
+	if (mP > 1) {
+		inputIndex = (int *) malloc(sizeof(int) * MAX_OUTPUT_LEN);
+		outputPath = (int *) malloc(sizeof(int) * MAX_OUTPUT_LEN);
+		computePath();
+	}
 
 	return true;
 }
@@ -236,7 +326,8 @@ bool Resampler::init()
 Resampler::Resampler(int wP, int wQ, int wFiltLen,
 		     int wDelay, float wFactor)
 	: mP(wP), mQ(wQ), mFiltLen(wFiltLen),
-	  mDelay(wDelay), mFactor(wFactor), inputIndex(NULL), outputPath(NULL)
+	  mDelay(wDelay), mFactor(wFactor), inputIndex(NULL), outputPath(NULL),
+	  shortBuffer(NULL)
 {
 }
 
@@ -248,4 +339,6 @@ Resampler::~Resampler()
 
 	free(inputIndex);
 	free(outputPath);
+
+	delete[] shortBuffer;
 }
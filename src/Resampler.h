@@ -38,6 +38,7 @@ private:
 
 	struct cxvec **partitions;
 	struct cxvec *history;
+	short *shortBuffer;
 
 	bool initFilters();
 	void releaseFilters();
@@ -67,10 +68,38 @@ public:
 
 	    Input and output vector lengths must of be equal multiples of the
 	    rational conversion rate denominator and numerator respectively.
+	    Integer decimators with a numerator of one filter only the
+	    retained outputs, several at a time on AVX2 and AVX-512 builds.
 	 */
 	int rotate(struct cxvec *in, struct cxvec *out);
 	int rotate(struct cxvec *in, struct cxvec *out, int len);
+	int rotate(struct cxvec *in, struct cxvec *out, int start, int len);
 	int update(struct cxvec *in);
+
+	/** Decimate sc16 samples without a float copy of the input
+	    @param in interleaved sc16 input samples
+	    @param ilen number of input samples
+	    @param out output vector
+	    @param scale output scaling applied to the filtered samples
+	    @return number of samples outputted, negative value on error
+
+	    Only integer decimators with a numerator of one are supported.
+	    The input length must be the output length times the decimation.
+	    Input passed to either call keeps sc16 history, which is
+	    separate from the history of float input.
+	 */
+	int rotate(const short *in, int ilen, struct cxvec *out, float scale);
+	int update(const short *in, int ilen);
+
+	/** Decimate a window of outputs and advance history over the input
+	    @param start first output computed
+	    @param len number of outputs computed
+	    @return number of samples outputted, negative value on error
+
+	    Outputs outside of the window are left untouched.
+	 */
+	int rotate(const short *in, int ilen, struct cxvec *out, float scale,
+		   int start, int len);
 };
 
 #endif /* _RESAMPLER_H_ */
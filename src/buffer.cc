@@ -23,317 +23,704 @@
 #include <sstream>
 #include <string.h>
 #include <limits.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+#include <time.h>
+#include <new>
 
 #include "buffer.h"
 
-ts_buffer::ts_buffer(size_t len)
-	: data(NULL), buf_len(len),
-	  time_start(0), time_end(0), data_start(0), data_end(0),
-	  tag(NULL), tag_len(0), tag_alloc(false)
+extern "C" {
+#include "openphy/hugepage.h"
+}
+
+ts_buffer::ts_buffer(size_t len, size_t chans, size_t smpl_size)
+	: data(NULL), buf_len(len), chans(chans), smpl_size(smpl_size),
+	  map_len(0), marks(NULL), wr_tag(NULL), wr_ts(0), wr_len(0)
 {
+	rd.id = 0;
+	rd.tag = NULL;
+	rd.end = 0;
+	rd.gap_rd = 0;
 }
 
 ts_buffer::~ts_buffer()
 {
-	delete[] data;
+	if (data)
+		munmap(data, 2 * map_len * chans);
+	if (marks)
+		munmap(marks, sysconf(_SC_PAGESIZE));
 }
 
-/* Allocate underlying memory buffer */
-bool ts_buffer::init()
+/*
+ * Map the mirrored channel regions
+ *
+ * Reserve twice the ring size for each channel and map the channel region
+ * of the same anonymous memory file into both halves. Ring length is rounded
+ * up to a whole number of pages of the requested size.
+ */
+bool ts_buffer::map_ring(size_t page, int flags)
 {
-	if (buf_len > SSIZE_MAX)
+	size_t len = (buf_len * smpl_size + page - 1) / page * page;
+
+	if (!chans || (2 * len * chans > SSIZE_MAX))
+		return false;
+
+	int fd = syscall(SYS_memfd_create, "ts_buffer", flags);
+	if (fd < 0)
 		return false;
 
-	data = new uint32_t[buf_len];
-	if (!data)
+	if (ftruncate(fd, len * chans) < 0) {
+		close(fd);
 		return false;
+	}
+
+	/* Huge page mappings must start on a page boundary */
+	size_t total = 2 * len * chans;
+	char *raw = (char *) mmap(NULL, total + page, PROT_NONE,
+				  MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (raw == MAP_FAILED) {
+		close(fd);
+		return false;
+	}
+
+	char *base = raw + (page - (uintptr_t) raw % page) % page;
+	if (base > raw)
+		munmap(raw, base - raw);
+	munmap(base + total, raw + page - base);
+
+	for (size_t i = 0; i < 2 * chans; i++) {
+		void *addr = mmap(base + i * len, len, PROT_READ | PROT_WRITE,
+				  MAP_SHARED | MAP_FIXED, fd, i / 2 * len);
+		if (addr == MAP_FAILED) {
+			munmap(base, total);
+			close(fd);
+			return false;
+		}
+	}
+
+	close(fd);
+
+	data = base;
+	map_len = len;
+	buf_len = len / smpl_size;
 
 	return true;
 }
 
-/* Reset time and data marker indicies */
+/*
+ * Allocate underlying memory buffer
+ *
+ * With huge pages enabled the ring is placed on reserved huge pages if
+ * available and the ring is a whole number of pages, otherwise on normal
+ * pages with transparent huge pages requested. Rings are never placed on
+ * pages larger than TS_BUFFER_HUGE_MAX, which would dwarf the ring itself.
+ * Time markers are kept in a separate shared page, so a buffer initialized
+ * before fork() is shared with the child process.
+ */
+bool ts_buffer::init()
+{
+	size_t page = sysconf(_SC_PAGESIZE);
+	size_t huge = hugepage_len();
+
+	bool reserved = huge && (huge <= TS_BUFFER_HUGE_MAX) &&
+			!(buf_len * smpl_size % huge);
+
+	if (!(reserved && map_ring(huge, hugepage_memfd_flags()))) {
+		if (!map_ring(page, 0))
+			return false;
+
+		if (huge)
+			madvise(data, 2 * map_len * chans, MADV_HUGEPAGE);
+	}
+
+	void *mem = mmap(NULL, page, PROT_READ | PROT_WRITE,
+			 MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+	if (mem == MAP_FAILED)
+		return false;
+
+	marks = new (mem) ts_marks();
+
+	/* Unused cursors never hold back the writer */
+	for (int i = 1; i < TS_BUFFER_READERS; i++)
+		marks->readers[i].time_start.store(INT64_MAX);
+
+	marks->readers[0].mode.store(TS_READER_LOSSY);
+
+	return true;
+}
+
+/*
+ * Claim a free reader slot. The read marker starts at the write head, or
+ * at the first write if nothing was written yet.
+ */
+int ts_buffer::attach(enum ts_reader_mode mode)
+{
+	if (!marks || (mode == TS_READER_FREE))
+		return -1;
+
+	for (int i = 1; i < TS_BUFFER_READERS; i++) {
+		struct ts_cursor *cursor = &marks->readers[i];
+		int free = TS_READER_FREE;
+
+		if (!cursor->mode.compare_exchange_strong(free, mode))
+			continue;
+
+		cursor->overruns.store(0);
+		cursor->time_start.store(get_last_time(), std::memory_order_release);
+
+		return i;
+	}
+
+	return -1;
+}
+
+void ts_buffer::detach(int id)
+{
+	struct ts_cursor *cursor = &marks->readers[id];
+
+	cursor->time_start.store(INT64_MAX, std::memory_order_release);
+	cursor->mode.store(TS_READER_FREE, std::memory_order_release);
+}
+
+/* Oldest read marker of the lossless readers, INT64_MAX if there are none */
+int64_t ts_buffer::lossless_start() const
+{
+	int64_t start = INT64_MAX;
+
+	for (int i = 0; i < TS_BUFFER_READERS; i++) {
+		const struct ts_cursor *cursor = &marks->readers[i];
+
+		if (cursor->mode.load(std::memory_order_acquire) != TS_READER_LOSSLESS)
+			continue;
+
+		int64_t ts = cursor->time_start.load(std::memory_order_acquire);
+		if (ts < start)
+			start = ts;
+	}
+
+	return start;
+}
+
+/* Reset time markers. Not safe while reader or writer is active. */
 void ts_buffer::reset()
 {
-	time_start = 0;
-	time_end = 0;
-	data_start = 0;
-	data_end = 0;
+	for (int i = 0; i < TS_BUFFER_READERS; i++) {
+		if (marks->readers[i].mode.load() != TS_READER_FREE)
+			marks->readers[i].time_start.store(0);
+	}
+
+	marks->time_end.store(0);
+	marks->time_origin.store(0);
+	marks->time_wr.store(0);
+	marks->gap_cnt.store(0);
+
+	rd.gap_rd = 0;
+}
+
+/* Clear telemetry counters. Safe at any time. */
+void ts_buffer::reset_stats()
+{
+	marks->writes.store(0);
+	marks->reads.store(0);
+	marks->overflows.store(0);
+	marks->underruns.store(0);
+	marks->stale_reads.store(0);
+	marks->fill_max.store(0);
+	marks->gaps.store(0);
+	marks->gap_smpls.store(0);
+	marks->blocked.store(0);
+}
+
+void ts_buffer::get_stats(struct ts_buffer_stats *stats) const
+{
+	int64_t fill = get_last_time() - get_first_time();
+
+	stats->length = buf_len;
+	stats->fill = fill > 0 ? fill : 0;
+	stats->fill_max = marks->fill_max.load(std::memory_order_relaxed);
+	stats->writes = marks->writes.load(std::memory_order_relaxed);
+	stats->reads = marks->reads.load(std::memory_order_relaxed);
+	stats->overflows = marks->overflows.load(std::memory_order_relaxed);
+	stats->underruns = marks->underruns.load(std::memory_order_relaxed);
+	stats->stale_reads = marks->stale_reads.load(std::memory_order_relaxed);
+	stats->gaps = marks->gaps.load(std::memory_order_relaxed);
+	stats->gap_smpls = marks->gap_smpls.load(std::memory_order_relaxed);
+	stats->blocked = marks->blocked.load(std::memory_order_relaxed);
+}
+
+static void stat_inc(std::atomic<uint64_t> &stat)
+{
+	stat.fetch_add(1, std::memory_order_relaxed);
 }
 
 /* Return number of available samples for a given timestamp */
 size_t ts_buffer::avail_smpls(int64_t ts) const
 {
-	if (ts >= time_end)
+	int64_t end = get_last_time();
+
+	if (ts >= end)
 		return 0;
 	else
-		return time_end - ts;
+		return end - ts;
 }
 
 /* Read into supplied buffer with timestamp and internal copy */
+ssize_t ts_buffer::read(rd_state &rd, void *buf, size_t len, int64_t ts)
+{
+	if ((chans != 1) || (rd.id < 0))
+		return -ERR_MEM;
+
+	int rc = chk_rd(rd, ts, len);
+	if (rc < 0)
+		return rc;
+
+	memcpy(buf, chan_data(0, ts), len * smpl_size);
+
+	marks->readers[rd.id].time_start.store(ts + len, std::memory_order_release);
+
+	return len;
+}
+
 ssize_t ts_buffer::read(void *buf, size_t len, int64_t ts)
 {
-	int type_sz = 2 * sizeof(int16_t);
+	return read(rd, buf, len, ts);
+}
+
+/* Reads must fall between the read marker and the write head */
+int ts_buffer::chk_rd(const rd_state &rd, int64_t ts, size_t len)
+{
+	int64_t end = get_last_time();
+
+	if ((len >= buf_len) || (ts < 0))
+		return -ERR_TIMESTAMP;
 
-	/* Check for valid read */
-	if ((len >= buf_len) || (ts + (int64_t) len > time_end))
+	/* Reader is ahead of the writer */
+	if (ts + (int64_t) len > end) {
+		stat_inc(marks->underruns);
 		return -ERR_TIMESTAMP;
+	}
 
 	/* Disallow reads prior to read marker with no readable data */
-	if (ts + (int64_t) len < time_start)
-		return ERR_TIMESTAMP;
-
-	/* How many samples should be copied out */
-	size_t num_smpls = time_end - ts;
-	if (num_smpls > len);
-		num_smpls = len;
-
-	/* Starting index */
-	size_t rd_start = (data_start + (ts - time_start)) % buf_len;
-
-	/* Read out */
-	if (rd_start + num_smpls < buf_len) {
-		size_t num_bytes = len * type_sz;
-		memcpy(buf, data + rd_start, num_bytes);
-	} else {
-		size_t copy0 = (buf_len - rd_start) * type_sz;
-		size_t copy1 = len * type_sz - copy0;
-
-		memcpy(buf, data + rd_start, copy0);
-		memcpy((char *) buf + copy0, data, copy1);
+	if (ts + (int64_t) len < get_first_time(rd.id))
+		return -ERR_TIMESTAMP;
+
+	/* Samples already overwritten by the writer */
+	if (end - ts > (int64_t) buf_len) {
+		stat_inc(marks->stale_reads);
+		stat_inc(marks->readers[rd.id].overruns);
+		return -ERR_OVERFLOW;
 	}
 
-	data_start = (rd_start + len) % buf_len;
-	time_start = ts + len;
+	stat_inc(marks->reads);
 
-	if (time_start > time_end)
-		return -ERR_TIMESTAMP;
-	else
-		return num_smpls;
+	return 0;
 }
 
-/* Return zero-copy pointer to read buffer */
-const void *ts_buffer::get_rd_buf(int64_t ts, size_t len, int *err)
+/*
+ * Open a read window. The first channel window tags the outstanding buffer
+ * and windows past the ring end fall into the mirrored mapping.
+ */
+int ts_buffer::open_rd(rd_state &rd, int64_t ts, size_t len)
 {
-	char *buf;
-	bool wrap = false;
+	/* Must be attached with no buffers outstanding */
+	if ((rd.id < 0) || rd.tag)
+		return -ERR_MEM;
 
-	int type_size = 2 * sizeof(short);
+	int rc = chk_rd(rd, ts, len);
+	if (rc < 0)
+		return rc;
 
-	/* Must be no buffers outstanding */
-	if (this->tag) {
-		if (err)
-			*err = ERR_MEM;
-		return NULL;
-	}
+	rd.tag = chan_data(0, ts);
+	rd.end = ts + len;
 
-	/* Check for valid read */
-	if ((len >= buf_len) || (ts < 0) || (ts + (int64_t) len > time_end)) {
-		if (err)
-			*err = ERR_TIMESTAMP;
-		return NULL;
-	}
+	return 0;
+}
 
-	/* Disallow reads prior to read marker with no readable data */
-	if (ts + (int64_t) len < time_start) {
+/* Return zero-copy pointer to read buffer */
+const void *ts_buffer::get_rd_buf(int64_t ts, size_t len, int *err)
+{
+	int rc = chans == 1 ? open_rd(rd, ts, len) : -ERR_MEM;
+	if (rc < 0) {
 		if (err)
-			*err = ERR_TIMESTAMP;
+			*err = -rc;
 		return NULL;
 	}
 
-	/* How many samples */
-	size_t num_smpls = time_end - ts;
-	if (num_smpls > len);
-		num_smpls = len;
-
-	/* Start index */
-	size_t rd_start = (data_start + (ts - time_start)) % buf_len;
-	size_t _rd_start = rd_start * type_size;
-
-	/* Read */
-	if (rd_start + num_smpls < buf_len) {
-		buf = (char *) data + _rd_start;
-	} else {
-		buf = new char[len * type_size];
-		size_t copy0 = (buf_len - rd_start) * type_size;
-		size_t copy1 = len * type_size - copy0;
-
-		memcpy(buf, (char *) data + _rd_start, copy0);
-		memcpy(buf + copy0, data, copy1);
-		wrap = true;
-	}
+	return rd.tag;
+}
+
+/* Return zero-copy pointers to the read buffer of every channel */
+int ts_buffer::get_rd_buf(rd_state &rd, int64_t ts, size_t len,
+			  std::vector<short *> &bufs)
+{
+	if (bufs.size() != chans)
+		return -ERR_MEM;
+
+	int rc = open_rd(rd, ts, len);
+	if (rc < 0)
+		return rc;
+
+	for (size_t i = 0; i < chans; i++)
+		bufs[i] = (short *) chan_data(i, ts);
 
-	data_start = (rd_start + len) % buf_len;
-	time_start = ts + len;
+	return 0;
+}
+
+int ts_buffer::get_rd_buf(int64_t ts, size_t len, std::vector<short *> &bufs)
+{
+	return get_rd_buf(rd, ts, len, bufs);
+}
 
-	this->tag = buf;
-	this->tag_len = len;
-	this->tag_alloc = wrap;
+/* Commit the completed read buffer and release it to the writer */
+bool ts_buffer::commit_rd(rd_state &rd, const void *buf)
+{
+	if ((!buf) || (buf != rd.tag))
+		return false;
 
-	return buf;
+	rd.tag = NULL;
+	marks->readers[rd.id].time_start.store(rd.end, std::memory_order_release);
+
+	return true;
 }
 
-/* Commit the completed read buffer */
 bool ts_buffer::commit_rd(const void *buf)
 {
-	if ((!buf) || (buf != tag))
+	return commit_rd(rd, buf);
+}
+
+bool ts_buffer::commit_rd(const std::vector<short *> &bufs)
+{
+	if (bufs.size() != chans)
+		return false;
+
+	return commit_rd(rd, bufs[0]);
+}
+
+/*
+ * Copy previously written samples into the supplied buffers without moving
+ * the read marker. Samples must not have been overwritten by the end of the
+ * copy.
+ */
+ssize_t ts_buffer::lookback(const std::vector<short *> &bufs,
+			    size_t len, int64_t ts)
+{
+	if (bufs.size() != chans)
+		return -ERR_MEM;
+
+	if ((len >= buf_len) || (ts + (int64_t) len > get_last_time()))
+		return -ERR_TIMESTAMP;
+
+	if (ts < get_history_time())
+		return -ERR_OVERFLOW;
+
+	for (size_t i = 0; i < chans; i++)
+		memcpy(bufs[i], chan_data(i, ts), len * smpl_size);
+
+	std::atomic_thread_fence(std::memory_order_acquire);
+
+	if (ts < get_history_time()) {
+		stat_inc(marks->stale_reads);
+		return -ERR_OVERFLOW;
+	}
+
+	return len;
+}
+
+/* Oldest sample that has not been overwritten */
+int64_t ts_buffer::get_history_time() const
+{
+	int64_t origin = marks->time_origin.load(std::memory_order_acquire);
+	int64_t start = marks->time_wr.load(std::memory_order_relaxed) - buf_len;
+
+	return start > origin ? start : origin;
+}
+
+/*
+ * Report the oldest gap not yet reported that starts before a timestamp.
+ * Gaps pushed out of the gap history before the reader got to them are not
+ * reported.
+ */
+bool ts_buffer::get_gap(rd_state &rd, int64_t end, int64_t *ts, int64_t *len)
+{
+	uint64_t cnt = marks->gap_cnt.load(std::memory_order_acquire);
+
+	if (cnt - rd.gap_rd > TS_BUFFER_GAPS)
+		rd.gap_rd = cnt - TS_BUFFER_GAPS;
+	if (rd.gap_rd == cnt)
 		return false;
 
-	if (tag_alloc)
-		delete tag;
+	size_t i = rd.gap_rd % TS_BUFFER_GAPS;
+	int64_t gap_ts = marks->gap_ts[i].load(std::memory_order_relaxed);
+	int64_t gap_len = marks->gap_len[i].load(std::memory_order_relaxed);
+
+	/* Entry was replaced while it was read */
+	std::atomic_thread_fence(std::memory_order_acquire);
+	if (marks->gap_cnt.load(std::memory_order_relaxed) - rd.gap_rd > TS_BUFFER_GAPS)
+		return get_gap(rd, end, ts, len);
+
+	if (gap_ts >= end)
+		return false;
 
-	tag = NULL;
+	*ts = gap_ts;
+	*len = gap_len;
+	rd.gap_rd++;
 
 	return true;
 }
 
-ssize_t ts_buffer::write(void *buf, size_t len, int64_t ts)
+bool ts_buffer::get_gap(int64_t end, int64_t *ts, int64_t *len)
+{
+	return get_gap(rd, end, ts, len);
+}
+
+/* Reads of the buffer's own reader that found samples overwritten */
+uint64_t ts_buffer::get_overruns() const
+{
+	return marks->readers[0].overruns.load(std::memory_order_relaxed);
+}
+
+/* Writes must advance the write head */
+int ts_buffer::chk_wr(int64_t ts, size_t len)
 {
-	bool wrap = false;
-	bool init = false;
-	int type_sz = 2 * sizeof(int16_t);
+	int64_t end = marks->time_end.load(std::memory_order_relaxed);
 
-	if ((len >= buf_len) || (ts < 0) || (ts + (int64_t) len <= time_end))
+	if ((len >= buf_len) || (ts < 0) || (ts + (int64_t) len <= end))
 		return -ERR_TIMESTAMP;
 
-	/* Start index */
-	size_t wr_start = data_start + (ts - time_start);
-	if (wr_start >= buf_len) {
-		wr_start = wr_start % buf_len;
-		wrap = true;
+	/*
+	 * Samples not yet read by a lossless reader must not be overwritten.
+	 * A reader that has read up to the write head has nothing left to
+	 * lose, and would otherwise hold back a write far past a gap forever.
+	 */
+	int64_t start = lossless_start();
+	if (end && (start < end) &&
+	    (ts + (int64_t) len - start > (int64_t) buf_len)) {
+		stat_inc(marks->blocked);
+		return -ERR_OVERFLOW;
 	}
 
-	/* Write it or just update head on 0 length write */
-	if (len) {
-		if ((wr_start + len) < buf_len) {
-			size_t num_bytes = len * type_sz;
-			memcpy(data + wr_start, buf, num_bytes);
-		} else {
-			size_t copy0 = (buf_len - wr_start) * type_sz;
-			size_t copy1 = len * type_sz - copy0;
-
-			memcpy(data + wr_start, buf, copy0);
-			memcpy(data, (char*) buf + copy0, copy1);
-
-			wrap = true;
+	return 0;
+}
+
+/* Announce the window end before any samples in the window are written */
+void ts_buffer::announce_wr(int64_t end)
+{
+	marks->time_wr.store(end, std::memory_order_relaxed);
+	std::atomic_thread_fence(std::memory_order_release);
+}
+
+/*
+ * Zero fill samples skipped between the write head and a write further
+ * ahead and record the gap. Only the ring length ahead of the write end is
+ * filled, since older samples are overwritten anyway.
+ */
+void ts_buffer::fill_gap(int64_t ts, size_t len)
+{
+	int64_t end = marks->time_end.load(std::memory_order_relaxed);
+	if (!end || (ts <= end))
+		return;
+
+	int64_t start = end;
+	if (ts + (int64_t) len - start > (int64_t) buf_len)
+		start = ts + len - buf_len;
+
+	if (ts + (int64_t) len > marks->time_wr.load(std::memory_order_relaxed))
+		announce_wr(ts + len);
+
+	for (size_t i = 0; (start < ts) && (i < chans); i++)
+		memset(chan_data(i, start), 0, (ts - start) * smpl_size);
+
+	uint64_t cnt = marks->gap_cnt.load(std::memory_order_relaxed);
+	marks->gap_ts[cnt % TS_BUFFER_GAPS].store(end, std::memory_order_relaxed);
+	marks->gap_len[cnt % TS_BUFFER_GAPS].store(ts - end, std::memory_order_relaxed);
+	marks->gap_cnt.store(cnt + 1, std::memory_order_release);
+
+	stat_inc(marks->gaps);
+	marks->gap_smpls.fetch_add(ts - end, std::memory_order_relaxed);
+}
+
+/* Make written samples visible to the reader */
+int ts_buffer::publish_wr(int64_t ts, size_t len)
+{
+	fill_gap(ts, len);
+
+	/* Read markers start at the first write */
+	if (!marks->time_end.load(std::memory_order_relaxed)) {
+		for (int i = 0; i < TS_BUFFER_READERS; i++) {
+			struct ts_cursor *cursor = &marks->readers[i];
+
+			if (cursor->mode.load(std::memory_order_relaxed) !=
+			    TS_READER_FREE)
+				cursor->time_start.store(ts, std::memory_order_relaxed);
 		}
+		marks->time_origin.store(ts, std::memory_order_release);
 	}
 
-	if (!data_start) {
-		data_start = wr_start;
-		time_start = ts;
-		init = true;
-	}
+	marks->time_end.store(ts + len, std::memory_order_release);
+	stat_inc(marks->writes);
+
+	/* Shared futex, readers may sit in another process after fork() */
+	marks->wr_seq.fetch_add(1);
+	if (marks->wr_waiters.load())
+		syscall(SYS_futex, &marks->wr_seq, FUTEX_WAKE, INT_MAX,
+			NULL, NULL, 0);
 
-	data_end = (wr_start + len) % buf_len;
-	time_end = ts + len;
+	uint64_t fill = ts + len - get_first_time();
+	if (fill > marks->fill_max.load(std::memory_order_relaxed))
+		marks->fill_max.store(fill, std::memory_order_relaxed);
 
-	if (!init && wrap && (data_end > data_start))
+	/* Unread samples were overwritten */
+	if (fill > buf_len) {
+		stat_inc(marks->overflows);
 		return -ERR_OVERFLOW;
-	else if (time_end <= time_start)
-		return -ERR_TIMESTAMP;
+	}
 
 	return len;
 }
 
-void *ts_buffer::get_wr_buf(int64_t ts, size_t len, int *err)
+/*
+ * Block until the write head moves past ts or the timeout expires, so that
+ * callers can recheck whether the writer is still running. Returns true if
+ * the head moved.
+ */
+bool ts_buffer::wait_wr(int64_t ts, int usec) const
 {
-	bool wrap0 = false;
-	bool wrap1 = false;
-	bool init = false;
+	struct timespec timeout = { usec / 1000000, (usec % 1000000) * 1000 };
+
+	/* Register before sampling the sequence so that no wake is missed */
+	marks->wr_waiters.fetch_add(1);
 
-	char *buf = NULL;
-	size_t copy0 = 0;
+	uint32_t seq = marks->wr_seq.load();
+	if (get_last_time() == ts)
+		syscall(SYS_futex, &marks->wr_seq, FUTEX_WAIT, seq,
+			&timeout, NULL, 0);
 
-	int type_size = 2 * sizeof(short);
+	marks->wr_waiters.fetch_sub(1);
+
+	return get_last_time() != ts;
+}
+
+ssize_t ts_buffer::write_chans(const short *const *bufs, size_t len, int64_t ts)
+{
+	int rc = chk_wr(ts, len);
+	if (rc < 0)
+		return rc;
 
+	if (len)
+		announce_wr(ts + len);
+
+	/* Write it or just update head on 0 length write */
+	for (size_t i = 0; len && (i < chans); i++)
+		memcpy(chan_data(i, ts), bufs[i], len * smpl_size);
+
+	return publish_wr(ts, len);
+}
+
+ssize_t ts_buffer::write(void *buf, size_t len, int64_t ts)
+{
+	const short *ptr = (const short *) buf;
+
+	if (len && (chans != 1))
+		return -ERR_MEM;
+
+	return write_chans(&ptr, len, ts);
+}
+
+ssize_t ts_buffer::write(const std::vector<short *> &bufs,
+			 size_t len, int64_t ts)
+{
+	if (bufs.size() != chans)
+		return -ERR_MEM;
+
+	return write_chans(&bufs.front(), len, ts);
+}
+
+/* Open a write window tagged by the first channel window */
+int ts_buffer::open_wr(int64_t ts, size_t len)
+{
 	/* Must be no buffers outstanding */
-	if (this->tag) {
-		if (err)
-			*err = ERR_MEM;
-		return NULL;
-	}
+	if (wr_tag)
+		return -ERR_MEM;
 
 	/* Check for valid write */
-	if ((len >= buf_len) || (ts < 0) || (ts + (int64_t) len <= time_end)) {
-		if (err)
-			*err = ERR_TIMESTAMP;
-		return NULL;
-	}
+	if (!len)
+		return -ERR_TIMESTAMP;
 
-	/* Starting index */
-	size_t wr_start = data_start + (ts - time_start);
-	if (wr_start >= buf_len) {
-		wr_start = wr_start % buf_len;
-		wrap0 = true;
-	}
+	int rc = chk_wr(ts, len);
+	if (rc < 0)
+		return rc;
 
-	size_t _wr_start = wr_start * type_size;
+	announce_wr(ts + len);
 
-	/* Write or update head on 0 length write */
-	if (len) {
-		if ((wr_start + len) < buf_len) {
-			buf = (char *) data + _wr_start;
-		} else {
-			buf = new char[len * type_size];
-			copy0 = (buf_len - wr_start) * type_size;
-			wrap1 = true;
-		}
-	}
+	wr_tag = chan_data(0, ts);
+	wr_ts = ts;
+	wr_len = len;
+
+	return 0;
+}
 
-	if (!data_start) {
-		data_start = wr_start;
-		time_start = ts;
-		init = true;
+/* Return zero-copy pointer to write buffer */
+void *ts_buffer::get_wr_buf(int64_t ts, size_t len, int *err)
+{
+	int rc = chans == 1 ? open_wr(ts, len) : -ERR_MEM;
+	if (rc < 0) {
+		if (err)
+			*err = -rc;
+		return NULL;
 	}
 
-	data_end = (wr_start + len) % buf_len;
-	time_end = ts + len;
+	return wr_tag;
+}
 
-	if (!init && wrap0 && (data_end > data_start))
-		return NULL;
-	if (time_end <= time_start)
-		return NULL;
+/* Return zero-copy pointers to the write buffer of every channel */
+int ts_buffer::get_wr_buf(int64_t ts, size_t len, std::vector<short *> &bufs)
+{
+	if (bufs.size() != chans)
+		return -ERR_MEM;
 
-	this->tag = buf;
-	this->tag_len = len;
-	this->tag_alloc = wrap1;
+	int rc = open_wr(ts, len);
+	if (rc < 0)
+		return rc;
 
-	if (wrap1) {
-		this->tag_split = copy0;
-		this->tag_start = (char *) data + _wr_start;
-	} else {
-		this->tag_split = 0;
-		this->tag_start = 0;
-	}
+	for (size_t i = 0; i < chans; i++)
+		bufs[i] = (short *) chan_data(i, ts);
 
-	return buf;
+	return 0;
 }
 
-bool ts_buffer::commit_wr(void *buf)
+/*
+ * Commit the first len samples of the write buffer and publish them to the
+ * reader. A zero length commit releases the buffer without writing.
+ */
+ssize_t ts_buffer::commit_wr(void *buf, size_t len)
 {
-	char *_data;
-	int type_size = 2 * sizeof(short);
+	if ((!buf) || (buf != wr_tag))
+		return -ERR_MEM;
 
-	if ((!buf) || (buf != tag))
-		return false;
+	if (len > wr_len)
+		return -ERR_TIMESTAMP;
 
-	if (tag_alloc) {
-		_data = tag_start;
-		memcpy(_data, buf, tag_split);
-		memcpy(data, (char *) buf + tag_split,
-		       tag_len * type_size - tag_split);
+	wr_tag = NULL;
+	if (!len)
+		return 0;
 
-		delete tag;
-	}
+	return publish_wr(wr_ts, len);
+}
 
-	tag = NULL;
+ssize_t ts_buffer::commit_wr(const std::vector<short *> &bufs, size_t len)
+{
+	if (bufs.size() != chans)
+		return -ERR_MEM;
 
-	return true;
+	return commit_wr(bufs[0], len);
 }
 
 ssize_t ts_buffer::write(void *buf, size_t len)
 {
-	return write(buf, len, time_end);
+	return write(buf, len, get_last_time());
 }
 
 ssize_t ts_buffer::write(int64_t timestamp)
@@ -344,12 +731,35 @@ ssize_t ts_buffer::write(int64_t timestamp)
 std::string ts_buffer::str_status() const
 {
 	std::ostringstream ost("Sample buffer: ");
+	int64_t start = get_first_time();
+	int64_t end = get_last_time();
 
 	ost << "length = " << buf_len;
-	ost << ", time_start = " << time_start;
-	ost << ", time_end = " << time_end;
-	ost << ", data_start = " << data_start;
-	ost << ", data_end = " << data_end;
+	ost << ", channels = " << chans;
+	ost << ", time_start = " << start;
+	ost << ", time_end = " << end;
+	ost << ", data_start = " << index(start);
+	ost << ", data_end = " << index(end);
+
+	return ost.str();
+}
+
+std::string ts_buffer::str_stats() const
+{
+	struct ts_buffer_stats stats;
+	std::ostringstream ost;
+
+	get_stats(&stats);
+
+	ost << "fill " << stats.fill << "/" << stats.length
+	    << " (max " << stats.fill_max << ")"
+	    << ", writes " << stats.writes
+	    << ", reads " << stats.reads
+	    << ", overflows " << stats.overflows
+	    << ", underruns " << stats.underruns
+	    << ", stale reads " << stats.stale_reads
+	    << ", gaps " << stats.gaps << " (" << stats.gap_smpls << " samples)"
+	    << ", blocked " << stats.blocked;
 
 	return ost.str();
 }
@@ -367,3 +777,27 @@ std::string ts_buffer::str_code(ssize_t code)
 		return "Sample buffer: Unknown error";
 	}
 }
+
+ts_reader::ts_reader(ts_buffer *buf, enum ts_reader_mode mode)
+	: buf(buf)
+{
+	rd.id = buf->attach(mode);
+	rd.tag = NULL;
+	rd.end = 0;
+	rd.gap_rd = buf->marks ?
+		    buf->marks->gap_cnt.load(std::memory_order_acquire) : 0;
+}
+
+ts_reader::~ts_reader()
+{
+	if (attached())
+		buf->detach(rd.id);
+}
+
+uint64_t ts_reader::get_overruns() const
+{
+	if (!attached())
+		return 0;
+
+	return buf->marks->readers[rd.id].overruns.load(std::memory_order_relaxed);
+}
@@ -4,10 +4,131 @@
 #include <stdint.h>
 #include <unistd.h>
 #include <string>
+#include <vector>
+#include <atomic>
 
+/* Bytes per complex sample of the supported element types */
+#define TS_BUFFER_SC16		(2 * sizeof(int16_t))
+#define TS_BUFFER_SC8		(2 * sizeof(int8_t))
+
+/* Timestamp gaps retained for the reader */
+#define TS_BUFFER_GAPS		64
+
+/* Reader cursors, including the buffer's own reader in slot 0 */
+#define TS_BUFFER_READERS	8
+
+/* Largest huge page a ring is placed on */
+#define TS_BUFFER_HUGE_MAX	(2 << 20)
+
+/*
+ * Lossless readers hold back the writer, which fails writes that would
+ * overwrite samples they have not read. Lossy readers are overrun instead.
+ */
+enum ts_reader_mode {
+	TS_READER_FREE,
+	TS_READER_LOSSY,
+	TS_READER_LOSSLESS,
+};
+
+/* Read marker and overrun count of one reader */
+struct ts_cursor {
+	std::atomic<int> mode;
+	std::atomic<int64_t> time_start;
+	std::atomic<uint64_t> overruns;
+};
+
+/* Read and write markers and telemetry stored in the shared mapping */
+struct ts_marks {
+	struct ts_cursor readers[TS_BUFFER_READERS];
+	std::atomic<int64_t> time_end;
+
+	/* Write head futex, bumped on each publish, and threads blocked on it */
+	std::atomic<uint32_t> wr_seq;
+	std::atomic<uint32_t> wr_waiters;
+
+	/* First written sample and end of the window being written */
+	std::atomic<int64_t> time_origin;
+	std::atomic<int64_t> time_wr;
+
+	std::atomic<uint64_t> writes;
+	std::atomic<uint64_t> reads;
+	std::atomic<uint64_t> overflows;
+	std::atomic<uint64_t> underruns;
+	std::atomic<uint64_t> stale_reads;
+	std::atomic<uint64_t> fill_max;
+	std::atomic<uint64_t> gaps;
+	std::atomic<uint64_t> gap_smpls;
+	std::atomic<uint64_t> blocked;
+
+	/* Start and length of recent gaps, published by the gap count */
+	std::atomic<uint64_t> gap_cnt;
+	std::atomic<int64_t> gap_ts[TS_BUFFER_GAPS];
+	std::atomic<int64_t> gap_len[TS_BUFFER_GAPS];
+};
+
+/*
+ * Buffer telemetry snapshot
+ *
+ * Fill is the distance from the read marker to the write head in samples.
+ * Overflows count writes that overwrote unread samples, underruns count
+ * reads past the write head, and stale reads count reads of samples that
+ * were already overwritten. Gaps count writes that skipped ahead of the
+ * write head and the samples they skipped. Blocked writes were refused to
+ * preserve samples not yet read by a lossless reader.
+ */
+struct ts_buffer_stats {
+	size_t length;
+	size_t fill;
+	size_t fill_max;
+	uint64_t writes;
+	uint64_t reads;
+	uint64_t overflows;
+	uint64_t underruns;
+	uint64_t stale_reads;
+	uint64_t gaps;
+	uint64_t gap_smpls;
+	uint64_t blocked;
+};
+
+/*
+ * Timestamped sample ring buffer
+ *
+ * The ring is mapped twice back-to-back in virtual memory so that any window
+ * shorter than the ring is contiguous, and reads and writes never copy to
+ * handle wrap-around.
+ *
+ * Multichannel buffers store each channel in its own mirrored region under a
+ * single time index, so one window and one set of markers cover all
+ * channels. Windows are returned as one pointer per channel. The single
+ * pointer read and write calls are limited to single channel buffers.
+ * Samples are sc16 by default. Buffers holding sc8 device samples are
+ * created with TS_BUFFER_SC8, and lengths and timestamps still count
+ * samples; only the window pointers refer to 8-bit values.
+ *
+ * Safe for a single writer and a single reader running on separate threads,
+ * or separate processes when the buffer is initialized before fork().
+ * Buffer position is derived from the timestamp alone. The writer publishes
+ * the write head (time_end) after samples are in place and the reader
+ * publishes the read marker (time_start) after a read is consumed. More
+ * readers can follow the same samples through ts_reader, each with its own
+ * read marker.
+ *
+ * Samples behind the read marker remain available until overwritten and can
+ * be copied out again with lookback(). The writer announces the end of each
+ * window (time_wr) before filling it, so a copy that raced with the writer
+ * is detected and discarded.
+ *
+ * A write ahead of the write head leaves a gap of samples the source never
+ * delivered. The gap is zero filled, up to the ring length, and recorded so
+ * that the reader can tell lost samples from received ones with get_gap().
+ *
+ * Readers block on the write head with wait_wr(), which sleeps on a futex in
+ * the shared mapping until the writer publishes past the given timestamp.
+ */
 class ts_buffer {
 public:
-	ts_buffer(size_t len);
+	ts_buffer(size_t len, size_t chans = 1,
+		  size_t smpl_size = TS_BUFFER_SC16);
 	~ts_buffer();
 
 	bool init();
@@ -19,14 +140,31 @@ public:
 	ssize_t write(void *buf, size_t len, int64_t ts);
 	ssize_t write(void *buf, size_t len);
 	ssize_t write(int64_t ts);
+	ssize_t write(const std::vector<short *> &bufs, size_t len, int64_t ts);
 
 	const void *get_rd_buf(int64_t ts, size_t len, int *err = NULL);
 	void *get_wr_buf(int64_t ts, size_t len, int *err = NULL);
 
+	int get_rd_buf(int64_t ts, size_t len, std::vector<short *> &bufs);
+	int get_wr_buf(int64_t ts, size_t len, std::vector<short *> &bufs);
+
 	bool commit_rd(const void *buf);
-	bool commit_wr(void *buf);
+	ssize_t commit_wr(void *buf, size_t len);
+
+	bool commit_rd(const std::vector<short *> &bufs);
+	ssize_t commit_wr(const std::vector<short *> &bufs, size_t len);
+
+	ssize_t lookback(const std::vector<short *> &bufs, size_t len, int64_t ts);
+	int64_t get_history_time() const;
+
+	bool get_gap(int64_t end, int64_t *ts, int64_t *len);
+	uint64_t get_overruns() const;
+
+	void get_stats(struct ts_buffer_stats *stats) const;
+	void reset_stats();
 
 	std::string str_status() const;
+	std::string str_stats() const;
 
 	static std::string str_code(ssize_t code);
 
@@ -36,23 +174,135 @@ public:
 		ERR_OVERFLOW,
 	};
 
-	int64_t get_last_time() const { return time_end; }
-	int64_t get_first_time() const { return time_start; }
+	size_t get_len() const { return buf_len; }
+	size_t get_chans() const { return chans; }
+	size_t get_smpl_size() const { return smpl_size; }
+
+	int64_t get_last_time() const { return marks->time_end.load(std::memory_order_acquire); }
+	int64_t get_first_time() const { return get_first_time(0); }
+
+	bool wait_wr(int64_t ts, int usec) const;
 
 private:
-	uint32_t *data;
+	/* Reader state private to the reading thread */
+	struct rd_state {
+		int id;
+		const void *tag;
+		int64_t end;
+		uint64_t gap_rd;
+	};
+
+	int64_t get_first_time(int id) const
+	{
+		return marks->readers[id].time_start.load(std::memory_order_acquire);
+	}
+
+	size_t index(int64_t ts) const { return ts % buf_len; }
+
+	/* Channel regions are spaced by the mirrored ring length */
+	char *chan_data(size_t chan, int64_t ts) const
+	{
+		return data + smpl_size * (2 * buf_len * chan + index(ts));
+	}
+
+	bool map_ring(size_t page, int flags);
+	int attach(enum ts_reader_mode mode);
+	void detach(int id);
+	int64_t lossless_start() const;
+
+	int chk_rd(const rd_state &rd, int64_t ts, size_t len);
+	int open_rd(rd_state &rd, int64_t ts, size_t len);
+	ssize_t read(rd_state &rd, void *buf, size_t len, int64_t ts);
+	int get_rd_buf(rd_state &rd, int64_t ts, size_t len,
+		       std::vector<short *> &bufs);
+	bool commit_rd(rd_state &rd, const void *buf);
+	bool get_gap(rd_state &rd, int64_t end, int64_t *ts, int64_t *len);
+
+	int chk_wr(int64_t ts, size_t len);
+	int open_wr(int64_t ts, size_t len);
+	void announce_wr(int64_t end);
+	void fill_gap(int64_t ts, size_t len);
+	int publish_wr(int64_t ts, size_t len);
+	ssize_t write_chans(const short *const *bufs, size_t len, int64_t ts);
+
+	char *data;
 	size_t buf_len;
+	size_t chans;
+	size_t smpl_size;
+	size_t map_len;
+	struct ts_marks *marks;
+
+	/* Own reader in slot 0 */
+	rd_state rd;
+
+	/* Outstanding write buffer */
+	void *wr_tag;
+	int64_t wr_ts;
+	size_t wr_len;
 
-	int64_t time_start;
-	int64_t time_end;
-	int64_t data_start;
-	int64_t data_end;
+	friend class ts_reader;
+};
+
+/*
+ * Additional sample buffer reader
+ *
+ * Attaches a read marker to an initialized buffer, from any process that
+ * shares it, so that consumers such as the sample recorder and event
+ * capture can follow the samples seen by the decoder without a copy of the
+ * stream. Windows, lookback and gaps behave as for the buffer's own reader.
+ * A lossy reader that falls behind the writer has its reads fail with
+ * ERR_OVERFLOW and counts an overrun. Attaching fails when all reader slots
+ * are taken.
+ */
+class ts_reader {
+public:
+	ts_reader(ts_buffer *buf, enum ts_reader_mode mode = TS_READER_LOSSY);
+	~ts_reader();
+
+	bool attached() const { return rd.id > 0; }
+
+	size_t avail_smpls(int64_t ts) const { return buf->avail_smpls(ts); }
+
+	ssize_t read(void *out, size_t len, int64_t ts)
+	{
+		return buf->read(rd, out, len, ts);
+	}
+
+	int get_rd_buf(int64_t ts, size_t len, std::vector<short *> &bufs)
+	{
+		return buf->get_rd_buf(rd, ts, len, bufs);
+	}
+
+	bool commit_rd(const std::vector<short *> &bufs)
+	{
+		return (bufs.size() == buf->chans) && buf->commit_rd(rd, bufs[0]);
+	}
+
+	ssize_t lookback(const std::vector<short *> &bufs, size_t len, int64_t ts)
+	{
+		return buf->lookback(bufs, len, ts);
+	}
+
+	bool get_gap(int64_t end, int64_t *ts, int64_t *len)
+	{
+		return buf->get_gap(rd, end, ts, len);
+	}
+
+	uint64_t get_overruns() const;
+
+	int64_t get_first_time() const
+	{
+		return attached() ? buf->get_first_time(rd.id) : -1;
+	}
+	int64_t get_last_time() const { return buf->get_last_time(); }
+
+private:
+	/* Reader slots are owned by one reader */
+	ts_reader(const ts_reader &);
+	ts_reader &operator=(const ts_reader &);
 
-	char *tag;
-	int tag_len;
-	char *tag_start;
-	int tag_split;
-	bool tag_alloc;
+	ts_buffer *buf;
+	ts_buffer::rd_state rd;
 };
 
 #endif /* _LTE_BUFFER_H_ */
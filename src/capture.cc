@@ -0,0 +1,367 @@
+/*
+ * LTE Event Triggered Sample Capture
+ *
+ * Copyright (C) 2015 Ettus Research LLC
+ * Author Tom Tsou <tom.tsou@ettus.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdio.h>
+#include <iostream>
+#include <sstream>
+#include <iomanip>
+#include <chrono>
+#include <vector>
+
+#include "capture.h"
+#include "radio.h"
+#include "buffer.h"
+#include "log.h"
+
+extern "C" {
+#include "sigproc/convert.h"
+}
+
+/* Samples per channel copied out of the receive buffer at a time */
+#define CAPTURE_CHUNK_LEN	(1 << 16)
+
+/* Captures queued per interval of received samples */
+#define CAPTURE_RATE_EVENTS	8
+#define CAPTURE_RATE_SEC	10
+
+/* Share of the receive buffer a capture window may span */
+#define CAPTURE_RING_SHARE	0.75
+
+/* Interval between checks of the receive buffer head */
+#define CAPTURE_POLL_MSEC	1
+
+static const char *event_str(enum capture_event event)
+{
+	switch (event) {
+	case CAPTURE_CRC:
+		return "crc";
+	case CAPTURE_SYNC:
+		return "sync";
+	case CAPTURE_DROP:
+		return "drop";
+	default:
+		return "event";
+	}
+}
+
+event_capture::event_capture(radio_dev *dev, const record_meta &meta,
+			     const std::string &prefix, unsigned events,
+			     int64_t pre_len, int64_t post_len)
+	: dev(dev), ring(NULL), reader(NULL), meta(meta), prefix(prefix),
+	  events(events), pre_len(pre_len), post_len(post_len), rec_blocks(0),
+	  pending_end(-1), count(0), suppressed(0), running(false),
+	  limit_ts(-1), limit_count(0), limited(0)
+{
+}
+
+event_capture::~event_capture()
+{
+	stop();
+	delete reader;
+}
+
+bool event_capture::start()
+{
+	/*
+	 * Windows are copied out once their end is received, so a window
+	 * must fit in the receive buffer with room left for the copy delay
+	 */
+	ring = dev->get_buffer();
+	int64_t max_len = ring ? ring->get_len() * CAPTURE_RING_SHARE : 0;
+
+	if (max_len && (pre_len + post_len > max_len)) {
+		pre_len = pre_len * max_len / (pre_len + post_len);
+		post_len = max_len - pre_len;
+
+		std::cout << "-- Capture window limited to "
+			  << max_len * 1000 / (int64_t) meta.rate
+			  << " ms by the receive buffer" << std::endl;
+	}
+
+	if (ring) {
+		if (ring->get_chans() != meta.chans) {
+			std::cerr << "** Capture channels do not match the "
+				  << "receive buffer" << std::endl;
+			return false;
+		}
+
+		reader = new ts_reader(ring, TS_READER_LOSSY);
+		if (!reader->attached()) {
+			std::cerr << "** No receive buffer reader available "
+				  << "for event capture" << std::endl;
+			return false;
+		}
+
+		ring_ptrs.resize(meta.chans);
+	}
+
+	/* Widened sc8 windows and lookback copies */
+	if (!ring || (ring->get_smpl_size() != TS_BUFFER_SC16)) {
+		chunks.assign(meta.chans,
+			      std::vector<short>(2 * CAPTURE_CHUNK_LEN));
+
+		for (size_t i = 0; i < meta.chans; i++)
+			chunk_ptrs.push_back(&chunks[i].front());
+	}
+
+	/* Captures are short, so the recorder pool only covers one window */
+	size_t frame = 2 * sizeof(int16_t) * meta.chans;
+	rec_blocks = (pre_len + post_len) * frame / RECORD_BLOCK_LEN + 1;
+	if (rec_blocks > RECORD_NUM_BLOCKS)
+		rec_blocks = RECORD_NUM_BLOCKS;
+
+	running = true;
+	thread = std::thread(&event_capture::dumper, this);
+
+	std::cout << "-- Event capture to " << prefix << ".*, "
+		  << pre_len << " samples before and "
+		  << post_len << " after" << std::endl;
+
+	return true;
+}
+
+/* Finish queued captures with the samples received so far */
+void event_capture::stop()
+{
+	if (!thread.joinable())
+		return;
+
+	{
+		std::lock_guard<std::mutex> guard(mutex);
+		running = false;
+	}
+
+	cond.notify_all();
+	thread.join();
+
+	std::ostringstream ost;
+	ost << "DEV   : Event capture wrote " << count << " captures"
+	    << ", " << suppressed << " triggers suppressed"
+	    << ", " << limited << " rate limited";
+
+	LOG_DEV(ost.str().c_str());
+}
+
+/* Queue a capture window, safe to call from any thread */
+void event_capture::trigger(enum capture_event event, int64_t ts)
+{
+	if (!(events & event) || (ts < 0))
+		return;
+
+	std::lock_guard<std::mutex> guard(mutex);
+
+	if (!running)
+		return;
+
+	/* Window overlaps one already queued */
+	if (ts - pre_len < pending_end) {
+		suppressed++;
+		return;
+	}
+
+	/* Bursts of triggers are limited per interval of received samples */
+	int64_t interval = CAPTURE_RATE_SEC * (int64_t) meta.rate;
+	if ((limit_ts < 0) || (ts - limit_ts >= interval)) {
+		limit_ts = ts;
+		limit_count = 0;
+	}
+
+	if (limit_count >= CAPTURE_RATE_EVENTS) {
+		/* Reported once per interval */
+		if (limit_count++ == CAPTURE_RATE_EVENTS) {
+			std::ostringstream ost;
+			ost << "DEV   : Event capture rate limit of "
+			    << CAPTURE_RATE_EVENTS << " per "
+			    << CAPTURE_RATE_SEC << " s reached";
+			LOG_ERR(ost.str().c_str());
+		}
+
+		limited++;
+		return;
+	}
+
+	limit_count++;
+
+	capture_job job;
+	job.event = event;
+	job.ts = ts;
+	job.start = ts > pre_len ? ts - pre_len : 0;
+	job.end = ts + post_len;
+
+	jobs.push_back(job);
+	pending_end = job.end;
+
+	cond.notify_all();
+}
+
+/* Wait for the receive buffer to pass the window end or for shutdown */
+bool event_capture::wait_end(int64_t end)
+{
+	std::unique_lock<std::mutex> lock(mutex);
+
+	while (dev->get_ts_high() < end) {
+		if (!running)
+			return false;
+
+		cond.wait_for(lock, std::chrono::milliseconds(CAPTURE_POLL_MSEC));
+	}
+
+	return true;
+}
+
+/*
+ * Record one chunk of a window, false if the receiver overwrote it. Ring
+ * samples are recorded in place and checked against the ring history once
+ * the recorder has copied them.
+ */
+bool event_capture::record_chunk(sample_recorder &rec, size_t len, int64_t ts)
+{
+	if (!reader) {
+		if (dev->lookback(chunk_ptrs, len, ts) < 0)
+			return false;
+
+		rec.push(chunk_ptrs, len, ts);
+		return true;
+	}
+
+	if (reader->get_rd_buf(ts, len, ring_ptrs) < 0)
+		return false;
+
+	if (ring->get_smpl_size() == TS_BUFFER_SC8) {
+		for (size_t i = 0; i < meta.chans; i++) {
+			convert_sc8_short(chunk_ptrs[i],
+					  (const int8_t *) ring_ptrs[i], 2 * len);
+		}
+
+		rec.push(chunk_ptrs, len, ts);
+	} else {
+		rec.push(ring_ptrs, len, ts);
+	}
+
+	reader->commit_rd(ring_ptrs);
+
+	return ts >= ring->get_history_time();
+}
+
+/* Samples of a window that the receive buffer zero filled */
+int64_t event_capture::count_gaps(int64_t start, int64_t end)
+{
+	int64_t gap_ts, gap_len, total = 0;
+
+	if (!reader)
+		return 0;
+
+	while (reader->get_gap(end, &gap_ts, &gap_len)) {
+		int64_t lo = gap_ts > start ? gap_ts : start;
+		int64_t hi = gap_ts + gap_len < end ? gap_ts + gap_len : end;
+
+		if (hi > lo)
+			total += hi - lo;
+	}
+
+	return total;
+}
+
+bool event_capture::dump(const capture_job &job)
+{
+	std::ostringstream ost;
+	int64_t end = job.end;
+
+	if (!wait_end(end) && (dev->get_ts_high() < end))
+		end = dev->get_ts_high();
+
+	/*
+	 * Pre-trigger samples are limited to the retained history, and the
+	 * capture reader cannot read back past samples it has already read
+	 */
+	int64_t start = job.start;
+	if (start < dev->get_ts_history())
+		start = dev->get_ts_history();
+	if (reader && (start < reader->get_first_time()))
+		start = reader->get_first_time();
+
+	if (start >= end) {
+		LOG_ERR("DEV   : Event capture window no longer available");
+		return false;
+	}
+
+	ost << prefix << "." << std::setw(4) << std::setfill('0') << count
+	    << "." << event_str(job.event)
+	    << "." << sample_format_str(meta.format);
+
+	sample_recorder rec(meta, rec_blocks);
+	if (!rec.open(ost.str()))
+		return false;
+
+	int64_t ts;
+	for (ts = start; ts < end; ts += CAPTURE_CHUNK_LEN) {
+		size_t len = end - ts;
+		if (len > CAPTURE_CHUNK_LEN)
+			len = CAPTURE_CHUNK_LEN;
+
+		if (!record_chunk(rec, len, ts)) {
+			LOG_ERR("DEV   : Event capture overrun by receiver");
+			break;
+		}
+	}
+
+	rec.close();
+
+	if (ts > end)
+		ts = end;
+
+	ost.str("");
+	ost << "DEV   : Captured " << event_str(job.event)
+	    << " event at " << job.ts
+	    << ", " << job.ts - start << " samples before and "
+	    << ts - job.ts << " after";
+
+	int64_t gaps = count_gaps(start, ts);
+	if (gaps)
+		ost << ", " << gaps << " zero filled";
+
+	LOG_DEV(ost.str().c_str());
+
+	return true;
+}
+
+void event_capture::dumper()
+{
+	std::unique_lock<std::mutex> lock(mutex);
+
+	for (;;) {
+		cond.wait(lock, [this] {
+			return !jobs.empty() || !running;
+		});
+
+		if (jobs.empty())
+			break;
+
+		capture_job job = jobs.front();
+
+		lock.unlock();
+		bool ok = dump(job);
+		lock.lock();
+
+		jobs.pop_front();
+		if (ok)
+			count++;
+	}
+}
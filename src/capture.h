@@ -0,0 +1,95 @@
+#ifndef _LTE_CAPTURE_H_
+#define _LTE_CAPTURE_H_
+
+#include <stdint.h>
+#include <deque>
+#include <string>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+#include "openphy/io.h"
+#include "record.h"
+
+class radio_dev;
+class ts_buffer;
+class ts_reader;
+
+/*
+ * Event triggered sample capture
+ *
+ * Samples are not copied in steady state. The receive buffer already holds
+ * the most recent samples, so a trigger only queues a capture window around
+ * the event timestamp. A background thread waits until the window end has
+ * been received, then hands the window to a sample recorder. Ring backed
+ * sources are read in place through a lossy reader, which never holds back
+ * the receiver and reports windows the receiver overwrote during the copy
+ * and gaps it zero filled. Other sources are copied out with lookback.
+ *
+ * The pre-trigger window is bounded by the receive buffer history at the
+ * time of the copy, and windows are shortened on start to fit the receive
+ * buffer. Triggers that fall inside a pending window are counted and
+ * suppressed, as are triggers beyond the capture rate limit.
+ */
+class event_capture {
+public:
+	event_capture(radio_dev *dev, const record_meta &meta,
+		      const std::string &prefix, unsigned events,
+		      int64_t pre_len, int64_t post_len);
+	~event_capture();
+
+	bool start();
+	void stop();
+
+	void trigger(enum capture_event event, int64_t ts);
+
+private:
+	struct capture_job {
+		enum capture_event event;
+		int64_t ts;
+		int64_t start;
+		int64_t end;
+	};
+
+	void dumper();
+	bool wait_end(int64_t end);
+	bool dump(const capture_job &job);
+	bool record_chunk(sample_recorder &rec, size_t len, int64_t ts);
+	int64_t count_gaps(int64_t start, int64_t end);
+
+	radio_dev *dev;
+	ts_buffer *ring;
+	ts_reader *reader;
+	record_meta meta;
+	std::string prefix;
+	unsigned events;
+	int64_t pre_len;
+	int64_t post_len;
+
+	/* Recorder blocks holding a whole window */
+	size_t rec_blocks;
+
+	/* Receive buffer windows and widened or copied samples */
+	std::vector<short *> ring_ptrs;
+	std::vector<std::vector<short> > chunks;
+	std::vector<short *> chunk_ptrs;
+
+	/* Shared with the dump thread */
+	std::deque<capture_job> jobs;
+	int64_t pending_end;
+	unsigned count;
+	unsigned suppressed;
+	bool running;
+
+	/* Rate limit interval start and captures queued within it */
+	int64_t limit_ts;
+	unsigned limit_count;
+	unsigned limited;
+
+	std::mutex mutex;
+	std::condition_variable cond;
+	std::thread thread;
+};
+
+#endif /* _LTE_CAPTURE_H_ */
@@ -0,0 +1,345 @@
+/*
+ * LTE Wideband Channelizer
+ *
+ * Copyright (C) 2015 Ettus Research LLC
+ * Author Tom Tsou <tom.tsou@ettus.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <math.h>
+#include <new>
+#include <iostream>
+#include <sstream>
+#include <sys/mman.h>
+
+#include "channelizer.h"
+#include "Resampler.h"
+#include "radio.h"
+#include "buffer.h"
+#include "log.h"
+
+extern "C" {
+#include "openphy/sigproc.h"
+#include "sigproc/convert.h"
+}
+
+/* Carrier samples produced per channelizer pass */
+#define CHAN_BLOCK_LEN		1024
+
+/* Decimation filter length scales with the decimation factor */
+#define CHAN_TAPS_PER_DECIM	24
+
+/* Channelizer check interval while waiting on a carrier head */
+#define CHAN_WAIT_USEC		10000
+
+/*
+ * Carrier stream device
+ *
+ * Reads one carrier from the shared rings. Frequency corrections requested
+ * by the synchronizer are applied to the carrier mixer.
+ */
+class chan_radio : public ring_radio {
+public:
+	chan_radio(struct chan_shared *shared, size_t carrier, ts_buffer *ring)
+		: ring_radio(ring), shared(shared), carrier(carrier) { }
+
+	void reset() { }
+	int reload();
+
+	bool tunable() { return true; }
+	int shift(double offset);
+	int freq_reset();
+
+	std::string str_stats();
+	void reset_stats();
+
+private:
+	struct chan_shared *shared;
+	size_t carrier;
+};
+
+/* Block until the channelizer advances the carrier head */
+int chan_radio::reload()
+{
+	int64_t ts = get_ts_high();
+
+	while (!ring->wait_wr(ts, CHAN_WAIT_USEC)) {
+		if (!shared->running.load())
+			return -1;
+	}
+
+	return 0;
+}
+
+int chan_radio::shift(double offset)
+{
+	double correction = shared->correction[carrier].load() + offset;
+	shared->correction[carrier].store(correction);
+
+	std::ostringstream ost;
+	ost << "DEV   : Adjusting carrier " << carrier << " mixer "
+	    << offset << " Hz, offset " << correction << " Hz";
+	LOG_DEV(ost.str().c_str());
+
+	return 0;
+}
+
+int chan_radio::freq_reset()
+{
+	shared->correction[carrier].store(0.0);
+
+	std::ostringstream ost;
+	ost << "DEV   : Resetting carrier " << carrier << " mixer";
+	LOG_DEV(ost.str().c_str());
+
+	return 0;
+}
+
+std::string chan_radio::str_stats()
+{
+	std::ostringstream ost;
+
+	ost << "DEV   : Carrier " << carrier << " mixer offset "
+	    << shared->correction[carrier].load() << " Hz"
+	    << "\n                     Buffer " << ring->str_stats();
+
+	return ost.str();
+}
+
+void chan_radio::reset_stats()
+{
+	ring->reset_stats();
+}
+
+channelizer::channelizer(double rate, size_t decim, size_t chans,
+			 const std::vector<double> &offsets)
+	: rate(rate), decim(decim), chans(chans), offsets(offsets),
+	  phase(offsets.size(), 0.0), rings(offsets.size(), NULL),
+	  wide(chans, NULL), wins(chans, NULL),
+	  mixed(NULL), out(NULL), shared(NULL)
+{
+}
+
+channelizer::~channelizer()
+{
+	for (size_t k = 0; k < rings.size(); k++)
+		delete rings[k];
+
+	for (size_t k = 0; k < filters.size(); k++) {
+		for (size_t i = 0; i < filters[k].size(); i++)
+			delete filters[k][i];
+	}
+
+	for (size_t i = 0; i < wide.size(); i++)
+		cxvec_free(wide[i]);
+
+	cxvec_free(mixed);
+	cxvec_free(out);
+
+	if (shared)
+		munmap(shared, sizeof(struct chan_shared));
+}
+
+/*
+ * Smallest decimation factor with a wideband rate that spans every carrier
+ * at the carrier rate
+ */
+size_t channelizer::get_decim(double rate, const std::vector<double> &offsets)
+{
+	double span = 0.0;
+
+	for (size_t i = 0; i < offsets.size(); i++) {
+		if (fabs(offsets[i]) > span)
+			span = fabs(offsets[i]);
+	}
+
+	return (size_t) ceil(2.0 * span / rate) + 1;
+}
+
+bool channelizer::init()
+{
+	int flags = CXVEC_FLG_FFT_ALIGN;
+	int taps = CHAN_TAPS_PER_DECIM * decim;
+	int len = CHAN_BLOCK_LEN * decim;
+
+	if (offsets.empty() || (offsets.size() > CHAN_MAX_CARRIERS)) {
+		std::cerr << "** Invalid number of carriers "
+			  << offsets.size() << std::endl;
+		return false;
+	}
+
+	for (size_t k = 0; k < offsets.size(); k++) {
+		if (fabs(offsets[k]) + rate / decim / 2.0 > rate / 2.0) {
+			std::cerr << "** Carrier offset " << offsets[k]
+				  << " Hz outside of capture band" << std::endl;
+			return false;
+		}
+	}
+
+	void *mem = mmap(NULL, sizeof(struct chan_shared),
+			 PROT_READ | PROT_WRITE,
+			 MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+	if (mem == MAP_FAILED)
+		return false;
+
+	shared = new (mem) chan_shared();
+	shared->running.store(true);
+	for (size_t k = 0; k < CHAN_MAX_CARRIERS; k++)
+		shared->correction[k].store(0.0);
+
+	filters.resize(offsets.size());
+
+	for (size_t k = 0; k < offsets.size(); k++) {
+		rings[k] = new ts_buffer(RADIO_RX_BUFLEN, chans);
+		if (!rings[k]->init()) {
+			std::cerr << "** Carrier buffer allocation failed"
+				  << std::endl;
+			return false;
+		}
+
+		for (size_t i = 0; i < chans; i++) {
+			filters[k].push_back(new Resampler(1, decim, taps));
+			if (!filters[k][i]->init())
+				return false;
+		}
+	}
+
+	for (size_t i = 0; i < chans; i++)
+		wide[i] = cxvec_alloc(len, 0, 0, NULL, flags);
+
+	mixed = cxvec_alloc(len, taps, 0, NULL, flags);
+	out = cxvec_alloc(CHAN_BLOCK_LEN, 0, 0, NULL, flags);
+
+	std::cout << "-- Channelizing " << offsets.size() << " carriers"
+		  << " at " << rate << " Hz, decimation " << decim << std::endl;
+
+	return true;
+}
+
+/* Carrier device for use after fork() in the carrier process */
+radio_dev *channelizer::carrier(size_t carrier, int64_t *ts)
+{
+	if (carrier >= rings.size())
+		return NULL;
+
+	/* Start from the first block written by the channelizer */
+	while (!rings[carrier]->wait_wr(0, CHAN_WAIT_USEC)) {
+		if (!shared->running.load())
+			return NULL;
+	}
+
+	*ts = rings[carrier]->get_last_time();
+
+	return new chan_radio(shared, carrier, rings[carrier]);
+}
+
+/*
+ * Mix each carrier to baseband and decimate. Mixer phase is continuous
+ * across blocks and shared by all receive channels of a carrier.
+ */
+void channelizer::process(std::vector<short *> &bufs, int64_t ts)
+{
+	size_t len = cxvec_len(mixed);
+	size_t olen = cxvec_len(out);
+	int64_t out_ts = ts / decim;
+
+	for (size_t i = 0; i < chans; i++) {
+		convert_short_float((float *) cxvec_data(wide[i]),
+				    bufs[i], 2 * len, 1.0f);
+	}
+
+	for (size_t k = 0; k < offsets.size(); k++) {
+		double freq = offsets[k] +
+			      shared->correction[k].load(std::memory_order_relaxed);
+		double step = -2.0 * M_PI * freq / rate;
+		float step_re = cos(step);
+		float step_im = sin(step);
+
+		/* Blocks held back by lossless readers are dropped */
+		int rc = rings[k]->get_wr_buf(out_ts, olen, wins);
+		bool ok = rc >= 0;
+		if (!ok && (rc != -ts_buffer::ERR_OVERFLOW))
+			std::cerr << "Fatal carrier buffer error" << std::endl;
+
+		for (size_t i = 0; i < chans; i++) {
+			float *in = (float *) cxvec_data(wide[i]);
+			float *mix = (float *) cxvec_data(mixed);
+			float rot_re = cos(phase[k]);
+			float rot_im = sin(phase[k]);
+
+			for (size_t n = 0; n < len; n++) {
+				float re = in[2 * n + 0];
+				float im = in[2 * n + 1];
+
+				mix[2 * n + 0] = re * rot_re - im * rot_im;
+				mix[2 * n + 1] = re * rot_im + im * rot_re;
+
+				float tmp = rot_re * step_re - rot_im * step_im;
+				rot_im = rot_re * step_im + rot_im * step_re;
+				rot_re = tmp;
+			}
+
+			filters[k][i]->rotate(mixed, out);
+
+			if (ok) {
+				convert_float_short(wins[i], (float *) cxvec_data(out),
+						    1.0f, 2 * olen);
+			}
+		}
+
+		/* Overflow is reported to the carrier reader */
+		if (ok)
+			rings[k]->commit_wr(wins, olen);
+
+		phase[k] = fmod(phase[k] + step * len, 2.0 * M_PI);
+	}
+}
+
+/* Channelize from the wideband source until it is exhausted */
+int channelizer::run(radio_dev *src, int64_t ts)
+{
+	size_t len = cxvec_len(mixed);
+	std::vector<short *> bufs(chans);
+	int rc = 0;
+
+	/* Carrier timestamps are wideband timestamps over the decimation */
+	ts = (ts + decim - 1) / decim * decim;
+
+	for (;;) {
+		while (ts + (int64_t) len > src->get_ts_high()) {
+			if (src->reload() < 0)
+				goto done;
+		}
+
+		if (src->pull(bufs, len, ts) < 0) {
+			rc = -1;
+			break;
+		}
+
+		process(bufs, ts);
+
+		if (src->commit(bufs) < 0) {
+			rc = -1;
+			break;
+		}
+
+		ts += len;
+	}
+
+done:
+	shared->running.store(false);
+
+	return rc;
+}
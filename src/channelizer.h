@@ -0,0 +1,69 @@
+#ifndef _LTE_CHANNELIZER_H_
+#define _LTE_CHANNELIZER_H_
+
+#include <stdint.h>
+#include <stddef.h>
+#include <vector>
+#include <atomic>
+
+class radio_dev;
+class ts_buffer;
+class Resampler;
+struct cxvec;
+
+/* Maximum number of carriers split from one wideband stream */
+#define CHAN_MAX_CARRIERS	8
+
+/* State shared between the channelizer and the carrier processes */
+struct chan_shared {
+	std::atomic<bool> running;
+	std::atomic<double> correction[CHAN_MAX_CARRIERS];
+};
+
+/*
+ * Wideband channelizer
+ *
+ * Splits a wideband sample stream into baseband streams for several
+ * carriers at fixed offsets from the capture center frequency. Each carrier
+ * is mixed to baseband and passed through a polyphase decimating filter
+ * that only computes retained output samples. Output is written to one
+ * multichannel timestamped ring per carrier.
+ *
+ * Rings and control state are allocated in shared memory by init(), so
+ * carrier pipelines may run in processes forked after init(). Each carrier
+ * is exposed to its pipeline as a radio device, where frequency shifts
+ * retune the carrier mixer instead of the RF front end.
+ */
+class channelizer {
+public:
+	channelizer(double rate, size_t decim, size_t chans,
+		    const std::vector<double> &offsets);
+	~channelizer();
+
+	bool init();
+	int run(radio_dev *src, int64_t ts);
+
+	radio_dev *carrier(size_t carrier, int64_t *ts);
+
+	static size_t get_decim(double rate, const std::vector<double> &offsets);
+
+private:
+	void process(std::vector<short *> &bufs, int64_t ts);
+
+	double rate;
+	size_t decim;
+	size_t chans;
+	std::vector<double> offsets;
+	std::vector<double> phase;
+
+	std::vector<ts_buffer *> rings;
+	std::vector<std::vector<Resampler *> > filters;
+	std::vector<struct cxvec *> wide;
+	std::vector<short *> wins;
+	struct cxvec *mixed;
+	struct cxvec *out;
+
+	struct chan_shared *shared;
+};
+
+#endif /* _LTE_CHANNELIZER_H_ */
@@ -0,0 +1,316 @@
+/*
+ * LTE Sample File Replay Device
+ *
+ * Copyright (C) 2015 Ettus Research LLC
+ * Author Tom Tsou <tom.tsou@ettus.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdio.h>
+#include <iostream>
+#include <sstream>
+#include <chrono>
+#include <thread>
+
+#include "radio.h"
+#include "buffer.h"
+#include "record.h"
+#include "log.h"
+
+extern "C" {
+#include "slot.h"
+#include "sigproc/convert.h"
+}
+
+/* Samples per channel read from file on each reload */
+#define FILE_CHUNK_LEN		4096
+
+/* Poll interval while lossless readers hold back the buffer */
+#define FILE_WAIT_USEC		50
+
+typedef std::chrono::steady_clock file_clock;
+
+/*
+ * Replay of sc16 samples recorded at the native rate for the configured
+ * number of resource blocks, or an integer multiple of it for wideband
+ * recordings. Multiple channels are interleaved per sample:
+ * I0 Q0 I1 Q1 for a two channel recording.
+ *
+ * Replay speed is relative to real time. A speed of zero reads as fast as
+ * the receive chain consumes samples.
+ *
+ * Packed sc12 and bfp8 recordings are unpacked on reload, directly into the
+ * sample buffer for single channel recordings.
+ */
+class file_radio : public ring_radio {
+public:
+	file_radio(size_t chans, double rate, double speed,
+		   enum sample_format format);
+	~file_radio();
+
+	bool open(const std::string &path);
+
+	void reset();
+	int reload();
+
+	int64_t seek(int64_t ts, int64_t end);
+
+	std::string str_stats();
+	void reset_stats();
+
+private:
+	void log_stats();
+	void unpack(short *out, const uint8_t *in, size_t len);
+
+	FILE *file;
+	size_t chans;
+	enum sample_format format;
+
+	/* Bytes and samples per channel of the smallest readable unit */
+	size_t unit_len;
+	size_t unit_smpls;
+
+	double rate;
+	double speed;
+	int64_t ts;
+	int64_t end;
+	int64_t total;
+	bool started;
+	file_clock::time_point start;
+
+	std::vector<int16_t> pkt_buf;
+	std::vector<uint8_t> packed_buf;
+	std::vector<short *> wr_ptrs;
+};
+
+file_radio::file_radio(size_t chans, double rate, double speed,
+		       enum sample_format format)
+	: file(NULL), chans(chans), format(format), rate(rate), speed(speed),
+	  ts(0), end(0), total(0), started(false),
+	  pkt_buf(2 * chans * FILE_CHUNK_LEN),
+	  wr_ptrs(chans)
+{
+	switch (format) {
+	case FORMAT_SC12:
+		unit_len = 3 * chans;
+		unit_smpls = 1;
+		break;
+	case FORMAT_BFP8:
+		/* Other channel counts are rejected on open */
+		unit_len = CONVERT_BFP8_BLK;
+		unit_smpls = (CONVERT_BFP8_LEN / 2) % chans ? 1 :
+			     CONVERT_BFP8_LEN / 2 / chans;
+		break;
+	case FORMAT_SC8:
+		unit_len = 2 * chans;
+		unit_smpls = 1;
+		break;
+	default:
+		unit_len = 2 * chans * sizeof(int16_t);
+		unit_smpls = 1;
+	}
+
+	if (format != FORMAT_SC16)
+		packed_buf.resize(FILE_CHUNK_LEN / unit_smpls * unit_len);
+}
+
+file_radio::~file_radio()
+{
+	reset();
+}
+
+bool file_radio::open(const std::string &path)
+{
+	/* Blocks are unpacked as whole samples of every channel */
+	if ((format == FORMAT_BFP8) && ((CONVERT_BFP8_LEN / 2) % chans)) {
+		std::cerr << "** Block floating point replay requires a channel "
+			  << "count dividing " << CONVERT_BFP8_LEN / 2 << std::endl;
+		return false;
+	}
+
+	file = fopen(path.c_str(), "rb");
+	if (!file) {
+		std::cerr << "** Failed to open sample file " << path << std::endl;
+		return false;
+	}
+
+	ring = new ts_buffer(RADIO_RX_BUFLEN, chans);
+	if (!ring->init())
+		return false;
+
+	std::cout << "-- Replaying " << path << " at " << rate << " Hz";
+	if (format != FORMAT_SC16)
+		std::cout << ", " << sample_format_str(format);
+	std::cout << std::endl;
+
+	return true;
+}
+
+void file_radio::reset()
+{
+	if (file)
+		fclose(file);
+
+	delete ring;
+
+	ring = NULL;
+	file = NULL;
+}
+
+void file_radio::log_stats()
+{
+	std::ostringstream ost;
+
+	double elapsed = std::chrono::duration<double>(file_clock::now() -
+						       start).count();
+	double duration = (double) total / rate;
+
+	ost << "DEV   : End of file, replayed " << duration << " s"
+	    << " in " << elapsed << " s, real-time factor "
+	    << duration / elapsed;
+
+	LOG_DEV(ost.str().c_str());
+}
+
+void file_radio::unpack(short *out, const uint8_t *in, size_t len)
+{
+	switch (format) {
+	case FORMAT_SC12:
+		convert_sc12_short(out, in, len);
+		break;
+	case FORMAT_BFP8:
+		convert_bfp8_short(out, in, len);
+		break;
+	case FORMAT_SC8:
+		convert_sc8_short(out, (const int8_t *) in, len);
+		break;
+	default:
+		break;
+	}
+}
+
+int64_t file_radio::seek(int64_t ts, int64_t end)
+{
+	int64_t units = ts / unit_smpls;
+
+	if (started || (ts < 0) ||
+	    fseeko(file, units * unit_len, SEEK_SET) < 0)
+		return -1;
+
+	this->ts = units * unit_smpls;
+	this->end = end > this->ts ? end : 0;
+
+	return this->ts;
+}
+
+int file_radio::reload()
+{
+	if (!started) {
+		start = file_clock::now();
+		started = true;
+	}
+
+	/* Replay waits for lossless readers instead of dropping samples */
+	int rc;
+	while ((rc = ring->get_wr_buf(ts, FILE_CHUNK_LEN, wr_ptrs)) ==
+	       -ts_buffer::ERR_OVERFLOW) {
+		std::this_thread::sleep_for(std::chrono::microseconds(FILE_WAIT_USEC));
+	}
+
+	if (rc < 0) {
+		std::cerr << "Fatal buffer reload error" << std::endl;
+		return -1;
+	}
+
+	/* Single channel recordings are read straight into the buffer */
+	int16_t *buf = chans > 1 ? &pkt_buf.front() : wr_ptrs[0];
+	void *raw = format == FORMAT_SC16 ? (void *) buf : &packed_buf.front();
+
+	size_t num = FILE_CHUNK_LEN / unit_smpls;
+	if (end && (ts + (int64_t) (num * unit_smpls) > end))
+		num = (end - ts + unit_smpls - 1) / unit_smpls;
+
+	num = num ? fread(raw, unit_len, num, file) : 0;
+	if (!num) {
+		ring->commit_wr(wr_ptrs, 0);
+		log_stats();
+		return -1;
+	}
+
+	num *= unit_smpls;
+	unpack(buf, (const uint8_t *) raw, 2 * chans * num);
+
+	/* Deinterleave multichannel recordings */
+	for (size_t i = 0; (chans > 1) && (i < chans); i++) {
+		for (size_t n = 0; n < num; n++) {
+			wr_ptrs[i][2 * n + 0] = pkt_buf[2 * (chans * n + i) + 0];
+			wr_ptrs[i][2 * n + 1] = pkt_buf[2 * (chans * n + i) + 1];
+		}
+	}
+
+	if (ring->commit_wr(wr_ptrs, num) < 0) {
+		std::cerr << "Fatal buffer reload error" << std::endl;
+		return -1;
+	}
+
+	ts += num;
+	total += num;
+
+	/* Pace against the wall clock unless unthrottled */
+	if (speed > 0.0) {
+		std::chrono::duration<double> due(total / rate / speed);
+		std::this_thread::sleep_until(start +
+			std::chrono::duration_cast<file_clock::duration>(due));
+	}
+
+	return 0;
+}
+
+std::string file_radio::str_stats()
+{
+	std::ostringstream ost;
+
+	ost << "DEV   : Replayed " << total << " samples"
+	    << "\n                     Buffer " << ring->str_stats();
+
+	return ost.str();
+}
+
+void file_radio::reset_stats()
+{
+	ring->reset_stats();
+}
+
+radio_dev *file_radio_init(int64_t *ts, const std::string &path,
+			   size_t rbs, size_t chans, double speed,
+			   size_t oversamp, enum sample_format format)
+{
+	double rate = lte_subframe_len(rbs) * 1000.0 * oversamp;
+	if (rate <= 0.0) {
+		std::cerr << "** Invalid sample rate selection" << std::endl;
+		return NULL;
+	}
+
+	file_radio *dev = new file_radio(chans, rate, speed, format);
+	if (!dev->open(path)) {
+		delete dev;
+		return NULL;
+	}
+
+	/* Recordings carry no time information so count from zero */
+	*ts = 0;
+
+	return dev;
+}
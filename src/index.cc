@@ -0,0 +1,146 @@
+/*
+ * LTE Capture Sync Index
+ *
+ * Copyright (C) 2015 Ettus Research LLC
+ * Author Tom Tsou <tom.tsou@ettus.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <iostream>
+#include <sstream>
+#include <fstream>
+
+#include "index.h"
+#include "log.h"
+
+std::string sync_index_path(const std::string &path)
+{
+	return path + ".idx";
+}
+
+bool sync_index_read(const std::string &path,
+		     std::vector<sync_index_entry> &entries)
+{
+	std::ifstream file(path);
+	std::string line;
+
+	if (!file)
+		return false;
+
+	entries.clear();
+
+	while (std::getline(file, line)) {
+		if (line.empty() || (line[0] == '#'))
+			continue;
+
+		std::istringstream ist(line);
+		sync_index_entry entry;
+		long long ts;
+
+		if (!(ist >> ts >> entry.sfn >> entry.n_id_cell >> entry.rbs
+			  >> entry.ant >> entry.phich_dur >> entry.phich_ng)) {
+			std::cerr << "** Invalid index entry in " << path
+				  << ": " << line << std::endl;
+			return false;
+		}
+
+		entry.ts = ts;
+
+		if (!entries.empty() && (entry.ts <= entries.back().ts)) {
+			std::cerr << "** Unordered index entry in " << path
+				  << ": " << line << std::endl;
+			return false;
+		}
+
+		entries.push_back(entry);
+	}
+
+	return !entries.empty();
+}
+
+const sync_index_entry *sync_index_find(const std::vector<sync_index_entry> &entries,
+					int64_t ts)
+{
+	const sync_index_entry *entry = NULL;
+	size_t lo = 0, hi = entries.size();
+
+	/* Entries are ordered by timestamp */
+	while (lo < hi) {
+		size_t mid = (lo + hi) / 2;
+
+		if (entries[mid].ts <= ts) {
+			entry = &entries[mid];
+			lo = mid + 1;
+		} else {
+			hi = mid;
+		}
+	}
+
+	return entry;
+}
+
+sync_index::sync_index()
+	: file(NULL), count(0)
+{
+}
+
+sync_index::~sync_index()
+{
+	close();
+}
+
+bool sync_index::open(const std::string &path)
+{
+	file = fopen(path.c_str(), "w");
+	if (!file) {
+		std::cerr << "** Failed to open index " << path << std::endl;
+		return false;
+	}
+
+	this->path = path;
+	count = 0;
+
+	fprintf(file, "# ts sfn cell rbs ant phich_dur phich_ng\n");
+
+	std::cout << "-- Indexing sync state to " << path << std::endl;
+
+	return true;
+}
+
+void sync_index::close()
+{
+	if (!file)
+		return;
+
+	fclose(file);
+	file = NULL;
+
+	std::ostringstream ost;
+	ost << "DEV   : Indexed " << count << " frames to " << path;
+
+	LOG_DEV(ost.str().c_str());
+}
+
+void sync_index::push(const sync_index_entry &entry)
+{
+	if (!file)
+		return;
+
+	fprintf(file, "%lli %i %i %i %i %i %i\n",
+		(long long) entry.ts, entry.sfn, entry.n_id_cell, entry.rbs,
+		entry.ant, entry.phich_dur, entry.phich_ng);
+
+	count++;
+}
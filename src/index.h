@@ -0,0 +1,60 @@
+#ifndef _LTE_INDEX_H_
+#define _LTE_INDEX_H_
+
+#include <stdio.h>
+#include <stdint.h>
+#include <vector>
+#include <string>
+
+/*
+ * Sync state at the start of a frame
+ *
+ * The timestamp is the sample offset of subframe 0 in the capture with the
+ * timing corrections applied up to that frame. Replay timing is the only
+ * offset indexed: captures are indexed from file replay, which has no
+ * frequency control, so a resumed decode corrects frequency as it tracks.
+ */
+struct sync_index_entry {
+	int64_t ts;
+	int sfn;
+	int n_id_cell;
+	int rbs;
+	int ant;
+	int phich_dur;
+	int phich_ng;
+};
+
+/* Index file stored alongside the capture */
+std::string sync_index_path(const std::string &path);
+
+/* Entries in capture order, false if the index is missing or invalid */
+bool sync_index_read(const std::string &path,
+		     std::vector<sync_index_entry> &entries);
+
+/* Last entry at or before a timestamp, or NULL if there is none */
+const sync_index_entry *sync_index_find(const std::vector<sync_index_entry> &entries,
+					int64_t ts);
+
+/*
+ * Sync index writer
+ *
+ * Entries are appended as text, one frame per line, from the sync thread.
+ * Writes are buffered and small compared to the sample stream.
+ */
+class sync_index {
+public:
+	sync_index();
+	~sync_index();
+
+	bool open(const std::string &path);
+	void close();
+
+	void push(const sync_index_entry &entry);
+
+private:
+	FILE *file;
+	std::string path;
+	uint64_t count;
+};
+
+#endif /* _LTE_INDEX_H_ */
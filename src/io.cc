@@ -23,9 +23,17 @@
 #include <stdlib.h>
 #include <string.h>
 #include <iostream>
+#include <atomic>
+#include <mutex>
+#include <sys/stat.h>
 
 #include "openphy/io.h"
-#include "uhd.h"
+#include "radio.h"
+#include "record.h"
+#include "capture.h"
+#include "index.h"
+#include "channelizer.h"
+#include "net.h"
 #include "log.h"
 
 extern "C" {
@@ -35,23 +43,53 @@ extern "C" {
 #define LTE_SLOT_LEN            15360
 #define LTE_SYM_LEN             2048
 
-static struct uhd_dev *dev = NULL;
+static radio_dev *dev = NULL;
+static sample_recorder *rec = NULL;
+static event_capture *cap = NULL;
+static sync_index *idx = NULL;
+
+/*
+ * Guards the recorder, capture and index, which may be stopped by a
+ * shutdown thread while decoding threads trigger captures or index frames
+ */
+static std::mutex output_mutex;
+static channelizer *chan = NULL;
 static int64_t subframe0_ts = 0;
 static int prev_subframe = -1;
 
 static int pss_adj = 0;
 static int subframe_len = 0;
 static int frame_len = 0;
+static int iface_rbs = 0;
+static int iface_chans = 0;
+
+/* Samples received before the last retune carry the previous offset */
+static std::atomic<int64_t> retune_ts(0);
+
+/* Gaps reported with the last subframe and end of the latest gap */
+static struct lte_gap read_gap;
+static int64_t gap_end = 0;
 
 void lte_radio_iface_reset()
 {
-	uhd_reset(dev);
+	lte_record_stop();
+	lte_capture_stop();
+	lte_index_stop();
+
+	dev->reset();
+	delete dev;
+	dev = NULL;
 
 	subframe0_ts = 0;
 	prev_subframe = -1;
 	pss_adj = 0;
 	subframe_len = 0;
 	frame_len = 0;
+	iface_rbs = 0;
+	iface_chans = 0;
+	retune_ts.store(0);
+	read_gap = lte_gap();
+	gap_end = 0;
 }
 
 /*
@@ -131,15 +169,8 @@ TIMING_OFFSET_FUNC(6,22,16)
 
 int (*fine_timing_offset)(int coarse, int fine) = NULL;
 
-int lte_radio_iface_init(double freq, int chans, double gain,
-			 int rbs, int ref, const std::string &args)
+static int iface_init_common(int rbs, int chans)
 {
-	dev = uhd_init(&subframe0_ts, freq, args, rbs, chans, gain, ref);
-	if (!dev) {
-		fprintf(stderr, "UHD failed to init\n");
-		return -1;
-	}
-
 	int base_q = get_decim(rbs);
 	if (use_fft_1536(rbs))
 		pss_adj = 32 * 3 / 4 / base_q;
@@ -148,6 +179,8 @@ int lte_radio_iface_init(double freq, int chans, double gain,
 
 	subframe_len = lte_subframe_len(rbs);
 	frame_len = lte_frame_len(rbs);
+	iface_rbs = rbs;
+	iface_chans = chans;
 
 	subframe0_ts += subframe_len;
 
@@ -180,6 +213,302 @@ int lte_radio_iface_init(double freq, int chans, double gain,
 	return 0;
 }
 
+int lte_radio_iface_init(double freq, int chans, double gain,
+			 int rbs, int ref, const std::string &args,
+			 enum sample_format wire)
+{
+	dev = uhd_radio_init(&subframe0_ts, freq, args, rbs,
+			     chans, gain, ref, 1, wire);
+	if (!dev) {
+		fprintf(stderr, "UHD failed to init\n");
+		return -1;
+	}
+
+	return iface_init_common(rbs, chans);
+}
+
+/*
+ * Regular files are mapped and read in place. Pipes and other streams fall
+ * back to buffered reads, as do packed recordings, which are unpacked into
+ * the sample buffer. Network addresses receive a live stream.
+ */
+static radio_dev *capture_init(int64_t *ts, const std::string &path,
+			       int rbs, int chans, double speed,
+			       size_t oversamp = 1)
+{
+	struct stat st;
+
+	if (net_is_url(path))
+		return net_radio_init(ts, path, rbs, chans, oversamp);
+
+	enum sample_format format = record_read_format(path);
+
+	if ((format == FORMAT_SC16) &&
+	    !stat(path.c_str(), &st) && S_ISREG(st.st_mode))
+		return mmap_radio_init(ts, path, rbs, chans, speed, oversamp);
+
+	return file_radio_init(ts, path, rbs, chans, speed, oversamp, format);
+}
+
+int lte_file_iface_init(const std::string &path, int chans,
+			int rbs, double speed)
+{
+	dev = capture_init(&subframe0_ts, path, rbs, chans, speed);
+	if (!dev) {
+		fprintf(stderr, "File failed to init\n");
+		return -1;
+	}
+
+	return iface_init_common(rbs, chans);
+}
+
+/*
+ * Limit replay to a sample range of the capture. Subframe reads restart at
+ * the first sample of the range.
+ */
+int lte_file_iface_seek(int64_t start, int64_t end)
+{
+	if (!dev || (prev_subframe >= 0))
+		return -1;
+
+	int64_t ts = dev->seek(start, end);
+	if (ts < 0) {
+		fprintf(stderr, "IO : Source does not support seeking\n");
+		return -1;
+	}
+
+	subframe0_ts = ts;
+
+	return 0;
+}
+
+/*
+ * Record the contiguous receive stream from the current head onward,
+ * including samples the decoder never pulls. The recorder reads the stream
+ * and writes to disk on its own threads, so the subframe reader is never
+ * blocked.
+ */
+int lte_record_start(const std::string &path, double freq, double gain,
+		     enum sample_format format)
+{
+	std::lock_guard<std::mutex> guard(output_mutex);
+
+	if (!dev || rec) {
+		fprintf(stderr, "IO : Recording requires an idle interface\n");
+		return -1;
+	}
+
+	record_meta meta;
+	meta.rate = subframe_len * 1000.0;
+	meta.freq = freq;
+	meta.gain = gain;
+	meta.rbs = iface_rbs;
+	meta.chans = iface_chans;
+	meta.format = format;
+
+	rec = new sample_recorder(meta);
+	if (!rec->open(path) || !rec->follow(dev)) {
+		delete rec;
+		rec = NULL;
+		return -1;
+	}
+
+	std::cout << "-- Recording " << sample_format_str(format)
+		  << " to " << path
+		  << (rec->direct_io() ? " (direct I/O)" : "") << std::endl;
+
+	return 0;
+}
+
+void lte_record_stop()
+{
+	std::lock_guard<std::mutex> guard(output_mutex);
+
+	delete rec;
+	rec = NULL;
+}
+
+int lte_index_start(const std::string &path)
+{
+	std::lock_guard<std::mutex> guard(output_mutex);
+
+	if (!dev || idx) {
+		fprintf(stderr, "IO : Indexing requires an idle interface\n");
+		return -1;
+	}
+
+	idx = new sync_index();
+	if (!idx->open(path)) {
+		delete idx;
+		idx = NULL;
+		return -1;
+	}
+
+	return 0;
+}
+
+void lte_index_stop()
+{
+	std::lock_guard<std::mutex> guard(output_mutex);
+
+	delete idx;
+	idx = NULL;
+}
+
+/* Index the sync state at the most recently read subframe */
+void lte_index_push(int sfn, int n_id_cell, int ant,
+		    int phich_dur, int phich_ng)
+{
+	std::lock_guard<std::mutex> guard(output_mutex);
+
+	if (!idx || (prev_subframe < 0))
+		return;
+
+	sync_index_entry entry;
+	entry.ts = subframe0_ts + prev_subframe * subframe_len;
+	entry.sfn = sfn;
+	entry.n_id_cell = n_id_cell;
+	entry.rbs = iface_rbs;
+	entry.ant = ant;
+	entry.phich_dur = phich_dur;
+	entry.phich_ng = phich_ng;
+
+	idx->push(entry);
+}
+
+/*
+ * Capture windows are copied out of the receive interface history by a
+ * background thread, so triggers cost nothing on the subframe reader.
+ */
+int lte_capture_start(const std::string &prefix, double freq, double gain,
+		      enum sample_format format, unsigned events,
+		      int pre_ms, int post_ms)
+{
+	std::lock_guard<std::mutex> guard(output_mutex);
+
+	if (!dev || cap) {
+		fprintf(stderr, "IO : Capture requires an idle interface\n");
+		return -1;
+	}
+
+	record_meta meta;
+	meta.rate = subframe_len * 1000.0;
+	meta.freq = freq;
+	meta.gain = gain;
+	meta.rbs = iface_rbs;
+	meta.chans = iface_chans;
+	meta.format = format;
+
+	cap = new event_capture(dev, meta, prefix, events,
+				(int64_t) pre_ms * subframe_len,
+				(int64_t) post_ms * subframe_len);
+	if (!cap->start()) {
+		delete cap;
+		cap = NULL;
+		return -1;
+	}
+
+	return 0;
+}
+
+void lte_capture_stop()
+{
+	std::lock_guard<std::mutex> guard(output_mutex);
+
+	delete cap;
+	cap = NULL;
+}
+
+void lte_capture_trigger(enum capture_event event, int64_t ts)
+{
+	std::lock_guard<std::mutex> guard(output_mutex);
+
+	if (cap)
+		cap->trigger(event, ts);
+}
+
+/*
+ * Wideband channelized operation
+ *
+ * The channelizer is created before carrier processes are forked. Each
+ * carrier process selects its carrier stream as the receive device while
+ * the parent process opens the wideband source and runs the channelizer.
+ */
+int lte_chan_iface_init(const std::vector<double> &offsets,
+			int chans, int rbs)
+{
+	double rate = lte_subframe_len(rbs) * 1000.0;
+	size_t decim = channelizer::get_decim(rate, offsets);
+
+	chan = new channelizer(rate * decim, decim, chans, offsets);
+	if (!chan->init()) {
+		fprintf(stderr, "Channelizer failed to init\n");
+		delete chan;
+		chan = NULL;
+		return -1;
+	}
+
+	return decim;
+}
+
+int lte_chan_iface_select(int carrier, int chans, int rbs)
+{
+	if (!chan)
+		return -1;
+
+	dev = chan->carrier(carrier, &subframe0_ts);
+	if (!dev) {
+		fprintf(stderr, "Carrier %i failed to init\n", carrier);
+		return -1;
+	}
+
+	return iface_init_common(rbs, chans);
+}
+
+static int chan_iface_run(radio_dev *src, int64_t ts)
+{
+	/* Wideband source telemetry is reported from the parent process */
+	dev = src;
+
+	int rc = chan->run(src, ts);
+
+	dev = NULL;
+	src->reset();
+	delete src;
+
+	return rc;
+}
+
+int lte_chan_iface_run(double freq, int chans, double gain,
+		       int rbs, int ref, const std::string &args, int decim,
+		       enum sample_format wire)
+{
+	int64_t ts;
+
+	radio_dev *src = uhd_radio_init(&ts, freq, args, rbs,
+					chans, gain, ref, decim, wire);
+	if (!src) {
+		fprintf(stderr, "UHD failed to init\n");
+		return -1;
+	}
+
+	return chan_iface_run(src, ts);
+}
+
+int lte_chan_file_run(const std::string &path, int chans,
+		      int rbs, double speed, int decim)
+{
+	int64_t ts;
+
+	radio_dev *src = capture_init(&ts, path, rbs, chans, speed, decim);
+	if (!src) {
+		fprintf(stderr, "File failed to init\n");
+		return -1;
+	}
+
+	return chan_iface_run(src, ts);
+}
+
 static int comp_timing_offset(int coarse, int fine, int state)
 {
 	int adjust = 0;
@@ -203,11 +532,46 @@ static int comp_timing_offset(int coarse, int fine, int state)
 	return adjust;
 }
 
+/*
+ * Skip whole frames after a failed read until the subframe falls within
+ * the last frame received. Returns the number of frames skipped.
+ */
+static int skip_frames(int64_t ts)
+{
+	int64_t head = dev->get_ts_high() - subframe_len;
+	if (head < ts + frame_len)
+		return 0;
+
+	return (head - ts) / frame_len;
+}
+
+/* Collect gaps reported by the source up to the end of a subframe */
+static void check_gaps(int64_t ts)
+{
+	int64_t gap_ts, gap_len;
+
+	while (dev->get_gap(ts + subframe_len, &gap_ts, &gap_len)) {
+		read_gap.len += (gap_len + subframe_len - 1) / subframe_len;
+
+		if (gap_ts + gap_len > gap_end)
+			gap_end = gap_ts + gap_len;
+
+		char sbuf[80];
+		snprintf(sbuf, 80, "DEV   : Receive gap of %lli samples at %lli",
+			 (long long) gap_len, (long long) gap_ts);
+		LOG_ERR(sbuf);
+	}
+
+	read_gap.overlap = ts < gap_end;
+}
+
 int lte_read_subframe(std::vector<short *> &bufs,
 		      int sf, int coarse, int fine, int state)
 {
 	int64_t ts;
 
+	read_gap = lte_gap();
+
 	if (sf <= prev_subframe)
 		subframe0_ts += frame_len;
 
@@ -216,24 +580,95 @@ int lte_read_subframe(std::vector<short *> &bufs,
 
 	ts = subframe0_ts + sf * subframe_len;
 
-	while (ts + subframe_len > uhd_get_ts_high(dev))
-		uhd_reload(dev);
+	while (ts + subframe_len > dev->get_ts_high()) {
+		if (dev->reload() < 0)
+			return LTE_IO_EOF;
+	}
 
-	if (uhd_pull(dev, bufs, subframe_len, ts) < 0) {
-		fprintf(stderr, "Failed to pull subframe data\n");
-		std::cout << ts << ", " << subframe0_ts << ", " << sf << std::endl;
-		exit(1);
-		return -1;
+	if (dev->pull(bufs, subframe_len, ts) < 0) {
+		int frames = skip_frames(ts);
+
+		if (frames) {
+			subframe0_ts += frames * frame_len;
+			ts += frames * frame_len;
+
+			read_gap.frames = frames;
+			read_gap.len = frames * 10;
+
+			char sbuf[80];
+			snprintf(sbuf, 80, "DEV   : Receive overrun, "
+				 "skipped %i frames", frames);
+			LOG_ERR(sbuf);
+		}
+
+		if (!frames || (dev->pull(bufs, subframe_len, ts) < 0)) {
+			fprintf(stderr, "Failed to pull subframe data\n");
+			std::cout << ts << ", " << subframe0_ts << ", "
+				  << sf << std::endl;
+			return LTE_IO_EOF;
+		}
 	}
 
+	check_gaps(ts);
+
 	prev_subframe = sf;
 
 	return offset;
 }
 
+std::string lte_iface_stats()
+{
+	if (!dev)
+		return "DEV   : No receive interface";
+
+	return dev->str_stats();
+}
+
+void lte_iface_reset_stats()
+{
+	if (dev)
+		dev->reset_stats();
+}
+
 int lte_commit_subframe(std::vector<short *> &bufs)
 {
-	return uhd_commit(dev, bufs);
+	return dev->commit(bufs);
+}
+
+/*
+ * Number of whole subframes preceding the most recently read subframe that
+ * are still held by the receive interface and were received with the
+ * current tuning
+ */
+int lte_lookback_avail()
+{
+	if (!dev || (prev_subframe < 0))
+		return 0;
+
+	int64_t ts = subframe0_ts + prev_subframe * subframe_len;
+	int64_t start = dev->get_ts_history();
+
+	if (start < retune_ts.load())
+		start = retune_ts.load();
+	if (ts <= start)
+		return 0;
+
+	return (ts - start) / subframe_len;
+}
+
+/*
+ * Copy the subframe received a number of subframes before the most recently
+ * read subframe into caller buffers. Subframe boundaries follow the current
+ * timing alignment. The sample offset shifts the window.
+ */
+int lte_lookback_subframe(std::vector<short *> &bufs, int back, int offset)
+{
+	if (!dev || (prev_subframe < 0) || (back < 0))
+		return -1;
+
+	int64_t ts = subframe0_ts + (prev_subframe - back) * subframe_len + offset;
+
+	return dev->lookback(bufs, subframe_len, ts);
 }
 
 int lte_write_subframe(int16_t *buf, int len, int dec, int zero)
@@ -241,12 +676,37 @@ int lte_write_subframe(int16_t *buf, int len, int dec, int zero)
 	return 0;
 }
 
+/* Timestamp of the most recently read subframe */
+int64_t lte_subframe_ts()
+{
+	if (prev_subframe < 0)
+		return -1;
+
+	return subframe0_ts + prev_subframe * subframe_len;
+}
+
+void lte_subframe_gap(struct lte_gap *gap)
+{
+	*gap = read_gap;
+}
+
+/*
+ * Samples received before a retune are not offered for lookback. Sources
+ * without frequency control ignore corrections, so their history stays
+ * available.
+ */
 int lte_offset_freq(double offset)
 {
-	return uhd_shift(dev, offset);
+	if (dev->tunable())
+		retune_ts.store(dev->get_ts_high());
+
+	return dev->shift(offset);
 }
 
 int lte_offset_reset()
 {
-	return uhd_freq_reset(dev);
+	if (dev->tunable())
+		retune_ts.store(dev->get_ts_high());
+
+	return dev->freq_reset();
 }
@@ -0,0 +1,357 @@
+/*
+ * LTE Memory Mapped Capture Device
+ *
+ * Copyright (C) 2015 Ettus Research LLC
+ * Author Tom Tsou <tom.tsou@ettus.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <iostream>
+#include <sstream>
+#include <chrono>
+#include <thread>
+
+#include "radio.h"
+#include "log.h"
+
+extern "C" {
+#include "slot.h"
+}
+
+/* Samples per channel exposed on each reload */
+#define MMAP_CHUNK_LEN		(1 << 16)
+
+/* Readahead ahead of the exposed samples and release lag behind reads */
+#define MMAP_READAHEAD		(16 << 20)
+#define MMAP_RELEASE_LAG	(16 << 20)
+
+typedef std::chrono::steady_clock mmap_clock;
+
+/*
+ * Memory mapped capture replay
+ *
+ * Single channel captures are read in place, so subframe windows point
+ * directly into the mapping. Multichannel captures are interleaved per
+ * sample and deinterleaved into per-channel windows on pull.
+ *
+ * Kernel readahead is requested for the region ahead of the exposed
+ * samples, and pages well behind the read position are released so that
+ * large captures do not accumulate in the process mapping.
+ */
+class mmap_radio : public radio_dev {
+public:
+	mmap_radio(size_t chans, double rate, double speed);
+	~mmap_radio();
+
+	bool open(const std::string &path);
+
+	void reset();
+	int reload();
+
+	int pull(std::vector<short *> &bufs, size_t len, int64_t ts);
+	int commit(std::vector<short *> &bufs);
+
+	int lookback(std::vector<short *> &bufs, size_t len, int64_t ts);
+
+	int64_t get_ts_high() { return head; }
+	int64_t get_ts_low() { return tail; }
+
+	/* The entire capture remains mapped */
+	int64_t get_ts_history() { return first; }
+
+	int64_t seek(int64_t ts, int64_t end);
+
+	std::string str_stats();
+	void reset_stats() { pulls = 0; }
+
+private:
+	void advise(int64_t start, int64_t end, int advice);
+	void deinterleave(std::vector<short *> &bufs, size_t len, int64_t ts);
+	void log_stats();
+
+	int16_t *data;
+	size_t map_len;
+	size_t chans;
+	double rate;
+	double speed;
+
+	int64_t total;
+	int64_t first;
+	int64_t head;
+	int64_t tail;
+	int64_t released;
+	bool started;
+	mmap_clock::time_point start;
+
+	/* Outstanding read window */
+	std::vector<short *> rd_tags;
+	int64_t rd_end;
+	uint64_t pulls;
+
+	std::vector<std::vector<int16_t> > chan_bufs;
+};
+
+mmap_radio::mmap_radio(size_t chans, double rate, double speed)
+	: data(NULL), map_len(0), chans(chans), rate(rate), speed(speed),
+	  total(0), first(0), head(0), tail(0), released(0), started(false),
+	  rd_end(0), pulls(0), chan_bufs(chans)
+{
+}
+
+mmap_radio::~mmap_radio()
+{
+	reset();
+}
+
+bool mmap_radio::open(const std::string &path)
+{
+	struct stat st;
+
+	int fd = ::open(path.c_str(), O_RDONLY);
+	if (fd < 0) {
+		std::cerr << "** Failed to open sample file " << path << std::endl;
+		return false;
+	}
+
+	size_t frame = 2 * sizeof(int16_t) * chans;
+
+	if ((fstat(fd, &st) < 0) || ((size_t) st.st_size < frame)) {
+		std::cerr << "** Invalid sample file " << path << std::endl;
+		::close(fd);
+		return false;
+	}
+
+	/*
+	 * Pulled buffers are handed out writable, and decoding may modify
+	 * them in place. A private mapping copies touched pages on write, so
+	 * the file is never modified and untouched pages stay shared with
+	 * the page cache.
+	 */
+	map_len = st.st_size;
+	data = (int16_t *) mmap(NULL, map_len, PROT_READ | PROT_WRITE,
+				MAP_PRIVATE, fd, 0);
+	::close(fd);
+
+	if (data == MAP_FAILED) {
+		std::cerr << "** Failed to map sample file " << path << std::endl;
+		data = NULL;
+		return false;
+	}
+
+	madvise(data, map_len, MADV_SEQUENTIAL);
+
+	total = map_len / frame;
+
+	std::cout << "-- Mapping " << path << " at " << rate << " Hz, "
+		  << total << " samples" << std::endl;
+
+	return true;
+}
+
+void mmap_radio::reset()
+{
+	if (data)
+		munmap(data, map_len);
+
+	data = NULL;
+	map_len = 0;
+}
+
+/* Apply advice to the page aligned byte range of a sample range */
+void mmap_radio::advise(int64_t start, int64_t end, int advice)
+{
+	size_t frame = 2 * sizeof(int16_t) * chans;
+	size_t page = sysconf(_SC_PAGESIZE);
+
+	size_t lo = start * frame / page * page;
+	size_t hi = end * frame;
+
+	if (hi > map_len)
+		hi = map_len;
+	if (lo >= hi)
+		return;
+
+	madvise((char *) data + lo, hi - lo, advice);
+}
+
+void mmap_radio::log_stats()
+{
+	std::ostringstream ost;
+
+	double elapsed = std::chrono::duration<double>(mmap_clock::now() -
+						       start).count();
+	double duration = (double) (total - first) / rate;
+
+	ost << "DEV   : End of file, replayed " << duration << " s"
+	    << " in " << elapsed << " s, real-time factor "
+	    << duration / elapsed;
+
+	LOG_DEV(ost.str().c_str());
+}
+
+int mmap_radio::reload()
+{
+	if (!started) {
+		start = mmap_clock::now();
+		started = true;
+	}
+
+	if (head >= total) {
+		log_stats();
+		return -1;
+	}
+
+	head += MMAP_CHUNK_LEN;
+	if (head > total)
+		head = total;
+
+	size_t frame = 2 * sizeof(int16_t) * chans;
+	advise(head, head + MMAP_READAHEAD / frame, MADV_WILLNEED);
+
+	int64_t lag = MMAP_RELEASE_LAG / frame;
+	if (tail - lag > released + lag) {
+		advise(released, tail - lag, MADV_DONTNEED);
+		released = tail - lag;
+	}
+
+	/* Pace against the wall clock unless unthrottled */
+	if (speed > 0.0) {
+		std::chrono::duration<double> due((head - first) / rate / speed);
+		std::this_thread::sleep_until(start +
+			std::chrono::duration_cast<mmap_clock::duration>(due));
+	}
+
+	return 0;
+}
+
+int64_t mmap_radio::seek(int64_t ts, int64_t end)
+{
+	if (started || (ts < 0) || (ts >= total))
+		return -1;
+
+	if ((end > ts) && (end < total))
+		total = end;
+
+	first = head = tail = released = ts;
+
+	return ts;
+}
+
+/* Split interleaved channels into per-channel buffers */
+void mmap_radio::deinterleave(std::vector<short *> &bufs,
+			      size_t len, int64_t ts)
+{
+	const int16_t *in = data + 2 * chans * ts;
+
+	for (size_t i = 0; i < chans; i++) {
+		for (size_t n = 0; n < len; n++) {
+			bufs[i][2 * n + 0] = in[2 * (chans * n + i) + 0];
+			bufs[i][2 * n + 1] = in[2 * (chans * n + i) + 1];
+		}
+	}
+}
+
+int mmap_radio::pull(std::vector<short *> &bufs, size_t len, int64_t ts)
+{
+	if (bufs.size() != chans) {
+		std::cerr << "MMAP: Invalid buffer " << bufs.size() << std::endl;
+		return -1;
+	}
+
+	if (!rd_tags.empty() || (ts < 0) || (ts + (int64_t) len > head)) {
+		std::cerr << "Fatal buffer pull error " << ts << std::endl;
+		return -1;
+	}
+
+	const int16_t *in = data + 2 * chans * ts;
+
+	if (chans == 1) {
+		bufs[0] = (short *) in;
+	} else {
+		for (size_t i = 0; i < chans; i++) {
+			chan_bufs[i].resize(2 * len);
+			bufs[i] = &chan_bufs[i].front();
+		}
+
+		deinterleave(bufs, len, ts);
+	}
+
+	rd_tags = bufs;
+	rd_end = ts + len;
+	pulls++;
+
+	return len;
+}
+
+int mmap_radio::lookback(std::vector<short *> &bufs, size_t len, int64_t ts)
+{
+	if ((bufs.size() != chans) || (ts < 0) || (ts + (int64_t) len > head))
+		return -1;
+
+	deinterleave(bufs, len, ts);
+
+	return len;
+}
+
+int mmap_radio::commit(std::vector<short *> &bufs)
+{
+	if (bufs != rd_tags) {
+		std::cerr << "Fatal commit error" << std::endl;
+		return -1;
+	}
+
+	rd_tags.clear();
+	tail = rd_end;
+
+	return 0;
+}
+
+std::string mmap_radio::str_stats()
+{
+	std::ostringstream ost;
+
+	ost << "DEV   : Mapped " << total << " samples"
+	    << ", position " << tail
+	    << ", pulls " << pulls
+	    << ", zero-copy " << (chans == 1 ? "yes" : "no");
+
+	return ost.str();
+}
+
+radio_dev *mmap_radio_init(int64_t *ts, const std::string &path,
+			   size_t rbs, size_t chans, double speed,
+			   size_t oversamp)
+{
+	double rate = lte_subframe_len(rbs) * 1000.0 * oversamp;
+	if (rate <= 0.0) {
+		std::cerr << "** Invalid sample rate selection" << std::endl;
+		return NULL;
+	}
+
+	mmap_radio *dev = new mmap_radio(chans, rate, speed);
+	if (!dev->open(path)) {
+		delete dev;
+		return NULL;
+	}
+
+	/* Recordings carry no time information so count from zero */
+	*ts = 0;
+
+	return dev;
+}
@@ -0,0 +1,504 @@
+/*
+ * LTE Network IQ Receive Device
+ *
+ * Copyright (C) 2015 Ettus Research LLC
+ * Author Tom Tsou <tom.tsou@ettus.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <poll.h>
+#include <sys/time.h>
+#include <iostream>
+#include <sstream>
+#include <thread>
+#include <atomic>
+
+#include "radio.h"
+#include "buffer.h"
+#include "net.h"
+#include "log.h"
+
+extern "C" {
+#include "slot.h"
+}
+
+/* Datagrams received per recvmmsg() call */
+#define NET_BATCH_PKTS		64
+
+/* Socket receive buffer covering roughly 100 ms at 2 x 23.04 Msps */
+#define NET_SOCK_BUFLEN		(16 << 20)
+
+/* Receive timeout so that the receive thread can check for shutdown */
+#define NET_TIMEOUT_USEC	100000
+
+/* Wait for a stream connection before giving up */
+#define NET_ACCEPT_MSEC		60000
+
+/* Receive thread check interval while waiting on the buffer head */
+#define NET_WAIT_USEC		10000
+
+/* Timestamp gaps longer than this are counted as jumps */
+#define NET_FILL_MAX		(RADIO_RX_BUFLEN / 4)
+
+/*
+ * Receive telemetry
+ *
+ * Lost packets are inferred from the sequence count. Late packets arrived
+ * with a timestamp behind the write head and were dropped. Timestamp gaps
+ * are zero filled by the sample buffer, up to the buffer length.
+ */
+struct net_stats {
+	std::atomic<uint64_t> packets;
+	std::atomic<uint64_t> samples;
+	std::atomic<uint64_t> lost;
+	std::atomic<uint64_t> late;
+	std::atomic<uint64_t> invalid;
+	std::atomic<uint64_t> filled;
+	std::atomic<uint64_t> jumps;
+	std::atomic<uint64_t> buf_overflows;
+	std::atomic<uint64_t> batch_max;
+};
+
+static void stat_inc(std::atomic<uint64_t> &stat, uint64_t val = 1)
+{
+	stat.fetch_add(val, std::memory_order_relaxed);
+}
+
+/*
+ * Network sample source
+ *
+ * Listens for a stream in the wire format of net.h over UDP, or accepts a
+ * single TCP connection. A receive thread writes packet payloads into the
+ * sample buffer by timestamp. UDP datagrams are received in batches with
+ * recvmmsg() to keep the per packet system call cost down at high rates.
+ */
+class net_radio : public ring_radio {
+public:
+	net_radio(size_t chans, double rate);
+	~net_radio();
+
+	bool open(const std::string &url);
+	bool start(int64_t *ts);
+
+	void reset();
+	int reload();
+
+	std::string str_stats();
+	void reset_stats();
+
+private:
+	void rx_loop();
+	int recv_udp();
+	int recv_tcp();
+	bool recv_full(char *buf, size_t len);
+	int handle_pkt(const char *buf, size_t len);
+
+	int fd;
+	enum net_proto proto;
+	struct sockaddr_in addr;
+	size_t chans;
+	double rate;
+
+	int64_t rx_ts;
+	uint32_t rx_seq;
+	bool synced;
+
+	std::thread rx_thread;
+	std::atomic<bool> rx_running;
+
+	std::vector<std::vector<char> > pkt_bufs;
+	std::vector<struct iovec> iovs;
+	std::vector<struct mmsghdr> msgs;
+	std::vector<short *> wr_ptrs;
+
+	struct net_stats stats;
+};
+
+net_radio::net_radio(size_t chans, double rate)
+	: fd(-1), chans(chans), rate(rate), rx_ts(0), rx_seq(0),
+	  synced(false), rx_running(false),
+	  pkt_bufs(NET_BATCH_PKTS, std::vector<char>(NET_IQ_PKT_MAX)),
+	  iovs(NET_BATCH_PKTS), msgs(NET_BATCH_PKTS),
+	  wr_ptrs(chans)
+{
+	reset_stats();
+
+	for (int i = 0; i < NET_BATCH_PKTS; i++) {
+		iovs[i].iov_base = &pkt_bufs[i].front();
+		iovs[i].iov_len = NET_IQ_PKT_MAX;
+
+		memset(&msgs[i], 0, sizeof(msgs[i]));
+		msgs[i].msg_hdr.msg_iov = &iovs[i];
+		msgs[i].msg_hdr.msg_iovlen = 1;
+	}
+}
+
+net_radio::~net_radio()
+{
+	reset();
+}
+
+bool net_radio::open(const std::string &url)
+{
+	if (!net_parse_url(url, &proto, &addr)) {
+		std::cerr << "** Invalid stream address " << url << std::endl;
+		return false;
+	}
+
+	int sock = socket(AF_INET, proto == NET_PROTO_UDP ?
+			  SOCK_DGRAM : SOCK_STREAM, 0);
+	if (sock < 0) {
+		std::cerr << "** Failed to create socket" << std::endl;
+		return false;
+	}
+
+	int on = 1;
+	setsockopt(sock, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+
+	int len = net_set_bufsize(sock, SO_RCVBUF, NET_SOCK_BUFLEN);
+	if (len < NET_SOCK_BUFLEN) {
+		std::cout << "-- Socket receive buffer limited to " << len
+			  << " bytes, raise net.core.rmem_max" << std::endl;
+	}
+
+	if (bind(sock, (struct sockaddr *) &addr, sizeof(addr)) < 0) {
+		std::cerr << "** Failed to bind " << url << ": "
+			  << strerror(errno) << std::endl;
+		close(sock);
+		return false;
+	}
+
+	if (proto == NET_PROTO_UDP) {
+		fd = sock;
+	} else {
+		std::cout << "-- Waiting for connection on " << url << std::endl;
+
+		if (listen(sock, 1) < 0) {
+			close(sock);
+			return false;
+		}
+
+		struct pollfd pfd = { sock, POLLIN, 0 };
+		int rc = poll(&pfd, 1, NET_ACCEPT_MSEC);
+		if (rc <= 0) {
+			std::cerr << "** No connection on " << url << " within "
+				  << NET_ACCEPT_MSEC / 1000 << " s" << std::endl;
+			close(sock);
+			return false;
+		}
+
+		fd = accept(sock, NULL, NULL);
+		close(sock);
+
+		if (fd < 0) {
+			std::cerr << "** Failed to accept connection" << std::endl;
+			return false;
+		}
+
+		net_set_bufsize(fd, SO_RCVBUF, NET_SOCK_BUFLEN);
+	}
+
+	struct timeval tv = { 0, NET_TIMEOUT_USEC };
+	setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+
+	ring = new ts_buffer(RADIO_RX_BUFLEN, chans);
+	if (!ring->init())
+		return false;
+
+	std::cout << "-- Receiving stream on " << url
+		  << " at " << rate << " Hz" << std::endl;
+
+	return true;
+}
+
+/* Launch the receive thread and block until the first samples arrive */
+bool net_radio::start(int64_t *ts)
+{
+	rx_running.store(true);
+	rx_thread = std::thread(&net_radio::rx_loop, this);
+
+	while (!ring->wait_wr(0, NET_WAIT_USEC)) {
+		if (!rx_running.load())
+			return false;
+	}
+
+	*ts = ring->get_first_time();
+
+	return true;
+}
+
+void net_radio::reset()
+{
+	if (rx_thread.joinable()) {
+		rx_running.store(false);
+		rx_thread.join();
+	}
+
+	if (fd >= 0)
+		close(fd);
+
+	delete ring;
+
+	ring = NULL;
+	fd = -1;
+}
+
+void net_radio::rx_loop()
+{
+	while (rx_running.load()) {
+		int rc = proto == NET_PROTO_UDP ? recv_udp() : recv_tcp();
+		if (rc < 0)
+			break;
+	}
+
+	rx_running.store(false);
+}
+
+/* Receive a batch of datagrams, waiting only for the first */
+int net_radio::recv_udp()
+{
+	int num = recvmmsg(fd, &msgs.front(), NET_BATCH_PKTS,
+			   MSG_WAITFORONE, NULL);
+	if (num < 0) {
+		if ((errno == EAGAIN) || (errno == EINTR))
+			return 0;
+
+		LOG_ERR("DEV   : Stream receive error");
+		return -1;
+	}
+
+	if ((uint64_t) num > stats.batch_max.load(std::memory_order_relaxed))
+		stats.batch_max.store(num, std::memory_order_relaxed);
+
+	for (int i = 0; i < num; i++) {
+		if (handle_pkt(&pkt_bufs[i].front(), msgs[i].msg_len) < 0)
+			return -1;
+	}
+
+	return 0;
+}
+
+bool net_radio::recv_full(char *buf, size_t len)
+{
+	while (len) {
+		ssize_t rc = recv(fd, buf, len, 0);
+		if (rc < 0) {
+			if (((errno == EAGAIN) || (errno == EINTR)) &&
+			    rx_running.load())
+				continue;
+			return false;
+		} else if (!rc) {
+			return false;
+		}
+
+		buf += rc;
+		len -= rc;
+	}
+
+	return true;
+}
+
+/* Read one packet from the byte stream, a closed connection ends it */
+int net_radio::recv_tcp()
+{
+	struct net_iq_hdr hdr = { };
+	char *buf = &pkt_bufs[0].front();
+
+	if (!recv_full(buf, NET_IQ_HDR_LEN))
+		return -1;
+
+	/*
+	 * Header is validated in full once the payload length is known. A
+	 * header rejected before its fields are read leaves no channels.
+	 */
+	net_iq_unpack(&hdr, buf, NET_IQ_HDR_LEN);
+
+	size_t len = 4 * hdr.chans * hdr.len;
+	if ((hdr.chans != chans) || (NET_IQ_HDR_LEN + len > NET_IQ_PKT_MAX)) {
+		LOG_ERR("DEV   : Invalid stream header, closing connection");
+		return -1;
+	}
+
+	if (!recv_full(buf + NET_IQ_HDR_LEN, len))
+		return -1;
+
+	/* Stream framing is lost after an invalid packet */
+	if (!net_iq_unpack(&hdr, buf, NET_IQ_HDR_LEN + len)) {
+		LOG_ERR("DEV   : Invalid stream packet, closing connection");
+		return -1;
+	}
+
+	return handle_pkt(buf, NET_IQ_HDR_LEN + len);
+}
+
+int net_radio::handle_pkt(const char *buf, size_t len)
+{
+	struct net_iq_hdr hdr;
+	std::ostringstream ost;
+
+	if (!net_iq_unpack(&hdr, buf, len) || (hdr.chans != chans)) {
+		stat_inc(stats.invalid);
+		return 0;
+	}
+
+	if (hdr.flags & NET_IQ_FLAG_EOS) {
+		LOG_DEV("DEV   : End of stream");
+		return -1;
+	}
+
+	if (hdr.rate != (uint32_t) rate) {
+		ost << "DEV   : Stream rate " << hdr.rate
+		    << " Hz does not match " << rate << " Hz";
+		LOG_ERR(ost.str().c_str());
+		return -1;
+	}
+
+	/* Reordered or duplicate packets do not move the sequence count back */
+	int32_t skip = (int32_t) (hdr.seq - rx_seq);
+	if (!synced || (skip >= 0)) {
+		if (synced)
+			stat_inc(stats.lost, skip);
+
+		rx_seq = hdr.seq + 1;
+	}
+
+	stat_inc(stats.packets);
+
+	if (!hdr.len)
+		return 0;
+
+	/* Stream timing starts at the first packet */
+	if (!synced) {
+		rx_ts = hdr.ts;
+		synced = true;
+	}
+
+	/* Reordered or duplicate packets would rewind the buffer */
+	if (hdr.ts < rx_ts) {
+		stat_inc(stats.late);
+		return 0;
+	}
+
+	/* Missing samples are zero filled when the packet is written */
+	if (hdr.ts - rx_ts > NET_FILL_MAX)
+		stat_inc(stats.jumps);
+	else
+		stat_inc(stats.filled, hdr.ts - rx_ts);
+
+	rx_ts = hdr.ts;
+
+	/* Lossless readers are behind, packet is dropped */
+	int rc = ring->get_wr_buf(rx_ts, hdr.len, wr_ptrs);
+	if (rc == -ts_buffer::ERR_OVERFLOW) {
+		stat_inc(stats.buf_overflows);
+		rx_ts += hdr.len;
+		return 0;
+	} else if (rc < 0) {
+		ost << "DEV   : Receive buffer error at " << rx_ts << " - "
+		    << ts_buffer::str_code(-rc);
+		LOG_ERR(ost.str().c_str());
+		return -1;
+	}
+
+	const int16_t *smpls = (const int16_t *) (buf + NET_IQ_HDR_LEN);
+
+	if (chans == 1) {
+		memcpy(wr_ptrs[0], smpls, hdr.len * 2 * sizeof(int16_t));
+	} else {
+		for (size_t i = 0; i < chans; i++) {
+			for (size_t n = 0; n < hdr.len; n++) {
+				wr_ptrs[i][2 * n + 0] = smpls[2 * (chans * n + i) + 0];
+				wr_ptrs[i][2 * n + 1] = smpls[2 * (chans * n + i) + 1];
+			}
+		}
+	}
+
+	if (ring->commit_wr(wr_ptrs, hdr.len) == -ts_buffer::ERR_OVERFLOW)
+		stat_inc(stats.buf_overflows);
+
+	rx_ts += hdr.len;
+	stat_inc(stats.samples, hdr.len);
+
+	return 0;
+}
+
+/* Block until the receive thread advances the buffer head */
+int net_radio::reload()
+{
+	int64_t ts = get_ts_high();
+
+	while (!ring->wait_wr(ts, NET_WAIT_USEC)) {
+		if (!rx_running.load())
+			return -1;
+	}
+
+	return 0;
+}
+
+std::string net_radio::str_stats()
+{
+	std::ostringstream ost;
+
+	ost << "DEV   : Packets " << stats.packets.load()
+	    << ", samples " << stats.samples.load()
+	    << ", lost " << stats.lost.load()
+	    << ", late " << stats.late.load()
+	    << ", invalid " << stats.invalid.load()
+	    << ", zero filled " << stats.filled.load()
+	    << ", timestamp jumps " << stats.jumps.load()
+	    << ", buffer overflows " << stats.buf_overflows.load()
+	    << ", max batch " << stats.batch_max.load()
+	    << "\n                     Buffer " << ring->str_stats();
+
+	return ost.str();
+}
+
+void net_radio::reset_stats()
+{
+	stats.packets.store(0);
+	stats.samples.store(0);
+	stats.lost.store(0);
+	stats.late.store(0);
+	stats.invalid.store(0);
+	stats.filled.store(0);
+	stats.jumps.store(0);
+	stats.buf_overflows.store(0);
+	stats.batch_max.store(0);
+
+	if (ring)
+		ring->reset_stats();
+}
+
+radio_dev *net_radio_init(int64_t *ts, const std::string &url,
+			  size_t rbs, size_t chans, size_t oversamp)
+{
+	double rate = lte_subframe_len(rbs) * 1000.0 * oversamp;
+	if (rate <= 0.0) {
+		std::cerr << "** Invalid sample rate selection" << std::endl;
+		return NULL;
+	}
+
+	net_radio *dev = new net_radio(chans, rate);
+	if (!dev->open(url) || !dev->start(ts)) {
+		delete dev;
+		return NULL;
+	}
+
+	return dev;
+}
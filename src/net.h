@@ -0,0 +1,55 @@
+#ifndef _LTE_NET_H_
+#define _LTE_NET_H_
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string>
+#include <netinet/in.h>
+
+/*
+ * Network IQ stream wire format
+ *
+ * Each packet carries a fixed header followed by sc16 samples for every
+ * channel, interleaved per sample as in capture files. Header fields are in
+ * network byte order and samples in little endian order. Like VITA-49, the
+ * header carries a packet sequence count and the integer sample timestamp of
+ * the first sample in the packet.
+ *
+ * The last packet of a stream sets NET_IQ_FLAG_EOS and carries no samples.
+ */
+#define NET_IQ_MAGIC		0x4f504951	/* "OPIQ" */
+#define NET_IQ_VERSION		1
+#define NET_IQ_HDR_LEN		32
+
+#define NET_IQ_FLAG_EOS		(1 << 0)
+
+/* Largest UDP payload and the default payload on a 1500 byte MTU */
+#define NET_IQ_PKT_MAX		65507
+#define NET_IQ_PKT_MTU		1472
+
+enum net_proto {
+	NET_PROTO_UDP,
+	NET_PROTO_TCP,
+};
+
+struct net_iq_hdr {
+	uint32_t seq;
+	uint32_t flags;
+	uint32_t rate;
+	uint16_t chans;
+	uint16_t len;
+	int64_t ts;
+};
+
+void net_iq_pack(const struct net_iq_hdr *hdr, void *buf);
+bool net_iq_unpack(struct net_iq_hdr *hdr, const void *buf, size_t len);
+
+/* Parse udp://host:port or tcp://host:port */
+bool net_is_url(const std::string &url);
+bool net_parse_url(const std::string &url, enum net_proto *proto,
+		   struct sockaddr_in *addr);
+
+/* Request a socket buffer, returns the size granted by the kernel */
+int net_set_bufsize(int fd, int opt, int len);
+
+#endif /* _LTE_NET_H_ */
@@ -0,0 +1,135 @@
+/*
+ * Network IQ Stream Wire Format
+ *
+ * Copyright (C) 2015 Ettus Research LLC
+ * Author Tom Tsou <tom.tsou@ettus.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <string.h>
+#include <stdlib.h>
+#include <endian.h>
+#include <netdb.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+
+#include "net.h"
+
+/*
+ * Header layout
+ *
+ *   0  magic    4  version:16 chans:16    8  seq
+ *  12  flags   16  rate                  20  len:16 reserved:16
+ *  24  timestamp (64 bits)
+ */
+void net_iq_pack(const struct net_iq_hdr *hdr, void *buf)
+{
+	uint32_t *words = (uint32_t *) buf;
+	uint64_t ts = htobe64(hdr->ts);
+
+	words[0] = htonl(NET_IQ_MAGIC);
+	words[1] = htonl(NET_IQ_VERSION << 16 | hdr->chans);
+	words[2] = htonl(hdr->seq);
+	words[3] = htonl(hdr->flags);
+	words[4] = htonl(hdr->rate);
+	words[5] = htonl((uint32_t) hdr->len << 16);
+	memcpy(&words[6], &ts, sizeof(ts));
+}
+
+/* Validate the header and the payload length against the packet length */
+bool net_iq_unpack(struct net_iq_hdr *hdr, const void *buf, size_t len)
+{
+	const uint32_t *words = (const uint32_t *) buf;
+	uint64_t ts;
+
+	if ((len < NET_IQ_HDR_LEN) || (ntohl(words[0]) != NET_IQ_MAGIC))
+		return false;
+
+	uint32_t word = ntohl(words[1]);
+	if ((word >> 16) != NET_IQ_VERSION)
+		return false;
+
+	hdr->chans = word & 0xffff;
+	hdr->seq = ntohl(words[2]);
+	hdr->flags = ntohl(words[3]);
+	hdr->rate = ntohl(words[4]);
+	hdr->len = ntohl(words[5]) >> 16;
+
+	memcpy(&ts, &words[6], sizeof(ts));
+	hdr->ts = be64toh(ts);
+
+	if (!hdr->chans || (hdr->ts < 0))
+		return false;
+
+	return len == (size_t) NET_IQ_HDR_LEN + 4 * hdr->chans * hdr->len;
+}
+
+bool net_is_url(const std::string &url)
+{
+	return !url.compare(0, 6, "udp://") || !url.compare(0, 6, "tcp://");
+}
+
+bool net_parse_url(const std::string &url, enum net_proto *proto,
+		   struct sockaddr_in *addr)
+{
+	if (!net_is_url(url))
+		return false;
+
+	*proto = url[0] == 'u' ? NET_PROTO_UDP : NET_PROTO_TCP;
+
+	size_t colon = url.rfind(':');
+	if ((colon == std::string::npos) || (colon < 6))
+		return false;
+
+	std::string host = url.substr(6, colon - 6);
+	int port = atoi(url.c_str() + colon + 1);
+	if ((port <= 0) || (port > 65535))
+		return false;
+
+	struct addrinfo hints, *res;
+
+	memset(&hints, 0, sizeof(hints));
+	hints.ai_family = AF_INET;
+
+	if (getaddrinfo(host.empty() ? "0.0.0.0" : host.c_str(),
+			NULL, &hints, &res))
+		return false;
+
+	memcpy(addr, res->ai_addr, sizeof(*addr));
+	addr->sin_port = htons(port);
+
+	freeaddrinfo(res);
+
+	return true;
+}
+
+/*
+ * The forced variants bypass the net.core.[rw]mem_max limits but require
+ * CAP_NET_ADMIN, so fall back to the limited request.
+ */
+int net_set_bufsize(int fd, int opt, int len)
+{
+	int force = opt == SO_RCVBUF ? SO_RCVBUFFORCE : SO_SNDBUFFORCE;
+	socklen_t size = sizeof(len);
+
+	if (setsockopt(fd, SOL_SOCKET, force, &len, sizeof(len)) < 0)
+		setsockopt(fd, SOL_SOCKET, opt, &len, sizeof(len));
+
+	if (getsockopt(fd, SOL_SOCKET, opt, &len, &size) < 0)
+		return -1;
+
+	/* Kernel reports double the usable size for bookkeeping */
+	return len / 2;
+}
@@ -419,6 +419,34 @@ static struct fft_hdl *create_fft(int rbs)
 	return init_fft(0, slen, 7, ilen, olen, 1, 1, in, out, 0);
 }
 
+/*
+ * Plan the subframe FFT for a bandwidth ahead of any subframe allocation.
+ * Plans are retained as FFTW wisdom, so subframes allocated later, including
+ * those of forked processes, reuse the measurement.
+ */
+int lte_ofdm_plan(int rbs)
+{
+	int slen = lte_sym_len(rbs);
+	int ilen = lte_cp_len(rbs) + slen;
+	struct cxvec *in, *out;
+	struct fft_hdl *fft;
+
+	if (slen <= 0)
+		return -1;
+
+	in = cxvec_alloc(7 * ilen, 0, 0, NULL, CXVEC_FLG_FFT_ALIGN);
+	out = cxvec_alloc(7 * slen, 0, 0, NULL, CXVEC_FLG_FFT_ALIGN);
+
+	fft = init_fft(0, slen, 7, ilen, slen, 1, 1, in, out, 0);
+	if (fft)
+		fft_free_hdl(fft);
+
+	cxvec_free(in);
+	cxvec_free(out);
+
+	return fft ? 0 : -1;
+}
+
 struct lte_subframe *lte_subframe_alloc(int rbs, int cell_id, int tx_ants,
 					struct lte_ref_map **maps0,
 					struct lte_ref_map **maps1)
@@ -702,6 +730,21 @@ static int lte_slot_chan_recov(struct lte_slot *slot)
 	return 0;
 }
 
+/* Center resource block split across the Nyquist edge, or zero if none */
+static int lte_edge_rb(int rbs)
+{
+	switch (rbs) {
+	case 15:
+		return 7;
+	case 25:
+		return 12;
+	case 75:
+		return 37;
+	default:
+		return 0;
+	}
+}
+
 /*
  * Run the FFT
  *
@@ -716,20 +759,7 @@ static int lte_slot_convert(struct lte_subframe *subframe, int ns)
 
 	cxvec_fft(subframe->fft, slot->syms[0].td, slot->fd);
 
-	switch (slot->rbs) {
-	case 15:
-		edge_rb = 7;
-		break;
-	case 25:
-		edge_rb = 12;
-		break;
-	case 75:
-		edge_rb = 37;
-		break;
-	default:
-		edge_rb = 0;
-	}
-
+	edge_rb = lte_edge_rb(slot->rbs);
 	if (edge_rb) {
 		for (int l = 0; l < 7; l++)
 			lte_sym_rb_map_special(&slot->syms[l], edge_rb);
@@ -759,20 +789,7 @@ static int lte_subframe_convert_refs(struct lte_subframe *subframe)
 
 	lte_combine_chan(ref0, subframe->tx_ants);
 
-	switch (subframe->rbs) {
-	case 15:
-		edge_rb = 7;
-		break;
-	case 25:
-		edge_rb = 12;
-		break;
-	case 75:
-		edge_rb = 37;
-		break;
-	default:
-		edge_rb = 0;
-	}
-
+	edge_rb = lte_edge_rb(subframe->rbs);
 	if (edge_rb) {
 		lte_sym_chan_rb_map_special(ref0, edge_rb, 0);
 		lte_sym_chan_rb_map_special(ref0, edge_rb, 1);
@@ -791,3 +808,90 @@ int lte_subframe_convert(struct lte_subframe *subframe)
 
 	return lte_subframe_convert_refs(subframe);
 }
+
+/*
+ * Resource grid of a converted subframe
+ *
+ * The grid holds the frequency domain symbols of both slots, the extracted
+ * pilots of all four reference symbols and the interpolated channel and
+ * magnitude estimates, each vector one symbol length long, stored as
+ * interleaved I/Q floats. Grid length counts complex values. Loading a grid
+ * restores the state left by lte_subframe_convert() without the FFT or
+ * channel estimation, so control and shared channel decoding can be run
+ * again from a capture.
+ */
+#define LTE_GRID_VECS		(2 + 2 * 2 * 2 + LTE_DOWNLINK_ANT + 1)
+#define LTE_GRID_SYMS		(LTE_GRID_VECS - 2 + 2 * 7)
+
+static void grid_vecs(struct lte_subframe *subframe, struct cxvec **vecs)
+{
+	int n = 0;
+
+	for (int i = 0; i < 2; i++)
+		vecs[n++] = subframe->slot[i].fd;
+
+	for (int i = 0; i < 2; i++) {
+		for (int r = 0; r < 2; r++) {
+			vecs[n++] = subframe->slot[i].refs[r].refs[0];
+			vecs[n++] = subframe->slot[i].refs[r].refs[1];
+		}
+	}
+
+	for (int p = 0; p < LTE_DOWNLINK_ANT + 1; p++)
+		vecs[n++] = subframe->slot[0].refs[0].chan[p];
+}
+
+int lte_subframe_grid_len(int rbs)
+{
+	int sym_len = lte_sym_len(rbs);
+
+	return sym_len > 0 ? LTE_GRID_SYMS * sym_len : -1;
+}
+
+int lte_subframe_grid_save(struct lte_subframe *subframe, float *grid)
+{
+	struct cxvec *vecs[LTE_GRID_VECS];
+
+	if (!subframe->assigned)
+		return -1;
+
+	grid_vecs(subframe, vecs);
+
+	for (int i = 0; i < LTE_GRID_VECS; i++) {
+		memcpy(grid, vecs[i]->data, vecs[i]->len * sizeof(float complex));
+		grid += 2 * vecs[i]->len;
+	}
+
+	return 0;
+}
+
+int lte_subframe_grid_load(struct lte_subframe *subframe, const float *grid)
+{
+	struct cxvec *vecs[LTE_GRID_VECS];
+	struct lte_ref *ref0 = &subframe->slot[0].refs[0];
+	int edge_rb = lte_edge_rb(subframe->rbs);
+
+	grid_vecs(subframe, vecs);
+
+	for (int i = 0; i < LTE_GRID_VECS; i++) {
+		memcpy(vecs[i]->data, grid, vecs[i]->len * sizeof(float complex));
+		grid += 2 * vecs[i]->len;
+	}
+
+	/* Split center blocks are copies and not views of the grid */
+	if (edge_rb) {
+		for (int i = 0; i < 2; i++) {
+			for (int l = 0; l < 7; l++) {
+				lte_sym_rb_map_special(&subframe->slot[i].syms[l],
+						       edge_rb);
+			}
+		}
+
+		for (int p = 0; p < LTE_DOWNLINK_ANT + 1; p++)
+			lte_sym_chan_rb_map_special(ref0, edge_rb, p);
+	}
+
+	subframe->assigned = 1;
+
+	return 0;
+}
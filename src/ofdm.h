@@ -26,11 +26,19 @@ struct lte_subframe *lte_subframe_alloc(int rbs, int cell_id, int ant,
 					struct lte_ref_map **maps1);
 void lte_subframe_free(struct lte_subframe *slot);
 
+/* Measure the subframe FFT once per bandwidth */
+int lte_ofdm_plan(int rbs);
+
 int lte_subframe_reset(struct lte_subframe *subframe,
 		       struct lte_ref_map **map0, struct lte_ref_map **map1);
 
 int lte_subframe_convert(struct lte_subframe *subframe);
 
+/* Save or restore the resource grid and channel estimates of a subframe */
+int lte_subframe_grid_len(int rbs);
+int lte_subframe_grid_save(struct lte_subframe *subframe, float *grid);
+int lte_subframe_grid_load(struct lte_subframe *subframe, const float *grid);
+
 float lte_ofdm_offset(struct lte_subframe *subframe);
 
 int lte_chk_ref(struct lte_subframe *subframe, int slot, int l, int sc, int p);
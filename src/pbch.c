@@ -34,6 +34,7 @@
 #include "qam.h"
 #include "si.h"
 #include "subframe.h"
+#include "slot.h"
 #include "pbch_block.h"
 #include "log.h"
 #include "sigproc/sigvec_internal.h"
@@ -41,13 +42,16 @@
 #define LTE_PBCH_NUM_RB		6
 #define LTE_RB_LEN		12
 
+/* Symbol and channel views address only the center 6 resource blocks */
 struct pbch_sym {
 	struct lte_sym *sym;
+	struct lte_sym center;
 	struct cxvec *data;
 };
 
 struct pbch_slot {
 	struct lte_slot *slot;
+	struct lte_ref ref;
 	struct pbch_sym syms[4];
 
 	struct {
@@ -57,15 +61,71 @@ struct pbch_slot {
 	} mib;
 };
 
-static int pbch_sym_init(struct pbch_sym *sym, struct lte_sym *lsym,
-			 struct cxvec *e, int idx, int len)
+/*
+ * Position of center resource block 'rb' in the frequency domain symbol
+ *
+ * The 72 broadcast subcarriers surround the DC subcarrier at every bandwidth,
+ * so each center block is found at the same offset from DC in the FFT output.
+ * With 15, 25, and 75 resource blocks the center blocks are offset by half a
+ * block from the subframe blocks, so the subframe block mapping, including the
+ * split block, is not used.
+ */
+static int pbch_rb_pos(int rbs, int rb)
+{
+	int half = LTE_PBCH_NUM_RB / 2;
+
+	if (rb < half)
+		return lte_sym_len(rbs) - (half - rb) * LTE_RB_LEN;
+	else
+		return 1 + (rb - half) * LTE_RB_LEN;
+}
+
+static struct cxvec **pbch_rb_map(struct cxvec *vec, int rbs)
+{
+	struct cxvec **rb;
+
+	rb = (struct cxvec **) calloc(LTE_PBCH_NUM_RB, sizeof(struct cxvec *));
+
+	for (int i = 0; i < LTE_PBCH_NUM_RB; i++) {
+		rb[i] = cxvec_subvec(vec, pbch_rb_pos(rbs, i),
+				     0, 0, LTE_RB_LEN);
+	}
+
+	return rb;
+}
+
+static void pbch_rb_free(struct cxvec **rb)
+{
+	for (int i = 0; i < LTE_PBCH_NUM_RB; i++)
+		cxvec_free(rb[i]);
+
+	free(rb);
+}
+
+/* Map the channel estimates shared by all symbols of the subframe */
+static void pbch_ref_init(struct pbch_slot *pbch)
+{
+	struct lte_ref *ref = pbch->slot->syms[0].ref;
+
+	pbch->ref = *ref;
+
+	for (int p = 0; p < LTE_DOWNLINK_ANT + 1; p++)
+		pbch->ref.rb[p] = pbch_rb_map(ref->chan[p], pbch->slot->rbs);
+}
+
+static int pbch_sym_init(struct pbch_slot *pbch, struct pbch_sym *sym,
+			 struct lte_sym *lsym, struct cxvec *e, int idx, int len)
 {
 	if (lsym->l >= 4) {
 		LOG_PBCH_ERR("Invalid symbol");
 		return -1;
 	}
 
-	sym->sym = lsym;
+	sym->center = *lsym;
+	sym->center.ref = &pbch->ref;
+	sym->center.rb = pbch_rb_map(lsym->fd, pbch->slot->rbs);
+
+	sym->sym = &sym->center;
 	sym->data = cxvec_subvec(e, idx, 0, 0, len);
 
 	return 0;
@@ -76,7 +136,7 @@ static struct pbch_slot *pbch_slot_alloc(struct lte_slot *slot)
 	int len, idx = 0;
 	struct pbch_slot *pbch;
 
-	if (slot->rbs != LTE_PBCH_NUM_RB) {
+	if (lte_sym_len(slot->rbs) < 0) {
 		printf("slot->rbs %i\n", slot->rbs);
 		LOG_PBCH_ERR("Invalid number of resouce blocks");
 		return NULL;
@@ -86,6 +146,8 @@ static struct pbch_slot *pbch_slot_alloc(struct lte_slot *slot)
 	pbch->slot = slot;
 	pbch->mib.e = cxvec_alloc_simple(240);
 
+	pbch_ref_init(pbch);
+
 	/* PBCH is 4 symbols long */
 	for (int i = 0; i < 4; i++) {
 		if (i < 2)
@@ -93,7 +155,7 @@ static struct pbch_slot *pbch_slot_alloc(struct lte_slot *slot)
 		else
 			len = 72;
 
-		pbch_sym_init(&pbch->syms[i],
+		pbch_sym_init(pbch, &pbch->syms[i],
 			      &pbch->slot->syms[i],
 			      pbch->mib.e, idx, len);
 		idx += len;
@@ -104,6 +166,7 @@ static struct pbch_slot *pbch_slot_alloc(struct lte_slot *slot)
 
 static void pbch_sym_free(struct pbch_sym *sym)
 {
+	pbch_rb_free(sym->center.rb);
 	cxvec_free(sym->data);
 }
 
@@ -112,6 +175,9 @@ static void free_pbch_slot(struct pbch_slot *pbch)
 	for (int i = 0; i < 4; i++)
 		pbch_sym_free(&pbch->syms[i]);
 
+	for (int p = 0; p < LTE_DOWNLINK_ANT + 1; p++)
+		pbch_rb_free(pbch->ref.rb[p]);
+
 	cxvec_free(pbch->mib.e);
 	free(pbch);
 }
@@ -453,13 +453,57 @@ static int pdsch_get_rv(struct lte_dci *dci, struct lte_time *ltime)
 int lte_wireshark_send(uint8_t *data, int len,
 		       int subframe, int si_rnti, int rnti);
 
+/* Soft bit capture point, see lte_pdsch_set_tap() */
+static void (*pdsch_tap)(const struct lte_pdsch_soft *soft);
+
+void lte_pdsch_set_tap(void (*tap)(const struct lte_pdsch_soft *soft))
+{
+	pdsch_tap = tap;
+}
+
+/* Decode soft bits already placed in the transport block 'f' buffer */
+static int pdsch_decode_soft(struct lte_pdsch_blk *tblk,
+			     const struct lte_pdsch_soft *soft)
+{
+	int i;
+	uint8_t *a;
+
+	/* Decode the transport block */
+	if (!lte_pdsch_blk_decode(tblk, soft->rv))
+		goto wireshark;
+
+	/* If we fail on DCI Format 1C, try all redundancy versions */
+	if (soft->dci_type == LTE_DCI_FORMAT1C) {
+		for (i = 0; i < 4; i++) {
+			if (i == soft->rv)
+				continue;
+
+			pdsch_log_blk_info1(soft->rnti, soft->mod, i);
+			if (!lte_pdsch_blk_decode(tblk, i))
+				goto wireshark;
+		}
+	}
+
+	return 0;
+
+wireshark:
+	a = lte_pdsch_blk_abuf(tblk, soft->tbs);
+	if (!a)
+		return -1;
+
+	int si = soft->rnti == SI_RNTI;
+
+	lte_wireshark_send(a, soft->tbs / 8, soft->subframe,
+			   si, soft->rnti);
+	return 1;
+}
+
 static int pdsch_decode_blk(struct pdsch_sym_blk *pblk, int n_id_cell,
 			    struct lte_dci *dci, int vrb,
 			    struct lte_pdsch_blk *tblk, struct lte_time *ltime)
 {
-	int i, G, rv;
+	int G, rv;
 	signed char *f;
-	uint8_t *a;
 
 	int mod = lte_tbs_get_mod_order(dci);
 	if (mod < 0)
@@ -516,34 +560,23 @@ static int pdsch_decode_blk(struct pdsch_sym_blk *pblk, int n_id_cell,
 	gen_scram_seq(seq, G, ltime->subframe, n_id_cell, dci->rnti);
 	lte_scramble2(f, seq, G);
 
-	/* Decode the transport block */
-	if (!lte_pdsch_blk_decode(tblk, rv))
-		goto wireshark;
-
-	/* If we fail on DCI Format 1C, try all redundancy versions */
-	if (dci->type == LTE_DCI_FORMAT1C) {
-		for (i = 0; i < 4; i++) {
-			if (i == rv)
-				continue;
-
-			pdsch_log_blk_info1(dci->rnti, mod, i);
-			if (!lte_pdsch_blk_decode(tblk, i))
-				goto wireshark;
-		}
-	}
-
-	return 0;
-
-wireshark:
-	a = lte_pdsch_blk_abuf(tblk, tbs);
-	if (!a)
-		return -1;
+	struct lte_pdsch_soft soft = {
+		.tbs = tbs,
+		.G = G,
+		.mod = mod,
+		.rv = rv,
+		.rnti = dci->rnti,
+		.dci_type = dci->type,
+		.frame = ltime->frame,
+		.subframe = ltime->subframe,
+		.n_id_cell = n_id_cell,
+		.f = f,
+	};
 
-	int si = dci->rnti == SI_RNTI;
+	if (pdsch_tap)
+		pdsch_tap(&soft);
 
-	lte_wireshark_send(a, tbs / 8, ltime->subframe,
-			   si, dci->rnti);
-	return 1;
+	return pdsch_decode_soft(tblk, &soft);
 }
 
 static int pdsch_extract_symbols(struct pdsch_slot **slot,
@@ -647,3 +680,26 @@ release:
 
 	return rc;
 }
+
+/* Decode soft bits of a captured transport block */
+int lte_decode_pdsch_soft(struct lte_pdsch_blk *tblk,
+			  const struct lte_pdsch_soft *soft)
+{
+	int8_t *f;
+
+	pdsch_log_blk_info0(soft->tbs, soft->G);
+	pdsch_log_blk_info1(soft->rnti, soft->mod, soft->rv);
+
+	if (lte_pdsch_blk_init(tblk, soft->tbs, soft->G, 1, soft->mod) < 0) {
+		LOG_PDSCH_ERR("Transport block initialization failed");
+		return -1;
+	}
+
+	f = lte_pdsch_blk_fbuf(tblk, soft->G);
+	if (!f)
+		return -1;
+
+	memcpy(f, soft->f, soft->G);
+
+	return pdsch_decode_soft(tblk, soft);
+}
@@ -1,17 +1,47 @@
 #ifndef _LTE_PDSCH_
 #define _LTE_PDSCH_
 
+#include <stdint.h>
+
 struct lte_pdsch_decoder;
 struct lte_subframe;
 struct lte_dci;
 struct lte_pdsch_blk;
 struct lte_time;
 
+/* Returns 1 on transport block CRC pass, 0 on CRC failure */
 int lte_decode_pdsch(struct lte_subframe **subframe,
 		     int chans, struct lte_pdsch_blk *blk,
 		     int cfi, int dci_index,
 		     struct lte_time *time);
 
+/*
+ * Descrambled soft bits of a transport block ahead of turbo decoding, along
+ * with the parameters needed to decode them again
+ */
+struct lte_pdsch_soft {
+	int tbs;
+	int G;
+	int mod;
+	int rv;
+	int rnti;
+	int dci_type;
+	int frame;
+	int subframe;
+	int n_id_cell;
+	const int8_t *f;
+};
+
+/*
+ * Soft bit capture point. The tap is called from every PDSCH decoding
+ * thread and the soft bits are only valid for the duration of the call.
+ */
+void lte_pdsch_set_tap(void (*tap)(const struct lte_pdsch_soft *soft));
+
+/* Decode captured soft bits, same returns as lte_decode_pdsch() */
+int lte_decode_pdsch_soft(struct lte_pdsch_blk *blk,
+			  const struct lte_pdsch_soft *soft);
+
 struct lte_pdsch_decoder *lte_pdsch_alloc_decoder(int d_len, int e_len);
 
 void lte_pdsch_free_decoder(struct lte_pdsch_decoder *dec);
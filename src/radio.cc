@@ -0,0 +1,86 @@
+/*
+ * LTE Ring Buffered Sample Source
+ *
+ * Copyright (C) 2015 Ettus Research LLC
+ * Author Tom Tsou <tom.tsou@ettus.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <iostream>
+
+#include "radio.h"
+#include "buffer.h"
+
+/* Windows are read in place and held until commit */
+int ring_radio::pull(std::vector<short *> &bufs, size_t len, int64_t ts)
+{
+	if (bufs.size() != ring->get_chans()) {
+		std::cerr << "DEV: Invalid buffer " << bufs.size() << std::endl;
+		return -1;
+	}
+
+	if (ring->avail_smpls(ts) < len) {
+		std::cerr << "Insufficient samples in buffer " << std::endl;
+		return -1;
+	}
+
+	int rc = ring->get_rd_buf(ts, len, bufs);
+	if (rc < 0) {
+		std::cerr << "Fatal buffer pull error " << -rc << std::endl;
+		return -1;
+	}
+
+	return len;
+}
+
+int ring_radio::commit(std::vector<short *> &bufs)
+{
+	if (bufs.size() != ring->get_chans()) {
+		std::cerr << "Fatal I/O error" << std::endl;
+		return -1;
+	}
+
+	if (!ring->commit_rd(bufs)) {
+		std::cerr << "Fatal commit error" << std::endl;
+		return -1;
+	}
+
+	return 0;
+}
+
+int ring_radio::lookback(std::vector<short *> &bufs, size_t len, int64_t ts)
+{
+	return ring->lookback(bufs, len, ts) < 0 ? -1 : len;
+}
+
+int64_t ring_radio::get_ts_high()
+{
+	return ring->get_last_time();
+}
+
+int64_t ring_radio::get_ts_low()
+{
+	return ring->get_first_time();
+}
+
+int64_t ring_radio::get_ts_history()
+{
+	return ring->get_history_time();
+}
+
+bool ring_radio::get_gap(int64_t end, int64_t *ts, int64_t *len)
+{
+	return ring->get_gap(end, ts, len);
+}
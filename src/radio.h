@@ -0,0 +1,128 @@
+#ifndef _LTE_RADIO_H_
+#define _LTE_RADIO_H_
+
+#include <stdint.h>
+#include <vector>
+#include <string>
+
+#include "openphy/io.h"
+
+class ts_buffer;
+
+/* Receive ring length in samples per channel of ring backed sources */
+#define RADIO_RX_BUFLEN		(1 << 20)
+
+/*
+ * Radio sample source backend
+ *
+ * A backend delivers timestamped sc16 samples for one or more receive
+ * channels. The subframe I/O interface only requires that samples up to
+ * get_ts_high() are available to pull, and that reload() advances the high
+ * timestamp or reports a negative value when the source is exhausted.
+ */
+class radio_dev {
+public:
+	virtual ~radio_dev() { }
+
+	virtual void reset() = 0;
+	virtual int reload() = 0;
+
+	virtual int pull(std::vector<short *> &bufs, size_t len, int64_t ts) = 0;
+	virtual int commit(std::vector<short *> &bufs) = 0;
+
+	virtual int64_t get_ts_high() = 0;
+	virtual int64_t get_ts_low() = 0;
+
+	/*
+	 * Copy already received samples into caller buffers. Samples from
+	 * get_ts_history() up to the high timestamp may be copied again after
+	 * commit. Sources without retained history report none.
+	 */
+	virtual int lookback(std::vector<short *> &bufs, size_t len, int64_t ts)
+	{
+		return -1;
+	}
+	virtual int64_t get_ts_history() { return get_ts_high(); }
+
+	/*
+	 * Receive ring that additional readers can attach to, or NULL for
+	 * sources that do not buffer through a ring
+	 */
+	virtual ts_buffer *get_buffer() { return NULL; }
+
+	/*
+	 * Report the next span of samples lost by the source that starts
+	 * before a timestamp, once per span. Lost samples read as zero.
+	 * Sources that cannot lose samples report none.
+	 */
+	virtual bool get_gap(int64_t end, int64_t *ts, int64_t *len)
+	{
+		return false;
+	}
+
+	/* Frequency control is a no-op on sources without a tuner */
+	virtual bool tunable() { return false; }
+	virtual int shift(double offset) { return 0; }
+	virtual int freq_reset() { return 0; }
+
+	/*
+	 * Replay only the samples from ts up to end, or to the end of the
+	 * source if end is zero. Must be called before the first reload.
+	 * Returns the first replayed timestamp, which packed formats round
+	 * down to a block boundary. Live sources cannot seek.
+	 */
+	virtual int64_t seek(int64_t ts, int64_t end) { return -1; }
+
+	/* Telemetry report and counter reset */
+	virtual std::string str_stats() = 0;
+	virtual void reset_stats() = 0;
+};
+
+/*
+ * Source buffered through a receive ring
+ *
+ * Pulls, lookback, gaps and timestamps are served from the ring, so a
+ * backend only fills the ring and provides reload(). Backends allocate the
+ * ring when opened, or share one that is written elsewhere.
+ */
+class ring_radio : public radio_dev {
+public:
+	ring_radio(ts_buffer *ring = NULL) : ring(ring) { }
+
+	int pull(std::vector<short *> &bufs, size_t len, int64_t ts);
+	int commit(std::vector<short *> &bufs);
+	int lookback(std::vector<short *> &bufs, size_t len, int64_t ts);
+
+	int64_t get_ts_high();
+	int64_t get_ts_low();
+	int64_t get_ts_history();
+	ts_buffer *get_buffer() { return ring; }
+
+	bool get_gap(int64_t end, int64_t *ts, int64_t *len);
+
+protected:
+	ts_buffer *ring;
+};
+
+/*
+ * Sources run at the native rate for the number of resource blocks, or an
+ * integer multiple of it when capturing wideband for the channelizer.
+ */
+radio_dev *uhd_radio_init(int64_t *ts, double freq, const std::string &args,
+			  size_t rbs, size_t chans, double gain, int ref,
+			  size_t oversamp = 1,
+			  enum sample_format wire = FORMAT_SC16);
+
+radio_dev *file_radio_init(int64_t *ts, const std::string &path,
+			   size_t rbs, size_t chans, double speed,
+			   size_t oversamp = 1,
+			   enum sample_format format = FORMAT_SC16);
+
+radio_dev *mmap_radio_init(int64_t *ts, const std::string &path,
+			   size_t rbs, size_t chans, double speed,
+			   size_t oversamp = 1);
+
+radio_dev *net_radio_init(int64_t *ts, const std::string &url,
+			  size_t rbs, size_t chans, size_t oversamp = 1);
+
+#endif /* _LTE_RADIO_H_ */
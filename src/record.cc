@@ -0,0 +1,580 @@
+/*
+ * LTE Raw Sample Recorder
+ *
+ * Copyright (C) 2015 Ettus Research LLC
+ * Author Tom Tsou <tom.tsou@ettus.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <iostream>
+#include <sstream>
+#include <fstream>
+#include <algorithm>
+#include <chrono>
+
+#include "record.h"
+#include "radio.h"
+#include "buffer.h"
+#include "log.h"
+
+extern "C" {
+#include "sigproc/convert.h"
+}
+
+/* Block alignment satisfies O_DIRECT on common filesystems */
+#define RECORD_BLOCK_ALIGN	4096
+
+/* Samples per channel read from a followed source at a time */
+#define RECORD_FEED_LEN		(1 << 16)
+
+/* Interval between checks of a followed source once caught up */
+#define RECORD_POLL_USEC	500
+
+/* Indexed by sample format */
+static const char *format_strs[] = {
+	"sc16",
+	"sc12",
+	"bfp8",
+	"sc8",
+};
+
+const char *sample_format_str(enum sample_format format)
+{
+	return format_strs[format];
+}
+
+bool sample_format_parse(const std::string &str, enum sample_format *format)
+{
+	for (int i = FORMAT_SC16; i <= FORMAT_SC8; i++) {
+		if (str == format_strs[i]) {
+			*format = (enum sample_format) i;
+			return true;
+		}
+	}
+
+	return false;
+}
+
+enum sample_format record_read_format(const std::string &path)
+{
+	enum sample_format format = FORMAT_SC16;
+	std::ifstream meta(path + ".meta");
+	std::string key, val;
+
+	while (meta >> key >> val) {
+		if (key == "format") {
+			if (!sample_format_parse(val, &format))
+				std::cerr << "** Unknown sample format " << val
+					  << ", assuming sc16" << std::endl;
+			break;
+		}
+	}
+
+	return format;
+}
+
+sample_recorder::sample_recorder(const record_meta &meta, size_t num_blocks)
+	: meta(meta), num_blocks(num_blocks), fd(-1), direct(false),
+	  block(NULL), block_fill(0),
+	  start_ts(-1), next_ts(-1), samples(0), gap_samples(0),
+	  drop_samples(0), dev(NULL), ring(NULL), reader(NULL),
+	  following(false), pack_buf(NULL), write_errors(0), running(false)
+{
+}
+
+sample_recorder::~sample_recorder()
+{
+	close();
+
+	for (size_t i = 0; i < blocks.size(); i++)
+		free(blocks[i]);
+
+	free(pack_buf);
+}
+
+bool sample_recorder::open(const std::string &path)
+{
+	this->path = path;
+
+	/* Replay unpacks blocks as whole samples of every channel */
+	if ((meta.format == FORMAT_BFP8) &&
+	    ((CONVERT_BFP8_LEN / 2) % meta.chans)) {
+		std::cerr << "** Block floating point recording requires a "
+			  << "channel count dividing " << CONVERT_BFP8_LEN / 2
+			  << std::endl;
+		return false;
+	}
+
+	/* Fall back to buffered writes where O_DIRECT is not supported */
+	fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_DIRECT, 0644);
+	if (fd >= 0) {
+		direct = true;
+	} else if (errno == EINVAL) {
+		fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	}
+
+	if (fd < 0) {
+		std::cerr << "** Failed to open record file " << path << std::endl;
+		return false;
+	}
+
+	for (size_t i = 0; i < num_blocks; i++) {
+		void *buf;
+		if (posix_memalign(&buf, RECORD_BLOCK_ALIGN, RECORD_BLOCK_LEN)) {
+			std::cerr << "** Record buffer allocation failed" << std::endl;
+			return false;
+		}
+
+		blocks.push_back((char *) buf);
+		free_blocks.push_back((char *) buf);
+	}
+
+	/* Packed blocks never exceed the raw block length */
+	if ((meta.format != FORMAT_SC16) &&
+	    posix_memalign((void **) &pack_buf, RECORD_BLOCK_ALIGN,
+			   RECORD_BLOCK_LEN)) {
+		std::cerr << "** Record buffer allocation failed" << std::endl;
+		return false;
+	}
+
+	if (!write_meta())
+		return false;
+
+	running = true;
+	thread = std::thread(&sample_recorder::writer, this);
+
+	return true;
+}
+
+/* Flush outstanding blocks and finalize the metadata */
+void sample_recorder::close()
+{
+	if (fd < 0)
+		return;
+
+	if (feed_thread.joinable()) {
+		following.store(false);
+		feed_thread.join();
+	}
+
+	delete reader;
+	reader = NULL;
+
+	if (thread.joinable()) {
+		if (block && block_fill)
+			queue_block();
+
+		{
+			std::lock_guard<std::mutex> guard(mutex);
+			running = false;
+		}
+
+		cond.notify_one();
+		thread.join();
+	}
+
+	::close(fd);
+	fd = -1;
+
+	write_meta();
+
+	std::ostringstream ost;
+	ost << "DEV   : Recorded " << samples << " samples"
+	    << ", " << gap_samples << " gap filled"
+	    << ", " << drop_samples << " dropped"
+	    << ", " << write_errors << " write errors";
+
+	LOG_DEV(ost.str().c_str());
+}
+
+bool sample_recorder::write_meta()
+{
+	std::string meta_path = path + ".meta";
+
+	FILE *file = fopen(meta_path.c_str(), "w");
+	if (!file) {
+		std::cerr << "** Failed to open " << meta_path << std::endl;
+		return false;
+	}
+
+	fprintf(file,
+		"format           %s\n"
+		"channels         %zu\n"
+		"sample_rate      %.0f\n"
+		"center_freq      %.0f\n"
+		"gain             %.2f\n"
+		"resource_blocks  %i\n"
+		"start_timestamp  %lli\n"
+		"samples          %llu\n"
+		"gap_samples      %llu\n"
+		"dropped_samples  %llu\n",
+		sample_format_str(meta.format),
+		meta.chans,
+		meta.rate,
+		meta.freq,
+		meta.gain,
+		meta.rbs,
+		(long long) start_ts,
+		(unsigned long long) samples,
+		(unsigned long long) gap_samples,
+		(unsigned long long) drop_samples);
+
+	fclose(file);
+
+	return true;
+}
+
+void sample_recorder::queue_block()
+{
+	{
+		std::lock_guard<std::mutex> guard(mutex);
+		full_blocks.push_back(std::make_pair(block, block_fill));
+	}
+
+	cond.notify_one();
+
+	block = NULL;
+	block_fill = 0;
+}
+
+/*
+ * Interleave samples into the current block. A NULL buffer list appends
+ * zeros for gap filling.
+ */
+void sample_recorder::append(const std::vector<short *> *bufs,
+			     size_t offset, size_t len)
+{
+	size_t frame = meta.chans * sizeof(uint32_t);
+
+	while (len) {
+		if (!block) {
+			std::lock_guard<std::mutex> guard(mutex);
+			if (!free_blocks.empty()) {
+				block = free_blocks.back();
+				free_blocks.pop_back();
+			}
+		}
+
+		/* Writer is behind, never stall the caller */
+		if (!block) {
+			drop_samples += len;
+			return;
+		}
+
+		size_t num = (RECORD_BLOCK_LEN - block_fill) / frame;
+		if (num > len)
+			num = len;
+
+		uint32_t *out = (uint32_t *) (block + block_fill);
+
+		if (!bufs) {
+			memset(out, 0, num * frame);
+		} else if (meta.chans == 1) {
+			memcpy(out, (*bufs)[0] + 2 * offset, num * frame);
+		} else {
+			for (size_t i = 0; i < meta.chans; i++) {
+				const uint32_t *in =
+					(const uint32_t *) (*bufs)[i] + offset;
+
+				for (size_t n = 0; n < num; n++)
+					out[meta.chans * n + i] = in[n];
+			}
+		}
+
+		block_fill += num * frame;
+		samples += num;
+		offset += num;
+		len -= num;
+
+		if (block_fill + frame > RECORD_BLOCK_LEN)
+			queue_block();
+	}
+}
+
+void sample_recorder::push(const std::vector<short *> &bufs,
+			   size_t len, int64_t ts)
+{
+	if ((fd < 0) || (bufs.size() != meta.chans))
+		return;
+
+	if (next_ts < 0)
+		start_ts = next_ts = ts;
+
+	int64_t end = ts + len;
+	if (end <= next_ts)
+		return;
+
+	size_t offset = 0;
+	if (ts > next_ts) {
+		append(NULL, 0, ts - next_ts);
+		gap_samples += ts - next_ts;
+	} else {
+		offset = next_ts - ts;
+	}
+
+	append(&bufs, offset, len - offset);
+	next_ts = end;
+}
+
+/*
+ * Record the contiguous stream of a source from its current head onward
+ *
+ * Ring backed sources are read through a lossless reader, so every sample
+ * the source delivers is recorded, and the source holds off rather than
+ * overwrite samples not yet recorded. Block allocation never waits on the
+ * disk, so the reader only falls behind by the time of one copy. Other
+ * sources are copied out of their retained history.
+ */
+bool sample_recorder::follow(radio_dev *dev)
+{
+	if ((fd < 0) || feed_thread.joinable())
+		return false;
+
+	this->dev = dev;
+	ring = dev->get_buffer();
+
+	if (ring) {
+		if (ring->get_chans() != meta.chans) {
+			std::cerr << "** Record channels do not match the "
+				  << "receive buffer" << std::endl;
+			return false;
+		}
+
+		reader = new ts_reader(ring, TS_READER_LOSSLESS);
+		if (!reader->attached()) {
+			std::cerr << "** No receive buffer reader available "
+				  << "for recording" << std::endl;
+			delete reader;
+			reader = NULL;
+			return false;
+		}
+	}
+
+	/* Widened sc8 windows and history copies */
+	if (!ring || (ring->get_smpl_size() != TS_BUFFER_SC16)) {
+		feed_bufs.assign(meta.chans,
+				 std::vector<short>(2 * RECORD_FEED_LEN));
+
+		for (size_t i = 0; i < meta.chans; i++)
+			feed_ptrs.push_back(&feed_bufs[i].front());
+	}
+
+	following.store(true);
+	feed_thread = std::thread(&sample_recorder::feeder, this);
+
+	return true;
+}
+
+/*
+ * Count samples of a recorded window that the source lost and the ring
+ * zero filled. Gaps are reported once and may span several windows.
+ */
+void sample_recorder::count_gaps(int64_t ts, size_t len)
+{
+	int64_t gap_ts, gap_len, end = ts + len;
+
+	while (reader->get_gap(end, &gap_ts, &gap_len))
+		feed_gaps.push_back(std::make_pair(gap_ts, gap_ts + gap_len));
+
+	while (!feed_gaps.empty()) {
+		int64_t lo = std::max(feed_gaps.front().first, ts);
+		int64_t hi = std::min(feed_gaps.front().second, end);
+
+		if (hi > lo)
+			gap_samples += hi - lo;
+		if (feed_gaps.front().second > end)
+			break;
+
+		feed_gaps.pop_front();
+	}
+}
+
+/*
+ * Record the next ring window, false if no samples are waiting. Samples
+ * the writer skipped past, which only happens across a gap longer than
+ * the ring, are zero filled by push().
+ */
+bool sample_recorder::feed_ring(std::vector<short *> &bufs, int64_t *ts)
+{
+	if (*ts < reader->get_first_time())
+		*ts = reader->get_first_time();
+
+	size_t len = reader->avail_smpls(*ts);
+	if (!len)
+		return false;
+	if (len > RECORD_FEED_LEN)
+		len = RECORD_FEED_LEN;
+
+	int rc = reader->get_rd_buf(*ts, len, bufs);
+	if (rc == -ts_buffer::ERR_OVERFLOW) {
+		*ts = ring->get_history_time();
+		return true;
+	} else if (rc < 0) {
+		return false;
+	}
+
+	if (ring->get_smpl_size() == TS_BUFFER_SC8) {
+		for (size_t i = 0; i < meta.chans; i++) {
+			convert_sc8_short(feed_ptrs[i],
+					  (const int8_t *) bufs[i], 2 * len);
+		}
+
+		push(feed_ptrs, len, *ts);
+	} else {
+		push(bufs, len, *ts);
+	}
+
+	count_gaps(*ts, len);
+	reader->commit_rd(bufs);
+	*ts += len;
+
+	return true;
+}
+
+/* Copy the next span out of the source history, false if there is none */
+bool sample_recorder::feed_history(int64_t *ts)
+{
+	int64_t head = dev->get_ts_high();
+	if (*ts >= head)
+		return false;
+
+	size_t len = std::min<int64_t>(head - *ts, RECORD_FEED_LEN);
+
+	if (dev->lookback(feed_ptrs, len, *ts) < 0) {
+		int64_t start = dev->get_ts_history();
+		if (start <= *ts)
+			return false;
+
+		*ts = start;
+		return true;
+	}
+
+	push(feed_ptrs, len, *ts);
+	*ts += len;
+
+	return true;
+}
+
+/* Record until stopped, then drain the samples received so far */
+void sample_recorder::feeder()
+{
+	std::vector<short *> bufs(meta.chans);
+	int64_t ts = ring ? 0 : dev->get_ts_high();
+
+	for (;;) {
+		bool run = following.load();
+		bool fed = ring ? feed_ring(bufs, &ts) : feed_history(&ts);
+
+		if (fed)
+			continue;
+		if (!run)
+			break;
+
+		std::this_thread::sleep_for(std::chrono::microseconds(RECORD_POLL_USEC));
+	}
+}
+
+bool sample_recorder::write_block(const char *buf, size_t len)
+{
+	/* Trailing partial block cannot be written with O_DIRECT */
+	if (direct && (len % RECORD_BLOCK_ALIGN)) {
+		int flags = fcntl(fd, F_GETFL);
+		fcntl(fd, F_SETFL, flags & ~O_DIRECT);
+		direct = false;
+	}
+
+	while (len) {
+		ssize_t rc = ::write(fd, buf, len);
+		if (rc < 0) {
+			if (errno == EINTR)
+				continue;
+			return false;
+		}
+
+		buf += rc;
+		len -= rc;
+	}
+
+	return true;
+}
+
+/*
+ * Pack a raw block into the recording format. Block floating point blocks
+ * are completed with zeros, which adds at most one block of trailing
+ * samples beyond the recorded sample count.
+ */
+const char *sample_recorder::pack_block(char *buf, size_t *len)
+{
+	size_t num = *len / sizeof(int16_t);
+
+	switch (meta.format) {
+	case FORMAT_SC12:
+		convert_short_sc12((uint8_t *) pack_buf, (short *) buf, num);
+		*len = num / 2 * 3;
+		break;
+	case FORMAT_BFP8:
+		if (num % CONVERT_BFP8_LEN) {
+			size_t pad = CONVERT_BFP8_LEN - num % CONVERT_BFP8_LEN;
+			memset(buf + *len, 0, pad * sizeof(int16_t));
+			num += pad;
+		}
+
+		convert_short_bfp8((uint8_t *) pack_buf, (short *) buf, num);
+		*len = num / CONVERT_BFP8_LEN * CONVERT_BFP8_BLK;
+		break;
+	case FORMAT_SC8:
+		convert_short_sc8((int8_t *) pack_buf, (short *) buf, num);
+		*len = num;
+		break;
+	default:
+		return buf;
+	}
+
+	return pack_buf;
+}
+
+void sample_recorder::writer()
+{
+	std::unique_lock<std::mutex> lock(mutex);
+
+	for (;;) {
+		cond.wait(lock, [this] {
+			return !full_blocks.empty() || !running;
+		});
+
+		if (full_blocks.empty())
+			break;
+
+		std::pair<char *, size_t> blk = full_blocks.front();
+		full_blocks.pop_front();
+
+		lock.unlock();
+		size_t len = blk.second;
+		const char *buf = pack_block(blk.first, &len);
+		bool ok = write_block(buf, len);
+		lock.lock();
+
+		if (!ok)
+			write_errors++;
+
+		free_blocks.push_back(blk.first);
+	}
+}
@@ -0,0 +1,122 @@
+#ifndef _LTE_RECORD_H_
+#define _LTE_RECORD_H_
+
+#include <stdint.h>
+#include <vector>
+#include <deque>
+#include <string>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <condition_variable>
+
+#include "openphy/io.h"
+
+class radio_dev;
+class ts_buffer;
+class ts_reader;
+
+/* Block size satisfies O_DIRECT on common filesystems */
+#define RECORD_BLOCK_LEN	(1 << 20)
+
+/* Roughly 0.7 seconds of two channel 20 MHz samples in flight */
+#define RECORD_NUM_BLOCKS	128
+
+/* Capture parameters stored alongside the sample file */
+struct record_meta {
+	double rate;
+	double freq;
+	double gain;
+	int rbs;
+	size_t chans;
+	enum sample_format format;
+};
+
+const char *sample_format_str(enum sample_format format);
+bool sample_format_parse(const std::string &str, enum sample_format *format);
+
+/* Format recorded in the metadata file, sc16 if there is none */
+enum sample_format record_read_format(const std::string &path);
+
+/*
+ * Raw sample recorder
+ *
+ * Timestamped sc16 windows handed to push() are interleaved per sample into
+ * the same layout read by file replay and collected in fixed size blocks. A
+ * background thread packs full blocks into the recording format and writes
+ * them to disk. The caller never waits on the disk; if every block is in
+ * flight, samples are dropped and counted.
+ *
+ * Overlapping windows are recorded once and gaps between windows are zero
+ * filled so that file offsets remain aligned with time. Short recordings
+ * may use fewer blocks than the default pool of RECORD_NUM_BLOCKS.
+ *
+ * A recorder can instead follow the contiguous stream of a source on its
+ * own thread with follow(), which records every sample delivered by the
+ * source rather than windows chosen by a consumer.
+ */
+class sample_recorder {
+public:
+	sample_recorder(const record_meta &meta,
+			size_t num_blocks = RECORD_NUM_BLOCKS);
+	~sample_recorder();
+
+	bool open(const std::string &path);
+	void close();
+
+	bool direct_io() const { return direct; }
+
+	void push(const std::vector<short *> &bufs, size_t len, int64_t ts);
+	bool follow(radio_dev *dev);
+
+private:
+	void feeder();
+	bool feed_ring(std::vector<short *> &bufs, int64_t *ts);
+	bool feed_history(int64_t *ts);
+	void count_gaps(int64_t ts, size_t len);
+	void append(const std::vector<short *> *bufs, size_t offset, size_t len);
+	void queue_block();
+	void writer();
+	bool write_block(const char *buf, size_t len);
+	const char *pack_block(char *buf, size_t *len);
+	bool write_meta();
+
+	record_meta meta;
+	size_t num_blocks;
+	std::string path;
+	int fd;
+	bool direct;
+
+	/* Producer state */
+	char *block;
+	size_t block_fill;
+	int64_t start_ts;
+	int64_t next_ts;
+	uint64_t samples;
+	uint64_t gap_samples;
+	uint64_t drop_samples;
+
+	/* Followed source, read from the feeder thread */
+	radio_dev *dev;
+	ts_buffer *ring;
+	ts_reader *reader;
+	std::vector<std::vector<short> > feed_bufs;
+	std::vector<short *> feed_ptrs;
+	std::deque<std::pair<int64_t, int64_t> > feed_gaps;
+	std::atomic<bool> following;
+	std::thread feed_thread;
+
+	/* Shared with the writer thread */
+	std::vector<char *> free_blocks;
+	std::deque<std::pair<char *, size_t> > full_blocks;
+	std::vector<char *> blocks;
+	char *pack_buf;
+	uint64_t write_errors;
+	bool running;
+
+	std::mutex mutex;
+	std::condition_variable cond;
+	std::thread thread;
+};
+
+#endif /* _LTE_RECORD_H_ */
@@ -19,6 +19,7 @@
  */
 
 #include <malloc.h>
+#include <limits.h>
 #include <string.h>
 #include "convert.h"
 
@@ -219,3 +220,332 @@ void convert_short_float(float *out, short *in, int len, float scale)
 	convert_scale_si16_ps(out, in, len, scale);
 #endif
 }
+
+/*
+ * Bit-packed 12-bit samples
+ *
+ * Keeps the 12 most significant bits of each 16-bit value, which is exact
+ * for 12-bit converter samples left justified in sc16. Each pair of values
+ * packs little endian into three bytes.
+ */
+static void pack_sc12(uint8_t *restrict out, const short *restrict in, int len)
+{
+	for (int i = 0; i < len / 2; i++) {
+		unsigned u0 = ((unsigned short) in[2 * i + 0]) >> 4;
+		unsigned u1 = ((unsigned short) in[2 * i + 1]) >> 4;
+
+		out[3 * i + 0] = u0;
+		out[3 * i + 1] = (u0 >> 8) | (u1 << 4);
+		out[3 * i + 2] = u1 >> 4;
+	}
+}
+
+static void unpack_sc12(short *restrict out, const uint8_t *restrict in, int len)
+{
+	for (int i = 0; i < len / 2; i++) {
+		const uint8_t *b = &in[3 * i];
+
+		out[2 * i + 0] = (short) ((b[1] & 0x0f) << 12 | b[0] << 4);
+		out[2 * i + 1] = (short) (b[2] << 8 | (b[1] & 0xf0));
+	}
+}
+
+#ifdef HAVE_SSSE3
+#include <tmmintrin.h>
+
+/* 8*N values packed into 12*N bytes */
+static void _ssse3_pack_sc12_8n(uint8_t *restrict out,
+				const short *restrict in, int len)
+{
+	__m128i m0, m1, m2;
+	__m128i mask = _mm_set1_epi32(0x00fff000);
+	__m128i shuf = _mm_setr_epi8(0, 1, 2, 4, 5, 6, 8, 9,
+				     10, 12, 13, 14, -1, -1, -1, -1);
+
+	for (int i = 0; i < len / 8; i++) {
+		m0 = _mm_loadu_si128((__m128i *) &in[8 * i]);
+
+		/* First value of each pair in the low 12 bits */
+		m1 = _mm_srli_epi32(_mm_slli_epi32(m0, 16), 20);
+
+		/* Second value in the next 12 bits */
+		m2 = _mm_and_si128(_mm_srli_epi32(m0, 8), mask);
+
+		/* Compact 24-bit lanes and store 12 bytes */
+		m0 = _mm_shuffle_epi8(_mm_or_si128(m1, m2), shuf);
+		_mm_storel_epi64((__m128i *) &out[12 * i], m0);
+		*(int32_t *) &out[12 * i + 8] =
+			_mm_cvtsi128_si32(_mm_srli_si128(m0, 8));
+	}
+}
+
+/* 8*N values unpacked from 12*N bytes with 16 byte loads */
+static void _ssse3_unpack_sc12_8n(short *restrict out,
+				  const uint8_t *restrict in, int len)
+{
+	__m128i m0, m1, m2;
+	__m128i lo = _mm_set1_epi32(0x0000ffff);
+	__m128i hi = _mm_set1_epi32(0xfff00000);
+	__m128i shuf = _mm_setr_epi8(0, 1, 1, 2, 3, 4, 4, 5,
+				     6, 7, 7, 8, 9, 10, 10, 11);
+
+	for (int i = 0; i < len / 8; i++) {
+		m0 = _mm_loadu_si128((__m128i *) &in[12 * i]);
+		m0 = _mm_shuffle_epi8(m0, shuf);
+
+		/* Bytes 0-1 of each triplet shift up, bytes 1-2 mask low */
+		m1 = _mm_and_si128(_mm_slli_epi16(m0, 4), lo);
+		m2 = _mm_and_si128(m0, hi);
+
+		_mm_storeu_si128((__m128i *) &out[8 * i], _mm_or_si128(m1, m2));
+	}
+}
+#endif /* HAVE_SSSE3 */
+
+void convert_short_sc12(uint8_t *out, const short *in, int len)
+{
+	int start = 0;
+
+#ifdef HAVE_SSSE3
+	start = len / 8 * 8;
+	_ssse3_pack_sc12_8n(out, in, start);
+#endif
+	pack_sc12(out + start / 2 * 3, in + start, len - start);
+}
+
+void convert_sc12_short(short *out, const uint8_t *in, int len)
+{
+	int start = 0;
+
+#ifdef HAVE_SSSE3
+	/* Keep the last 16 byte load within the input */
+	if (len > 8)
+		start = (len - 3) / 8 * 8;
+	_ssse3_unpack_sc12_8n(out, in, start);
+#endif
+	unpack_sc12(out + start, in + start / 2 * 3, len - start);
+}
+
+/*
+ * Block floating point 8-bit samples
+ *
+ * Each block of CONVERT_BFP8_LEN values is stored as a shift count byte
+ * followed by the values rounded to 8 bits after the shift. The shift is
+ * the smallest that fits the largest magnitude in the block.
+ */
+static int bfp8_shift(int max)
+{
+	int bits = max ? 32 - __builtin_clz(max) : 0;
+
+	return bits > 7 ? bits - 7 : 0;
+}
+
+#ifndef HAVE_SSE3
+static void pack_bfp8(uint8_t *restrict out, const short *restrict in)
+{
+	int max = 0;
+
+	for (int i = 0; i < CONVERT_BFP8_LEN; i++) {
+		int val = in[i] < 0 ? -in[i] : in[i];
+		if (val > max)
+			max = val;
+	}
+
+	int shift = bfp8_shift(max);
+	int round = shift ? 1 << (shift - 1) : 0;
+
+	/*
+	 * Saturate as the SSE path does. Unpacked values must also fit in
+	 * 16 bits, which limits a block holding -32768 to [-64, 63].
+	 */
+	int hi = shift > 8 ? SHRT_MAX >> shift : 127;
+
+	out[0] = shift;
+
+	for (int i = 0; i < CONVERT_BFP8_LEN; i++) {
+		int val = (in[i] + round) >> shift;
+		if (val > hi)
+			val = hi;
+		else if (val < -hi - 1)
+			val = -hi - 1;
+
+		out[i + 1] = (int8_t) val;
+	}
+}
+
+static void unpack_bfp8(short *restrict out, const uint8_t *restrict in)
+{
+	int shift = in[0];
+
+	for (int i = 0; i < CONVERT_BFP8_LEN; i++)
+		out[i] = (short) ((int8_t) in[i + 1] * (1 << shift));
+}
+#endif
+
+#ifdef HAVE_SSE3
+static void _sse_pack_bfp8(uint8_t *restrict out, const short *restrict in)
+{
+	__m128i m0, m1, m2, m3, max, min;
+
+	max = min = _mm_loadu_si128((__m128i *) in);
+	for (int i = 1; i < CONVERT_BFP8_LEN / 8; i++) {
+		m0 = _mm_loadu_si128((__m128i *) &in[8 * i]);
+		max = _mm_max_epi16(max, m0);
+		min = _mm_min_epi16(min, m0);
+	}
+
+	/* Horizontal reduction */
+	max = _mm_max_epi16(max, _mm_srli_si128(max, 8));
+	min = _mm_min_epi16(min, _mm_srli_si128(min, 8));
+	max = _mm_max_epi16(max, _mm_srli_si128(max, 4));
+	min = _mm_min_epi16(min, _mm_srli_si128(min, 4));
+	max = _mm_max_epi16(max, _mm_srli_si128(max, 2));
+	min = _mm_min_epi16(min, _mm_srli_si128(min, 2));
+
+	int hi = (short) _mm_cvtsi128_si32(max);
+	int lo = (short) _mm_cvtsi128_si32(min);
+	int shift = bfp8_shift(hi > -lo ? hi : -lo);
+
+	m1 = _mm_set1_epi16(shift ? 1 << (shift - 1) : 0);
+	m2 = _mm_cvtsi32_si128(shift);
+
+	out[0] = shift;
+
+	/* Round, shift and saturate to 8 bits */
+	for (int i = 0; i < CONVERT_BFP8_LEN / 16; i++) {
+		m0 = _mm_loadu_si128((__m128i *) &in[16 * i + 0]);
+		m3 = _mm_loadu_si128((__m128i *) &in[16 * i + 8]);
+
+		m0 = _mm_sra_epi16(_mm_adds_epi16(m0, m1), m2);
+		m3 = _mm_sra_epi16(_mm_adds_epi16(m3, m1), m2);
+
+		_mm_storeu_si128((__m128i *) &out[16 * i + 1],
+				 _mm_packs_epi16(m0, m3));
+	}
+}
+
+static void _sse_unpack_bfp8(short *restrict out, const uint8_t *restrict in)
+{
+	__m128i m0, m1, m2;
+	__m128i shift = _mm_cvtsi32_si128(in[0]);
+	__m128i zero = _mm_setzero_si128();
+
+	for (int i = 0; i < CONVERT_BFP8_LEN / 16; i++) {
+		m0 = _mm_loadu_si128((__m128i *) &in[16 * i + 1]);
+
+		/* Sign extend through the high byte and apply the shift */
+		m1 = _mm_srai_epi16(_mm_unpacklo_epi8(zero, m0), 8);
+		m2 = _mm_srai_epi16(_mm_unpackhi_epi8(zero, m0), 8);
+
+		_mm_storeu_si128((__m128i *) &out[16 * i + 0],
+				 _mm_sll_epi16(m1, shift));
+		_mm_storeu_si128((__m128i *) &out[16 * i + 8],
+				 _mm_sll_epi16(m2, shift));
+	}
+}
+#endif /* HAVE_SSE3 */
+
+/* Length in values must be a multiple of CONVERT_BFP8_LEN */
+void convert_short_bfp8(uint8_t *out, const short *in, int len)
+{
+	for (int i = 0; i < len / CONVERT_BFP8_LEN; i++) {
+#ifdef HAVE_SSE3
+		_sse_pack_bfp8(&out[CONVERT_BFP8_BLK * i],
+			       &in[CONVERT_BFP8_LEN * i]);
+#else
+		pack_bfp8(&out[CONVERT_BFP8_BLK * i], &in[CONVERT_BFP8_LEN * i]);
+#endif
+	}
+}
+
+void convert_bfp8_short(short *out, const uint8_t *in, int len)
+{
+	for (int i = 0; i < len / CONVERT_BFP8_LEN; i++) {
+#ifdef HAVE_SSE3
+		_sse_unpack_bfp8(&out[CONVERT_BFP8_LEN * i],
+				 &in[CONVERT_BFP8_BLK * i]);
+#else
+		unpack_bfp8(&out[CONVERT_BFP8_LEN * i], &in[CONVERT_BFP8_BLK * i]);
+#endif
+	}
+}
+
+/*
+ * 8-bit samples
+ *
+ * Values are the rounded high byte of the 16-bit value, matching the sc8
+ * device wire format, and are widened back to the 16-bit scale on unpack.
+ */
+static void pack_sc8(int8_t *restrict out, const short *restrict in, int len)
+{
+	for (int i = 0; i < len; i++) {
+		int val = (in[i] + 128) >> 8;
+		if (val > 127)
+			val = 127;
+
+		out[i] = val;
+	}
+}
+
+static void unpack_sc8(short *restrict out, const int8_t *restrict in, int len)
+{
+	for (int i = 0; i < len; i++)
+		out[i] = (short) (in[i] * 256);
+}
+
+#ifdef HAVE_SSE3
+static void _sse_pack_sc8_16n(int8_t *restrict out,
+			      const short *restrict in, int len)
+{
+	__m128i m0, m1, round = _mm_set1_epi16(128);
+
+	for (int i = 0; i < len / 16; i++) {
+		m0 = _mm_loadu_si128((__m128i *) &in[16 * i + 0]);
+		m1 = _mm_loadu_si128((__m128i *) &in[16 * i + 8]);
+
+		m0 = _mm_srai_epi16(_mm_adds_epi16(m0, round), 8);
+		m1 = _mm_srai_epi16(_mm_adds_epi16(m1, round), 8);
+
+		_mm_storeu_si128((__m128i *) &out[16 * i],
+				 _mm_packs_epi16(m0, m1));
+	}
+}
+
+/* Interleaving below a zero byte places each value in the high byte */
+static void _sse_unpack_sc8_16n(short *restrict out,
+				const int8_t *restrict in, int len)
+{
+	__m128i m0, zero = _mm_setzero_si128();
+
+	for (int i = 0; i < len / 16; i++) {
+		m0 = _mm_loadu_si128((__m128i *) &in[16 * i]);
+
+		_mm_storeu_si128((__m128i *) &out[16 * i + 0],
+				 _mm_unpacklo_epi8(zero, m0));
+		_mm_storeu_si128((__m128i *) &out[16 * i + 8],
+				 _mm_unpackhi_epi8(zero, m0));
+	}
+}
+#endif /* HAVE_SSE3 */
+
+void convert_short_sc8(int8_t *out, const short *in, int len)
+{
+	int start = 0;
+
+#ifdef HAVE_SSE3
+	start = len / 16 * 16;
+	_sse_pack_sc8_16n(out, in, start);
+#endif
+	pack_sc8(out + start, in + start, len - start);
+}
+
+void convert_sc8_short(short *out, const int8_t *in, int len)
+{
+	int start = 0;
+
+#ifdef HAVE_SSE3
+	start = len / 16 * 16;
+	_sse_unpack_sc8_16n(out, in, start);
+#endif
+	unpack_sc8(out + start, in + start, len - start);
+}
@@ -1,7 +1,21 @@
 #ifndef CONVERT_H
 #define CONVERT_H
 
+#include <stdint.h>
+
+/* Values per block and bytes per block of block floating point samples */
+#define CONVERT_BFP8_LEN	64
+#define CONVERT_BFP8_BLK	(CONVERT_BFP8_LEN + 1)
+
 void convert_float_short(short *out, float *in, float scale, int len);
 void convert_short_float(float *out, short *in, int len, float scale);
 
+/* Compressed sample packing, lengths count 16-bit values */
+void convert_short_sc12(uint8_t *out, const short *in, int len);
+void convert_sc12_short(short *out, const uint8_t *in, int len);
+void convert_short_bfp8(uint8_t *out, const short *in, int len);
+void convert_bfp8_short(short *out, const uint8_t *in, int len);
+void convert_short_sc8(int8_t *out, const short *in, int len);
+void convert_sc8_short(short *out, const int8_t *in, int len);
+
 #endif /* CONVERT_H */
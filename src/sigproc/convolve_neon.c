@@ -189,6 +189,90 @@ int single_convolve(complex float *restrict in,
 	return 1;
 }
 
+/*! \brief Decimating convolution
+ *  \param[in] in Pointer to complex input sample of the first output
+ *  \param[in] h Complex vector filter taps
+ *  \param[out] out Pointer to complex output samples
+ *  \param[in] len Number of output samples
+ *  \param[in] decim Input samples per output sample
+ *
+ * Computes only the retained outputs of a filter followed by decimation.
+ */
+int decim_convolve(const float *in, const struct cxvec *h_vec,
+		   float *out, int len, int decim)
+{
+	for (int i = 0; i < len; i++) {
+		single_convolve((complex float *) &in[2 * i * decim],
+				(struct cxvec *) h_vec,
+				(complex float *) &out[2 * i]);
+	}
+
+	return len;
+}
+
+/*! \brief Decimating convolution of sc16 input
+ *  \param[in] in Pointer to sc16 input sample of the first output
+ *  \param[in] h Complex vector filter taps
+ *  \param[out] out Pointer to complex output samples
+ *  \param[in] len Number of output samples
+ *  \param[in] decim Input samples per output sample
+ *  \param[in] scale Output scaling
+ */
+int decim_convolve_short(const short *in, const struct cxvec *h_vec,
+			 float *out, int len, int decim, float scale)
+{
+	const float *h = (const float *) h_vec->data;
+	int h_len = h_vec->len;
+
+	for (int i = 0; i < len; i++) {
+		const short *x = &in[2 * (i * decim - (h_len - 1))];
+		float a = 0.0f, b = 0.0f;
+
+		for (int n = 0; n < h_len; n++) {
+			a += x[2 * n + 0] * h[2 * n];
+			b += x[2 * n + 1] * h[2 * n];
+		}
+
+		out[2 * i + 0] = a * scale;
+		out[2 * i + 1] = b * scale;
+	}
+
+	return len;
+}
+
+/*! \brief Half-band filter and decimation by two
+ *  \param[in] in Pointer to complex input sample of the first output
+ *  \param[in] h Real taps of one half of the filter, innermost first
+ *  \param[in] h_len Number of taps in 'h'
+ *  \param[in] center Center tap
+ *  \param[out] out Pointer to complex output samples
+ *  \param[in] len Number of output samples
+ */
+int halfband_convolve(const float *in, const float *h, int h_len,
+		      float center, float *out, int len)
+{
+	int c = 2 * h_len - 1;
+
+	for (int i = 0; i < len; i++) {
+		const float *x = &in[4 * i];
+		float a = center * x[-2 * c + 0];
+		float b = center * x[-2 * c + 1];
+
+		for (int n = 0; n < h_len; n++) {
+			const float *x0 = &x[2 * (2 * n + 1 - c)];
+			const float *x1 = &x[-2 * (2 * n + 1 + c)];
+
+			a += h[n] * (x0[0] + x1[0]);
+			b += h[n] * (x0[1] + x1[1]);
+		}
+
+		out[2 * i + 0] = a;
+		out[2 * i + 1] = b;
+	}
+
+	return len;
+}
+
 static int check_params(struct cxvec *in,
 			struct cxvec *h, struct cxvec *out)
 {
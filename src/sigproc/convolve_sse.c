@@ -707,3 +707,513 @@ int single_convolve(const float *in,
 
 	return 1;
 }
+
+#if defined(__AVX512F__)
+/*
+ * Decimating AVX-512 complex-real convolution
+ *
+ * Four outputs are accumulated together so that each block of eight taps is
+ * loaded and expanded once and shared between the outputs. Taps are stored
+ * as complex values with zero imaginary parts, and duplicating the real
+ * parts lets the taps multiply interleaved I/Q input directly.
+ */
+static float complex sum_iq512(__m512 acc)
+{
+	__m256 lo = _mm512_castps512_ps256(acc);
+	__m256 hi = _mm256_castpd_ps(_mm512_extractf64x4_pd(_mm512_castps_pd(acc), 1));
+	__m256 m0 = _mm256_add_ps(lo, hi);
+	__m128 m1 = _mm_add_ps(_mm256_castps256_ps128(m0),
+			       _mm256_extractf128_ps(m0, 1));
+
+	m1 = _mm_add_ps(m1, _mm_movehl_ps(m1, m1));
+
+	return m1[0] + I * m1[1];
+}
+
+static void conv_real_decim(const float *x, const float *h, float *y,
+			    int h_len, int len, int decim)
+{
+	int i = 0, d = 2 * decim;
+	__m512 m0, m1, m2, m3, m4;
+
+	for (; i + 4 <= len; i += 4) {
+		const float *_x = &x[i * d];
+
+		m1 = m2 = m3 = m4 = _mm512_setzero_ps();
+
+		for (int n = 0; n < 2 * h_len; n += 16) {
+			m0 = _mm512_moveldup_ps(_mm512_loadu_ps(&h[n]));
+
+			m1 = _mm512_fmadd_ps(_mm512_loadu_ps(&_x[n + 0 * d]), m0, m1);
+			m2 = _mm512_fmadd_ps(_mm512_loadu_ps(&_x[n + 1 * d]), m0, m2);
+			m3 = _mm512_fmadd_ps(_mm512_loadu_ps(&_x[n + 2 * d]), m0, m3);
+			m4 = _mm512_fmadd_ps(_mm512_loadu_ps(&_x[n + 3 * d]), m0, m4);
+		}
+
+		((float complex *) y)[i + 0] = sum_iq512(m1);
+		((float complex *) y)[i + 1] = sum_iq512(m2);
+		((float complex *) y)[i + 2] = sum_iq512(m3);
+		((float complex *) y)[i + 3] = sum_iq512(m4);
+	}
+
+	for (; i < len; i++) {
+		m1 = _mm512_setzero_ps();
+
+		for (int n = 0; n < 2 * h_len; n += 16) {
+			m0 = _mm512_moveldup_ps(_mm512_loadu_ps(&h[n]));
+			m1 = _mm512_fmadd_ps(_mm512_loadu_ps(&x[i * d + n]), m0, m1);
+		}
+
+		((float complex *) y)[i] = sum_iq512(m1);
+	}
+}
+
+#define DECIM_TAP_BLK		8
+#elif defined(__AVX__) && defined(__FMA__)
+/*
+ * Decimating AVX complex-real convolution
+ *
+ * Four outputs are accumulated together so that each block of four taps is
+ * loaded and expanded once and shared between the outputs. Taps are stored
+ * as complex values with zero imaginary parts, and duplicating the real
+ * parts lets the taps multiply interleaved I/Q input directly.
+ */
+static float complex sum_iq256(__m256 acc)
+{
+	__m128 m0 = _mm_add_ps(_mm256_castps256_ps128(acc),
+			       _mm256_extractf128_ps(acc, 1));
+
+	m0 = _mm_add_ps(m0, _mm_movehl_ps(m0, m0));
+
+	return m0[0] + I * m0[1];
+}
+
+static void conv_real_decim(const float *x, const float *h, float *y,
+			    int h_len, int len, int decim)
+{
+	int i = 0, d = 2 * decim;
+	__m256 m0, m1, m2, m3, m4;
+
+	for (; i + 4 <= len; i += 4) {
+		const float *_x = &x[i * d];
+
+		m1 = m2 = m3 = m4 = _mm256_setzero_ps();
+
+		for (int n = 0; n < 2 * h_len; n += 8) {
+			m0 = _mm256_moveldup_ps(_mm256_loadu_ps(&h[n]));
+
+			m1 = _mm256_fmadd_ps(_mm256_loadu_ps(&_x[n + 0 * d]), m0, m1);
+			m2 = _mm256_fmadd_ps(_mm256_loadu_ps(&_x[n + 1 * d]), m0, m2);
+			m3 = _mm256_fmadd_ps(_mm256_loadu_ps(&_x[n + 2 * d]), m0, m3);
+			m4 = _mm256_fmadd_ps(_mm256_loadu_ps(&_x[n + 3 * d]), m0, m4);
+		}
+
+		((float complex *) y)[i + 0] = sum_iq256(m1);
+		((float complex *) y)[i + 1] = sum_iq256(m2);
+		((float complex *) y)[i + 2] = sum_iq256(m3);
+		((float complex *) y)[i + 3] = sum_iq256(m4);
+	}
+
+	for (; i < len; i++) {
+		m1 = _mm256_setzero_ps();
+
+		for (int n = 0; n < 2 * h_len; n += 8) {
+			m0 = _mm256_moveldup_ps(_mm256_loadu_ps(&h[n]));
+			m1 = _mm256_fmadd_ps(_mm256_loadu_ps(&x[i * d + n]), m0, m1);
+		}
+
+		((float complex *) y)[i] = sum_iq256(m1);
+	}
+}
+
+#define DECIM_TAP_BLK		4
+#endif
+
+/*! \brief Decimating convolution
+ *  \param[in] in Pointer to complex input sample of the first output
+ *  \param[in] h Complex vector filter taps
+ *  \param[out] out Pointer to complex output samples
+ *  \param[in] len Number of output samples
+ *  \param[in] decim Input samples per output sample
+ *
+ * Computes only the retained outputs of a filter followed by decimation.
+ * Output 'i' is the single output convolution at input sample 'i * decim'.
+ * AVX-512 or AVX2 FMA builds compute several outputs per pass over the
+ * taps, otherwise outputs are computed one at a time.
+ */
+int decim_convolve(const float *in, const struct cxvec *h_vec,
+		   float *out, int len, int decim)
+{
+	const float complex *_in = (const float complex *) in;
+	float complex *_out = (float complex *) out;
+
+	if (!(h_vec->flags & (CXVEC_FLG_REAL_ONLY | CXVEC_FLG_MEM_ALIGN))) {
+		fprintf(stderr, "convolve: Taps must be real and aligned\n");
+		return -1;
+	}
+
+#ifdef DECIM_TAP_BLK
+	if (!(h_vec->len % DECIM_TAP_BLK)) {
+		conv_real_decim((const float *) &_in[-(h_vec->len - 1)],
+				(const float *) h_vec->data,
+				out, h_vec->len, len, decim);
+		return len;
+	}
+#endif
+	for (int i = 0; i < len; i++)
+		single_convolve((const float *) &_in[i * decim], h_vec,
+				(float *) &_out[i]);
+
+	return len;
+}
+
+/* Generic decimating convolution of sc16 input */
+static void conv_short_decim_generic(const short *x, const float *h,
+				     float *y, int h_len, int len,
+				     int decim, float scale)
+{
+	for (int i = 0; i < len; i++) {
+		const short *_x = &x[2 * i * decim];
+		float a = 0.0f, b = 0.0f;
+
+		for (int n = 0; n < h_len; n++) {
+			a += _x[2 * n + 0] * h[2 * n];
+			b += _x[2 * n + 1] * h[2 * n];
+		}
+
+		y[2 * i + 0] = a * scale;
+		y[2 * i + 1] = b * scale;
+	}
+}
+
+#if defined(__AVX512F__)
+/* Widen eight sc16 samples to interleaved I/Q floats */
+static inline __m512 load_short512(const short *x)
+{
+	__m256i m0 = _mm256_loadu_si256((const __m256i *) x);
+
+	return _mm512_cvtepi32_ps(_mm512_cvtepi16_epi32(m0));
+}
+
+/*
+ * Decimating AVX-512 convolution of sc16 input
+ *
+ * Same structure as the float kernel with the input widened in registers,
+ * so sc16 samples are filtered without a converted copy in memory.
+ */
+static void conv_short_decim(const short *x, const float *h, float *y,
+			     int h_len, int len, int decim, float scale)
+{
+	int i = 0, d = 2 * decim;
+	__m512 m0, m1, m2, m3, m4;
+
+	for (; i + 4 <= len; i += 4) {
+		const short *_x = &x[i * d];
+
+		m1 = m2 = m3 = m4 = _mm512_setzero_ps();
+
+		for (int n = 0; n < 2 * h_len; n += 16) {
+			m0 = _mm512_moveldup_ps(_mm512_loadu_ps(&h[n]));
+
+			m1 = _mm512_fmadd_ps(load_short512(&_x[n + 0 * d]), m0, m1);
+			m2 = _mm512_fmadd_ps(load_short512(&_x[n + 1 * d]), m0, m2);
+			m3 = _mm512_fmadd_ps(load_short512(&_x[n + 2 * d]), m0, m3);
+			m4 = _mm512_fmadd_ps(load_short512(&_x[n + 3 * d]), m0, m4);
+		}
+
+		((float complex *) y)[i + 0] = sum_iq512(m1) * scale;
+		((float complex *) y)[i + 1] = sum_iq512(m2) * scale;
+		((float complex *) y)[i + 2] = sum_iq512(m3) * scale;
+		((float complex *) y)[i + 3] = sum_iq512(m4) * scale;
+	}
+
+	for (; i < len; i++) {
+		m1 = _mm512_setzero_ps();
+
+		for (int n = 0; n < 2 * h_len; n += 16) {
+			m0 = _mm512_moveldup_ps(_mm512_loadu_ps(&h[n]));
+			m1 = _mm512_fmadd_ps(load_short512(&x[i * d + n]), m0, m1);
+		}
+
+		((float complex *) y)[i] = sum_iq512(m1) * scale;
+	}
+}
+
+#define DECIM_SHORT_BLK		8
+#elif defined(__AVX2__) && defined(__FMA__)
+/* Widen four sc16 samples to interleaved I/Q floats */
+static inline __m256 load_short256(const short *x)
+{
+	__m128i m0 = _mm_loadu_si128((const __m128i *) x);
+
+	return _mm256_cvtepi32_ps(_mm256_cvtepi16_epi32(m0));
+}
+
+/*
+ * Decimating AVX2 convolution of sc16 input
+ *
+ * Same structure as the float kernel with the input widened in registers,
+ * so sc16 samples are filtered without a converted copy in memory.
+ */
+static void conv_short_decim(const short *x, const float *h, float *y,
+			     int h_len, int len, int decim, float scale)
+{
+	int i = 0, d = 2 * decim;
+	__m256 m0, m1, m2, m3, m4;
+
+	for (; i + 4 <= len; i += 4) {
+		const short *_x = &x[i * d];
+
+		m1 = m2 = m3 = m4 = _mm256_setzero_ps();
+
+		for (int n = 0; n < 2 * h_len; n += 8) {
+			m0 = _mm256_moveldup_ps(_mm256_loadu_ps(&h[n]));
+
+			m1 = _mm256_fmadd_ps(load_short256(&_x[n + 0 * d]), m0, m1);
+			m2 = _mm256_fmadd_ps(load_short256(&_x[n + 1 * d]), m0, m2);
+			m3 = _mm256_fmadd_ps(load_short256(&_x[n + 2 * d]), m0, m3);
+			m4 = _mm256_fmadd_ps(load_short256(&_x[n + 3 * d]), m0, m4);
+		}
+
+		((float complex *) y)[i + 0] = sum_iq256(m1) * scale;
+		((float complex *) y)[i + 1] = sum_iq256(m2) * scale;
+		((float complex *) y)[i + 2] = sum_iq256(m3) * scale;
+		((float complex *) y)[i + 3] = sum_iq256(m4) * scale;
+	}
+
+	for (; i < len; i++) {
+		m1 = _mm256_setzero_ps();
+
+		for (int n = 0; n < 2 * h_len; n += 8) {
+			m0 = _mm256_moveldup_ps(_mm256_loadu_ps(&h[n]));
+			m1 = _mm256_fmadd_ps(load_short256(&x[i * d + n]), m0, m1);
+		}
+
+		((float complex *) y)[i] = sum_iq256(m1) * scale;
+	}
+}
+
+#define DECIM_SHORT_BLK		4
+#endif
+
+/*! \brief Decimating convolution of sc16 input
+ *  \param[in] in Pointer to sc16 input sample of the first output
+ *  \param[in] h Complex vector filter taps
+ *  \param[out] out Pointer to complex output samples
+ *  \param[in] len Number of output samples
+ *  \param[in] decim Input samples per output sample
+ *  \param[in] scale Output scaling
+ *
+ * Same as decim_convolve() with widening and scaling of the input folded
+ * into the filter.
+ */
+int decim_convolve_short(const short *in, const struct cxvec *h_vec,
+			 float *out, int len, int decim, float scale)
+{
+	const short *x = &in[-2 * (h_vec->len - 1)];
+
+	if (!(h_vec->flags & (CXVEC_FLG_REAL_ONLY | CXVEC_FLG_MEM_ALIGN))) {
+		fprintf(stderr, "convolve: Taps must be real and aligned\n");
+		return -1;
+	}
+
+#ifdef DECIM_SHORT_BLK
+	if (!(h_vec->len % DECIM_SHORT_BLK)) {
+		conv_short_decim(x, (const float *) h_vec->data, out,
+				 h_vec->len, len, decim, scale);
+		return len;
+	}
+#endif
+	conv_short_decim_generic(x, (const float *) h_vec->data, out,
+				 h_vec->len, len, decim, scale);
+
+	return len;
+}
+
+/* Generic half-band decimation */
+static void conv_halfband_generic(const float *x, const float *h, int h_len,
+				  float center, float *y, int len)
+{
+	int c = 2 * h_len - 1;
+
+	for (int i = 0; i < len; i++) {
+		const float *_x = &x[4 * i];
+		float a = center * _x[-2 * c + 0];
+		float b = center * _x[-2 * c + 1];
+
+		for (int n = 0; n < h_len; n++) {
+			const float *x0 = &_x[2 * (2 * n + 1 - c)];
+			const float *x1 = &_x[-2 * (2 * n + 1 + c)];
+
+			a += h[n] * (x0[0] + x1[0]);
+			b += h[n] * (x0[1] + x1[1]);
+		}
+
+		y[2 * i + 0] = a;
+		y[2 * i + 1] = b;
+	}
+}
+
+#if defined(__AVX512F__)
+/*
+ * Gather eight complex samples at even offsets. Complex samples are moved
+ * as 64-bit pairs, so one permute across two vectors does the gather.
+ */
+static inline __m512 load_even512(const float *x)
+{
+	__m512i idx = _mm512_setr_epi64(0, 2, 4, 6, 8, 10, 12, 14);
+	__m512d m0 = _mm512_castps_pd(_mm512_loadu_ps(&x[0]));
+	__m512d m1 = _mm512_castps_pd(_mm512_loadu_ps(&x[16]));
+
+	return _mm512_castpd_ps(_mm512_permutex2var_pd(m0, idx, m1));
+}
+
+/*
+ * AVX-512 half-band decimation
+ *
+ * Vectors hold eight consecutive outputs, so each tap is a broadcast
+ * multiplied against even sample gathers and no horizontal sums are needed.
+ * Four vectors are accumulated together to cover the FMA latency.
+ */
+static void conv_halfband(const float *x, const float *h, int h_len,
+			  float center, float *y, int len)
+{
+	int i = 0, c = 2 * h_len - 1;
+	__m512 m0, m1, m2, m3, m4, m5;
+
+	for (; i + 32 <= len; i += 32) {
+		const float *_x = &x[4 * i];
+
+		m0 = _mm512_set1_ps(center);
+
+		m1 = _mm512_mul_ps(load_even512(&_x[-2 * c + 0]), m0);
+		m2 = _mm512_mul_ps(load_even512(&_x[-2 * c + 32]), m0);
+		m3 = _mm512_mul_ps(load_even512(&_x[-2 * c + 64]), m0);
+		m4 = _mm512_mul_ps(load_even512(&_x[-2 * c + 96]), m0);
+
+		for (int n = 0; n < h_len; n++) {
+			const float *x0 = &_x[2 * (2 * n + 1 - c)];
+			const float *x1 = &_x[-2 * (2 * n + 1 + c)];
+
+			m0 = _mm512_set1_ps(h[n]);
+
+			m5 = _mm512_add_ps(load_even512(&x0[0]),
+					   load_even512(&x1[0]));
+			m1 = _mm512_fmadd_ps(m5, m0, m1);
+			m5 = _mm512_add_ps(load_even512(&x0[32]),
+					   load_even512(&x1[32]));
+			m2 = _mm512_fmadd_ps(m5, m0, m2);
+			m5 = _mm512_add_ps(load_even512(&x0[64]),
+					   load_even512(&x1[64]));
+			m3 = _mm512_fmadd_ps(m5, m0, m3);
+			m5 = _mm512_add_ps(load_even512(&x0[96]),
+					   load_even512(&x1[96]));
+			m4 = _mm512_fmadd_ps(m5, m0, m4);
+		}
+
+		_mm512_storeu_ps(&y[2 * i + 0], m1);
+		_mm512_storeu_ps(&y[2 * i + 16], m2);
+		_mm512_storeu_ps(&y[2 * i + 32], m3);
+		_mm512_storeu_ps(&y[2 * i + 48], m4);
+	}
+
+	conv_halfband_generic(&x[4 * i], h, h_len, center,
+			      &y[2 * i], len - i);
+}
+
+#define HAVE_HALFBAND
+#elif defined(__AVX2__) && defined(__FMA__)
+/*
+ * Gather four complex samples at even offsets. Unpacking two vectors as
+ * 64-bit pairs leaves the even samples in lane order, which a cross-lane
+ * permute restores to sample order.
+ */
+static inline __m256 load_even256(const float *x)
+{
+	__m256d m0 = _mm256_castps_pd(_mm256_loadu_ps(&x[0]));
+	__m256d m1 = _mm256_castps_pd(_mm256_loadu_ps(&x[8]));
+
+	return _mm256_castpd_ps(_mm256_permute4x64_pd(_mm256_unpacklo_pd(m0, m1),
+						      _MM_SHUFFLE(3, 1, 2, 0)));
+}
+
+/*
+ * AVX2 half-band decimation
+ *
+ * Vectors hold four consecutive outputs, so each tap is a broadcast
+ * multiplied against even sample gathers and no horizontal sums are needed.
+ * Four vectors are accumulated together to cover the FMA latency.
+ */
+static void conv_halfband(const float *x, const float *h, int h_len,
+			  float center, float *y, int len)
+{
+	int i = 0, c = 2 * h_len - 1;
+	__m256 m0, m1, m2, m3, m4, m5;
+
+	for (; i + 16 <= len; i += 16) {
+		const float *_x = &x[4 * i];
+
+		m0 = _mm256_set1_ps(center);
+
+		m1 = _mm256_mul_ps(load_even256(&_x[-2 * c + 0]), m0);
+		m2 = _mm256_mul_ps(load_even256(&_x[-2 * c + 16]), m0);
+		m3 = _mm256_mul_ps(load_even256(&_x[-2 * c + 32]), m0);
+		m4 = _mm256_mul_ps(load_even256(&_x[-2 * c + 48]), m0);
+
+		for (int n = 0; n < h_len; n++) {
+			const float *x0 = &_x[2 * (2 * n + 1 - c)];
+			const float *x1 = &_x[-2 * (2 * n + 1 + c)];
+
+			m0 = _mm256_set1_ps(h[n]);
+
+			m5 = _mm256_add_ps(load_even256(&x0[0]),
+					   load_even256(&x1[0]));
+			m1 = _mm256_fmadd_ps(m5, m0, m1);
+			m5 = _mm256_add_ps(load_even256(&x0[16]),
+					   load_even256(&x1[16]));
+			m2 = _mm256_fmadd_ps(m5, m0, m2);
+			m5 = _mm256_add_ps(load_even256(&x0[32]),
+					   load_even256(&x1[32]));
+			m3 = _mm256_fmadd_ps(m5, m0, m3);
+			m5 = _mm256_add_ps(load_even256(&x0[48]),
+					   load_even256(&x1[48]));
+			m4 = _mm256_fmadd_ps(m5, m0, m4);
+		}
+
+		_mm256_storeu_ps(&y[2 * i + 0], m1);
+		_mm256_storeu_ps(&y[2 * i + 8], m2);
+		_mm256_storeu_ps(&y[2 * i + 16], m3);
+		_mm256_storeu_ps(&y[2 * i + 24], m4);
+	}
+
+	conv_halfband_generic(&x[4 * i], h, h_len, center,
+			      &y[2 * i], len - i);
+}
+
+#define HAVE_HALFBAND
+#endif
+
+/*! \brief Half-band filter and decimation by two
+ *  \param[in] in Pointer to complex input sample of the first output
+ *  \param[in] h Real taps of one half of the filter, innermost first
+ *  \param[in] h_len Number of taps in 'h'
+ *  \param[in] center Center tap
+ *  \param[out] out Pointer to complex output samples
+ *  \param[in] len Number of output samples
+ *
+ * The filter spans '4 * h_len - 1' input samples ending at 'in[2 * i]' for
+ * output 'i', so '4 * h_len - 2' samples of history must precede 'in'.
+ * Every other tap of a half-band filter is zero except the center tap, so
+ * only the even offsets from the newest sample are read. Symmetric taps are
+ * applied to the sum of their sample pairs.
+ */
+int halfband_convolve(const float *in, const float *h, int h_len,
+		      float center, float *out, int len)
+{
+#ifdef HAVE_HALFBAND
+	conv_halfband(in, h, h_len, center, out, len);
+#else
+	conv_halfband_generic(in, h, h_len, center, out, len);
+#endif
+	return len;
+}
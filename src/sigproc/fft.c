@@ -25,6 +25,7 @@
 
 #include "openphy/sigvec.h"
 #include "openphy/fft.h"
+#include "openphy/hugepage.h"
 #include "sigvec_internal.h"
 
 struct fft_hdl {
@@ -97,14 +98,21 @@ struct fft_hdl *init_fft(int reverse, int m, int many,
 	return hdl;
 }
 
+/* FFT buffers are placed on huge pages when enabled */
 void *fft_malloc(size_t size)
 {
+	if (hugepage_len())
+		return hugepage_malloc(size);
+
 	return fftwf_malloc(size);
 }
 
 void fft_free_buf(void *buf)
 {
-	fftwf_free(buf);
+	if (hugepage_owns(buf))
+		hugepage_free(buf);
+	else
+		fftwf_free(buf);
 }
 
 /*! \brief Free FFT backend resources 
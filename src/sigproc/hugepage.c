@@ -0,0 +1,310 @@
+/*
+ * Huge Page Buffer Allocation
+ *
+ * Copyright (C) 2015 Ettus Research LLC
+ * Author Tom Tsou <tom.tsou@ettus.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <pthread.h>
+#include <sys/mman.h>
+
+#include "openphy/hugepage.h"
+
+/* Page size encoding shared by mmap() and memfd_create() */
+#define HUGEPAGE_SHIFT		26
+#define HUGEPAGE_ENC_2M		(21 << HUGEPAGE_SHIFT)
+#define HUGEPAGE_ENC_1G		(30 << HUGEPAGE_SHIFT)
+
+#ifndef MAP_HUGETLB
+#define MAP_HUGETLB		0x40000
+#endif
+#ifndef MFD_HUGETLB
+#define MFD_HUGETLB		0x0004
+#endif
+
+/* Transparent huge pages are always 2 MB */
+#define THP_LEN			(2 << 20)
+
+/* Block alignment covers vector loads and cache lines */
+#define BLOCK_ALIGN		64
+
+/* Requests above a quarter page are mapped separately */
+#define LARGE_FRACTION		4
+
+/*
+ * Small buffers are carved from shared huge page regions and recycled by
+ * exact size on release, since buffers are reallocated with the same
+ * dimensions whenever decoding state is rebuilt. Large buffers receive a
+ * dedicated region that is unmapped on release.
+ */
+struct hp_region {
+	char *base;
+	size_t len;
+	size_t used;
+	int large;
+	struct hp_region *next;
+};
+
+union hp_block {
+	struct {
+		size_t len;
+		struct hp_region *region;
+		union hp_block *next;
+	} hdr;
+	char pad[BLOCK_ALIGN];
+};
+
+static size_t page_len;
+static int map_flags;
+static int memfd_flags;
+static int thp_fallback;
+
+static struct hp_region *regions;
+static union hp_block *free_blocks;
+static pthread_mutex_t hp_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+/*! \brief Select the huge page size used for buffer allocation
+ *  \param[in] size Huge page size or HUGEPAGE_NONE to disable
+ *
+ *  Must be called before any buffers are allocated.
+ */
+int hugepage_init(enum hugepage_size size)
+{
+	if (regions)
+		return -1;
+
+	switch (size) {
+	case HUGEPAGE_NONE:
+		page_len = 0;
+		map_flags = 0;
+		memfd_flags = 0;
+		break;
+	case HUGEPAGE_2M:
+		page_len = 2 << 20;
+		map_flags = MAP_HUGETLB | HUGEPAGE_ENC_2M;
+		memfd_flags = MFD_HUGETLB | HUGEPAGE_ENC_2M;
+		break;
+	case HUGEPAGE_1G:
+		page_len = 1 << 30;
+		map_flags = MAP_HUGETLB | HUGEPAGE_ENC_1G;
+		memfd_flags = MFD_HUGETLB | HUGEPAGE_ENC_1G;
+		break;
+	default:
+		return -1;
+	}
+
+	return 0;
+}
+
+/*! \brief Selected huge page length in bytes or zero if disabled */
+size_t hugepage_len(void)
+{
+	return page_len;
+}
+
+/*! \brief Flags for memfd_create() backed by reserved huge pages */
+int hugepage_memfd_flags(void)
+{
+	return memfd_flags;
+}
+
+/*
+ * Map from the reserved huge page pool. If no pages are reserved, map
+ * aligned anonymous memory and request transparent huge pages.
+ */
+static char *map_pages(size_t len)
+{
+	void *addr = mmap(NULL, len, PROT_READ | PROT_WRITE,
+			  MAP_PRIVATE | MAP_ANONYMOUS | map_flags, -1, 0);
+	if (addr != MAP_FAILED)
+		return addr;
+
+	if (!thp_fallback) {
+		fprintf(stderr, "Hugepage: No reserved %zu kB pages, "
+			"using transparent huge pages\n", page_len >> 10);
+		thp_fallback = 1;
+	}
+
+	char *raw = mmap(NULL, len + THP_LEN, PROT_READ | PROT_WRITE,
+			 MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (raw == MAP_FAILED)
+		return NULL;
+
+	char *base = (char *) (((uintptr_t) raw + THP_LEN - 1) &
+			       ~((uintptr_t) THP_LEN - 1));
+
+	if (base > raw)
+		munmap(raw, base - raw);
+	if (base + len < raw + len + THP_LEN)
+		munmap(base + len, raw + THP_LEN - base);
+
+	madvise(base, len, MADV_HUGEPAGE);
+
+	return base;
+}
+
+static struct hp_region *add_region(size_t len, int large)
+{
+	struct hp_region *region = malloc(sizeof *region);
+	if (!region)
+		return NULL;
+
+	region->base = map_pages(len);
+	if (!region->base) {
+		free(region);
+		return NULL;
+	}
+
+	region->len = len;
+	region->used = 0;
+	region->large = large;
+	region->next = regions;
+	regions = region;
+
+	return region;
+}
+
+static struct hp_region *find_region(const void *buf)
+{
+	struct hp_region *region;
+	const char *ptr = buf;
+
+	for (region = regions; region; region = region->next) {
+		if ((ptr >= region->base) && (ptr < region->base + region->len))
+			return region;
+	}
+
+	return NULL;
+}
+
+static union hp_block *alloc_block(size_t len)
+{
+	struct hp_region *region;
+	union hp_block **prev;
+	union hp_block *blk;
+
+	if (len > page_len / LARGE_FRACTION) {
+		size_t map_len = (len + page_len - 1) / page_len * page_len;
+
+		region = add_region(map_len, 1);
+		if (!region)
+			return NULL;
+
+		goto carve;
+	}
+
+	/* Recycle a released block of the same size */
+	for (prev = &free_blocks; *prev; prev = &(*prev)->hdr.next) {
+		if ((*prev)->hdr.len == len) {
+			blk = *prev;
+			*prev = blk->hdr.next;
+			return blk;
+		}
+	}
+
+	for (region = regions; region; region = region->next) {
+		if (!region->large && (region->used + len <= region->len))
+			goto carve;
+	}
+
+	region = add_region(page_len, 0);
+	if (!region)
+		return NULL;
+
+carve:
+	blk = (union hp_block *) (region->base + region->used);
+	blk->hdr.len = len;
+	blk->hdr.region = region;
+	region->used += len;
+
+	return blk;
+}
+
+/*! \brief Allocate a huge page backed buffer aligned to 64 bytes
+ *  \param[in] size Buffer size in bytes
+ */
+void *hugepage_malloc(size_t size)
+{
+	union hp_block *blk;
+	void *buf;
+
+	if (!page_len) {
+		if (posix_memalign(&buf, BLOCK_ALIGN, size))
+			return NULL;
+		return buf;
+	}
+
+	size_t len = sizeof(*blk) +
+		     (size + BLOCK_ALIGN - 1) / BLOCK_ALIGN * BLOCK_ALIGN;
+
+	pthread_mutex_lock(&hp_mutex);
+	blk = alloc_block(len);
+	pthread_mutex_unlock(&hp_mutex);
+
+	if (!blk)
+		return NULL;
+
+	return blk + 1;
+}
+
+/*! \brief Release a buffer from hugepage_malloc() */
+void hugepage_free(void *buf)
+{
+	struct hp_region **prev;
+
+	if (!buf)
+		return;
+
+	pthread_mutex_lock(&hp_mutex);
+
+	union hp_block *blk = (union hp_block *) buf - 1;
+	struct hp_region *region = find_region(buf);
+
+	if (!region) {
+		pthread_mutex_unlock(&hp_mutex);
+		free(buf);
+		return;
+	}
+
+	if (!region->large) {
+		blk->hdr.next = free_blocks;
+		free_blocks = blk;
+		pthread_mutex_unlock(&hp_mutex);
+		return;
+	}
+
+	for (prev = &regions; *prev != region; prev = &(*prev)->next);
+	*prev = region->next;
+
+	pthread_mutex_unlock(&hp_mutex);
+
+	munmap(region->base, region->len);
+	free(region);
+}
+
+/*! \brief Check whether a buffer was allocated from huge pages */
+int hugepage_owns(const void *buf)
+{
+	pthread_mutex_lock(&hp_mutex);
+	int owns = find_region(buf) != NULL;
+	pthread_mutex_unlock(&hp_mutex);
+
+	return owns;
+}
@@ -0,0 +1,175 @@
+/*
+ * LTE Decoder Stage Capture
+ *
+ * Copyright (C) 2015 Ettus Research LLC
+ * Author Tom Tsou <tom.tsou@ettus.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <iostream>
+#include <sstream>
+
+#include "stage.h"
+#include "log.h"
+
+/* Largest payload accepted on replay, well above a 20 MHz MIMO grid */
+#define STAGE_MAX_LEN		(1 << 24)
+
+struct stage_prefix {
+	uint32_t tag;
+	uint32_t len;
+};
+
+stage_writer::stage_writer()
+	: file(NULL), count(0), errors(0)
+{
+}
+
+stage_writer::~stage_writer()
+{
+	close();
+}
+
+bool stage_writer::open(const std::string &path)
+{
+	file = fopen(path.c_str(), "wb");
+	if (!file) {
+		std::cerr << "** Failed to open stage capture " << path << std::endl;
+		return false;
+	}
+
+	this->path = path;
+	count = 0;
+	errors = 0;
+
+	std::cout << "-- Capturing decoder stages to " << path << std::endl;
+
+	return true;
+}
+
+/* Safe while other threads write, which are discarded once closed */
+void stage_writer::close()
+{
+	std::lock_guard<std::mutex> guard(mutex);
+
+	if (!file)
+		return;
+
+	fclose(file);
+	file = NULL;
+
+	std::ostringstream ost;
+	ost << "DEV   : Captured " << count << " stage records to " << path;
+	if (errors)
+		ost << ", " << errors << " write errors";
+
+	LOG_DEV(ost.str().c_str());
+}
+
+void stage_writer::write(uint32_t tag, const void *hdr, size_t hdr_len,
+			 const void *data, size_t len)
+{
+	struct stage_prefix prefix = { tag, (uint32_t) len };
+
+	std::lock_guard<std::mutex> guard(mutex);
+
+	if (!file)
+		return;
+
+	if ((fwrite(&prefix, sizeof(prefix), 1, file) != 1) ||
+	    (fwrite(hdr, hdr_len, 1, file) != 1) ||
+	    (len && (fwrite(data, len, 1, file) != 1))) {
+		errors++;
+		return;
+	}
+
+	count++;
+}
+
+void stage_writer::write(const struct stage_grid &grid,
+			 const float *data, size_t len)
+{
+	write(STAGE_GRID_TAG, &grid, sizeof(grid), data, len * sizeof(float));
+}
+
+void stage_writer::write(const struct stage_soft &soft, const int8_t *data)
+{
+	write(STAGE_SOFT_TAG, &soft, sizeof(soft), data, soft.G);
+}
+
+stage_reader::stage_reader()
+	: file(NULL)
+{
+}
+
+stage_reader::~stage_reader()
+{
+	if (file)
+		fclose(file);
+}
+
+bool stage_reader::open(const std::string &path)
+{
+	file = fopen(path.c_str(), "rb");
+	if (!file) {
+		std::cerr << "** Failed to open stage capture " << path << std::endl;
+		return false;
+	}
+
+	this->path = path;
+
+	return true;
+}
+
+bool stage_reader::next(struct stage_record &rec)
+{
+	struct stage_prefix prefix;
+	void *hdr;
+	size_t hdr_len;
+
+	if (!file || (fread(&prefix, sizeof(prefix), 1, file) != 1))
+		return false;
+
+	switch (prefix.tag) {
+	case STAGE_GRID_TAG:
+		hdr = &rec.grid;
+		hdr_len = sizeof(rec.grid);
+		break;
+	case STAGE_SOFT_TAG:
+		hdr = &rec.soft;
+		hdr_len = sizeof(rec.soft);
+		break;
+	default:
+		std::cerr << "** Unknown stage record in " << path << std::endl;
+		return false;
+	}
+
+	if (prefix.len > STAGE_MAX_LEN) {
+		std::cerr << "** Invalid stage record length in " << path
+			  << std::endl;
+		return false;
+	}
+
+	rec.tag = prefix.tag;
+	rec.data.resize(prefix.len);
+
+	if ((fread(hdr, hdr_len, 1, file) != 1) ||
+	    (prefix.len && (fread(&rec.data.front(), prefix.len, 1, file) != 1))) {
+		std::cerr << "** Truncated stage record in " << path << std::endl;
+		return false;
+	}
+
+	return true;
+}
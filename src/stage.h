@@ -0,0 +1,103 @@
+#ifndef _LTE_STAGE_H_
+#define _LTE_STAGE_H_
+
+#include <stdio.h>
+#include <stdint.h>
+#include <vector>
+#include <string>
+#include <mutex>
+
+/* Record tags, "GRID" and "SOFT" in file order */
+#define STAGE_GRID_TAG		0x44495247
+#define STAGE_SOFT_TAG		0x54464f53
+
+/*
+ * Post-FFT resource grid of one subframe
+ *
+ * Followed by one grid per receive antenna as laid out by
+ * lte_subframe_grid_save(). The timestamp is the receive timestamp of the
+ * subframe or negative if unknown.
+ */
+struct stage_grid {
+	int32_t rbs;
+	int32_t n_id_cell;
+	int32_t ng;
+	int32_t tx_ants;
+	int32_t rx_ants;
+	int32_t frame;
+	int32_t subframe;
+	int32_t reserved;
+	int64_t ts;
+};
+
+/* Transport block ahead of turbo decoding, followed by G soft bits */
+struct stage_soft {
+	int32_t tbs;
+	int32_t G;
+	int32_t mod;
+	int32_t rv;
+	int32_t rnti;
+	int32_t dci_type;
+	int32_t frame;
+	int32_t subframe;
+	int32_t n_id_cell;
+	int32_t reserved;
+};
+
+struct stage_record {
+	uint32_t tag;
+	union {
+		struct stage_grid grid;
+		struct stage_soft soft;
+	};
+	std::vector<char> data;
+};
+
+/*
+ * Decoder stage capture
+ *
+ * Records are appended in native byte order, each a tag and payload length
+ * followed by the stage header and payload, so grid and soft bit records
+ * can share a file and replay tells them apart. Writes are serialized
+ * across the PDSCH decoding threads and made on the calling thread, so a
+ * capture slows decoding to the disk rate rather than dropping records.
+ */
+class stage_writer {
+public:
+	stage_writer();
+	~stage_writer();
+
+	bool open(const std::string &path);
+	void close();
+
+	void write(const struct stage_grid &grid, const float *data, size_t len);
+	void write(const struct stage_soft &soft, const int8_t *data);
+
+private:
+	void write(uint32_t tag, const void *hdr, size_t hdr_len,
+		   const void *data, size_t len);
+
+	FILE *file;
+	std::string path;
+	uint64_t count;
+	uint64_t errors;
+	std::mutex mutex;
+};
+
+/* Sequential reader of a stage capture */
+class stage_reader {
+public:
+	stage_reader();
+	~stage_reader();
+
+	bool open(const std::string &path);
+
+	/* False at the end of the capture or on a damaged record */
+	bool next(struct stage_record &rec);
+
+private:
+	FILE *file;
+	std::string path;
+};
+
+#endif /* _LTE_STAGE_H_ */
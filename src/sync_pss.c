@@ -103,6 +103,41 @@ static int pss_findmax(int16_t *seq, int len, int *pos)
 	return max;
 }
 
+/* Index of the peak magnitude within a window, zero if none is nonzero */
+static int pss_window_max_idx(struct cxvec *vec, int start, int len)
+{
+	int idx = 0;
+	float val, max = 0.0f;
+
+	for (int i = start; i < start + len; i++) {
+		val = cabsf(vec->data[i]);
+		if (val > max) {
+			max = val;
+			idx = i;
+		}
+	}
+
+	return idx;
+}
+
+/*
+ * Peak to average ratio of a correlation that is zero outside of a window.
+ * The ratio only looks at the peak and its neighbours, so a subvector
+ * around the window gives the same result as the whole correlation.
+ */
+static float pss_window_par(struct cxvec *vec, int start, int len)
+{
+	int low = (start - 64 < 0) ? 0 : start - 64;
+	int high = (start + len + 64 > vec->len) ? vec->len : start + len + 64;
+	float par;
+
+	struct cxvec *cut = cxvec_subvec(vec, low, 0, 0, high - low);
+	par = cxvec_par(cut);
+	cxvec_free(cut);
+
+	return par;
+}
+
 /* Fractional peak determination with interpolation */
 static int pss_sync_frac(struct cxvec *vec, int pos, int chan)
 {
@@ -205,7 +240,13 @@ int lte_pss_sync(struct lte_rx *rx, struct cxvec **subframe,
 	return 0;
 }
 
-/* PSS: Narrowest time domain synchronization with fractional interpolation */
+/*
+ * PSS: Narrowest time domain synchronization with fractional interpolation
+ *
+ * Only the correlation window is computed, so only the window is scanned.
+ * PSS samples outside of the window and the sequence length ahead of it
+ * are never read.
+ */
 int lte_pss_fine_sync(struct lte_rx *rx, struct cxvec **subframe,
 		      int chans, struct lte_sync *sync, int n_id_2)
 {
@@ -213,8 +254,9 @@ int lte_pss_fine_sync(struct lte_rx *rx, struct cxvec **subframe,
 		return -EINVAL;
 
 	int i, n, pos, sf_len = subframe[0]->len;
-	int corr_len = 40;
-	int corr_start = 464;
+	int corr_len = LTE_PSS_FINE_LEN;
+	int corr_start = LTE_PSS_FINE_START;
+	int corr_end = corr_start + corr_len;
 
 	float par;
 	struct cxvec *corr[chans];
@@ -226,27 +268,27 @@ int lte_pss_fine_sync(struct lte_rx *rx, struct cxvec **subframe,
 	}
 
 	/* Channel selection */
-	for (n = 0; n < sf_len; n++)
+	for (n = corr_start; n < corr_end; n++)
 		corr[0]->data[n] = cabsf(corr[0]->data[n]);
 
-	pos = cxvec_max_idx(corr[0]);
+	pos = pss_window_max_idx(corr[0], corr_start, corr_len);
 	pss_sync_frac(corr[0], pos + 7, 0);
 
 	if (chans == 2) {
-		for (n = 0; n < sf_len; n++)
+		for (n = corr_start; n < corr_end; n++)
 			corr[1]->data[n] = cabsf(corr[1]->data[n]);
 
-		pos = cxvec_max_idx(corr[1]);
+		pos = pss_window_max_idx(corr[1], corr_start, corr_len);
 		pss_sync_frac(corr[1], pos + 7, 1);
 	}
 
 	for (i = 1; i < chans; i++) {
-		for (n = 0; n < sf_len; n++)
+		for (n = corr_start; n < corr_end; n++)
 			corr[0]->data[n] += cabsf(corr[i]->data[n]);
 	}
 
-	par = cxvec_par(corr[0]);
-	pos = cxvec_max_idx(corr[0]);
+	par = pss_window_par(corr[0], corr_start, corr_len);
+	pos = pss_window_max_idx(corr[0], corr_start, corr_len);
 
 	/* These values are magic! */
 	sync->n_id_2 = n_id_2;
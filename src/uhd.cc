@@ -20,16 +20,39 @@
 
 #include <iostream>
 #include <iomanip>
+#include <sstream>
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include <mutex>
 #include <stdint.h>
+#include <string.h>
+#include <math.h>
 
 #include <uhd/usrp/multi_usrp.hpp>
 #include <uhd/utils/thread_priority.hpp>
 #include "openphy/io.h"
 #include "uhd.h"
+#include "radio.h"
 #include "buffer.h"
+#include "record.h"
 #include "log.h"
 
-#define RX_BUFLEN		(1 << 20)
+extern "C" {
+#include "sigproc/convert.h"
+}
+
+/* Packets received directly into the sample buffers on each reload */
+#define RX_BATCH_PKTS		4
+
+/* Receive thread check interval while waiting on the buffer head */
+#define RX_WAIT_USEC		10000
+
+/* Samples per channel widened per pass of an sc8 lookback */
+#define RX_LOOKBACK_LEN		(1 << 15)
+
+/* Power of two histogram bins for timestamp gaps and reload latency */
+#define RX_HIST_BINS		24
 
 #define DEV_ARGS_X300		",master_clock_rate=184.32e6"
 #define DEV_ARGS_DEFAULT	""
@@ -41,8 +64,32 @@ enum {
 	DEV_TYPE_UNKNOWN,
 };
 
+/*
+ * Receive telemetry
+ *
+ * Updated by the receive thread and readable at any time. Latency is the
+ * duration of each reload including the wait in recv(). Histogram bin n
+ * counts values from 2^(n-1) up to 2^n, with the last bin unbounded.
+ */
+struct uhd_stats {
+	std::atomic<uint64_t> reloads;
+	std::atomic<uint64_t> samples;
+	std::atomic<uint64_t> timeouts;
+	std::atomic<uint64_t> dev_overflows;
+	std::atomic<uint64_t> buf_overflows;
+	std::atomic<uint64_t> jumps;
+	std::atomic<uint64_t> non_monotonic;
+	std::atomic<uint64_t> latency_max;
+	std::atomic<uint64_t> gap_hist[RX_HIST_BINS];
+	std::atomic<uint64_t> latency_hist[RX_HIST_BINS];
+};
+
 struct uhd_dev {
-	uhd_dev() : type(DEV_TYPE_UNKNOWN) { }
+	uhd_dev() : type(DEV_TYPE_UNKNOWN), wire(FORMAT_SC16), rx_buf(NULL),
+		    rx_ts(0), rx_running(false)
+	{
+		uhd_reset_stats(this);
+	}
 
 	int type;
 	size_t chans;
@@ -50,24 +97,142 @@ struct uhd_dev {
 	double rate;
 	double base_freq;
 	double offset_freq;
+	enum sample_format wire;
 	uhd::usrp::multi_usrp::sptr dev;
 	uhd::rx_streamer::sptr stream;
-	std::vector<ts_buffer *> rx_bufs;
+	ts_buffer *rx_buf;
+
+	/* Receive windows and timestamp gap relocation buffers */
+	std::vector<short *> wr_ptrs;
+	std::vector<std::vector<int16_t> > gap_bufs;
+	std::vector<short *> gap_ptrs;
+
+	/*
+	 * With sc8 over the wire the ring holds 8-bit samples, which are
+	 * widened into the conversion buffers on pull. The ring windows are
+	 * held until commit.
+	 */
+	std::vector<short *> rd_ptrs;
+	std::vector<std::vector<int16_t> > cvt_bufs;
+	std::vector<short *> cvt_ptrs;
+
+	/* sc8 lookback copies, which may be taken from any thread */
+	std::vector<std::vector<int8_t> > lb_bufs;
+	std::vector<short *> lb_ptrs;
+	std::mutex lb_mutex;
+
+	/* Expected timestamp of the next receive */
+	int64_t rx_ts;
+
+	std::thread rx_thread;
+	std::atomic<bool> rx_running;
+
+	struct uhd_stats stats;
 };
 
-static int64_t last = 0;
 static bool pps_init = false;
 
 void uhd_reset(struct uhd_dev *dev)
 {
 	uhd_stop_rx(dev);
 
-	for (size_t i = 0; i < dev->rx_bufs.size(); i++)
-		delete dev->rx_bufs[i];
+	delete dev->rx_buf;
+
+	dev->rx_buf = NULL;
+	dev->wr_ptrs.resize(0);
+	dev->gap_bufs.resize(0);
+	dev->gap_ptrs.resize(0);
+	dev->rd_ptrs.resize(0);
+	dev->cvt_bufs.resize(0);
+	dev->cvt_ptrs.resize(0);
+	dev->lb_bufs.resize(0);
+	dev->lb_ptrs.resize(0);
+
+	dev->rx_ts = 0;
+}
+
+void uhd_reset_stats(struct uhd_dev *dev)
+{
+	struct uhd_stats *stats = &dev->stats;
+
+	stats->reloads.store(0);
+	stats->samples.store(0);
+	stats->timeouts.store(0);
+	stats->dev_overflows.store(0);
+	stats->buf_overflows.store(0);
+	stats->jumps.store(0);
+	stats->non_monotonic.store(0);
+	stats->latency_max.store(0);
+
+	for (int i = 0; i < RX_HIST_BINS; i++) {
+		stats->gap_hist[i].store(0);
+		stats->latency_hist[i].store(0);
+	}
+
+	if (dev->rx_buf)
+		dev->rx_buf->reset_stats();
+}
+
+static void stat_inc(std::atomic<uint64_t> &stat, uint64_t val = 1)
+{
+	stat.fetch_add(val, std::memory_order_relaxed);
+}
+
+static void stat_hist(std::atomic<uint64_t> *hist, uint64_t val)
+{
+	int bin = val ? 64 - __builtin_clzll(val) : 0;
+	if (bin >= RX_HIST_BINS)
+		bin = RX_HIST_BINS - 1;
+
+	stat_inc(hist[bin]);
+}
+
+static void str_hist(std::ostringstream &ost,
+		     const std::atomic<uint64_t> *hist, const char *unit)
+{
+	for (int i = 0; i < RX_HIST_BINS; i++) {
+		uint64_t cnt = hist[i].load(std::memory_order_relaxed);
+		if (!cnt)
+			continue;
 
-	dev->rx_bufs.resize(0);
+		uint64_t lo = i ? 1ULL << (i - 1) : 0;
 
-	last = 0;
+		ost << " " << lo;
+		if (i == RX_HIST_BINS - 1)
+			ost << "+";
+		else
+			ost << "-" << (1ULL << i) - 1;
+
+		ost << unit << ":" << cnt;
+	}
+}
+
+std::string uhd_str_stats(struct uhd_dev *dev)
+{
+	struct uhd_stats *stats = &dev->stats;
+	std::ostringstream ost;
+
+	ost << "DEV   : Reloads " << stats->reloads.load()
+	    << ", samples " << stats->samples.load()
+	    << ", timeouts " << stats->timeouts.load()
+	    << ", device overflows " << stats->dev_overflows.load()
+	    << ", buffer overflows " << stats->buf_overflows.load()
+	    << ", timestamp jumps " << stats->jumps.load()
+	    << ", non-monotonic " << stats->non_monotonic.load();
+
+	ost << "\n                     Reload latency max "
+	    << stats->latency_max.load() << " us,";
+	str_hist(ost, stats->latency_hist, " us");
+
+	ost << "\n                     Timestamp gaps";
+	str_hist(ost, stats->gap_hist, "");
+
+	if (dev->rx_buf) {
+		ost << "\n                     Buffer "
+		    << dev->rx_buf->str_stats();
+	}
+
+	return ost.str();
 }
 
 static double uhd_get_rate(int rbs)
@@ -120,16 +285,16 @@ static bool uhd_init_freq(struct uhd_dev *dev, double freq)
 	return true;
 }
 
-static bool uhd_init_rates(struct uhd_dev *dev, int rbs)
+static bool uhd_init_rates(struct uhd_dev *dev, int rbs, size_t oversamp)
 {
-	double mcr, rate = uhd_get_rate(rbs);
+	double mcr, rate = uhd_get_rate(rbs) * oversamp;
 	if (rate == 0.0)
 		return false;
 
 	std::cout << "-- Setting rates to " << rate << " Hz" << std::endl;
 	try {
 		if (dev->type != DEV_TYPE_X300) {
-			if (rbs < 25)
+			if (rate < uhd_get_rate(25))
 				mcr = 8.0 * rate;
 			else
 				mcr = rate;
@@ -144,19 +309,36 @@ static bool uhd_init_rates(struct uhd_dev *dev, int rbs)
 	}
 
 	dev->rate = dev->dev->get_rx_rate();
+	if (fabs(dev->rate - rate) > 1.0) {
+		std::cerr << "** Sample rate " << rate
+			  << " Hz not supported by device" << std::endl;
+		return false;
+	}
 
 	return true;
 }
 
+/*
+ * The ring stores samples in the wire format so that the receive thread
+ * never converts. With sc8 the host format is also sc8, which halves both
+ * the transport bandwidth and the ring footprint.
+ */
 static bool uhd_init_rx(struct uhd_dev *dev, int64_t *ts)
 {
-	uhd::stream_args_t stream_args("sc16", "sc16");
-	dev->rx_bufs.resize(dev->chans);
+	bool sc8 = dev->wire == FORMAT_SC8;
+	const char *fmt = sc8 ? "sc8" : "sc16";
+	uhd::stream_args_t stream_args(fmt, fmt);
 
-	for (size_t i = 0; i < dev->chans; i++) {
+	for (size_t i = 0; i < dev->chans; i++)
 		stream_args.channels.push_back(i);
-		dev->rx_bufs[i] = new ts_buffer(RX_BUFLEN);
-		dev->rx_bufs[i]->init();
+
+	std::cout << "-- Streaming " << fmt << " samples" << std::endl;
+
+	dev->rx_buf = new ts_buffer(RADIO_RX_BUFLEN, dev->chans,
+				    sc8 ? TS_BUFFER_SC8 : TS_BUFFER_SC16);
+	if (!dev->rx_buf->init()) {
+		std::cerr << "** Receive buffer allocation failed" << std::endl;
+		return false;
 	}
 
 	dev->stream = dev->dev->get_rx_stream(stream_args);
@@ -164,12 +346,26 @@ static bool uhd_init_rx(struct uhd_dev *dev, int64_t *ts)
 	dev->spp = dev->stream->get_max_num_samps();
 	std::cout << "-- Samples per packet " << dev->spp << std::endl;
 
-	std::vector<std::vector<int16_t> >
-		pkt_bufs(dev->chans, std::vector<int16_t>(2 * dev->spp));
+	dev->wr_ptrs.resize(dev->chans);
+	dev->gap_bufs.assign(dev->chans,
+			     std::vector<int16_t>(2 * RX_BATCH_PKTS * dev->spp));
 
-	std::vector<int16_t *> pkt_ptrs;
-	for (size_t i = 0; i < pkt_bufs.size(); i++)
-		pkt_ptrs.push_back(&pkt_bufs[i].front());
+	for (size_t i = 0; i < dev->chans; i++)
+		dev->gap_ptrs.push_back(&dev->gap_bufs[i].front());
+
+	dev->rd_ptrs.assign(dev->chans, NULL);
+	dev->cvt_bufs.resize(dev->chans);
+	dev->cvt_ptrs.assign(dev->chans, NULL);
+
+	if (sc8) {
+		dev->lb_bufs.assign(dev->chans,
+				    std::vector<int8_t>(2 * RX_LOOKBACK_LEN));
+
+		for (size_t i = 0; i < dev->chans; i++) {
+			dev->lb_ptrs.push_back((short *)
+					       &dev->lb_bufs[i].front());
+		}
+	}
 
 	uhd::time_spec_t current = dev->dev->get_time_now();
 	uhd::stream_cmd_t cmd(uhd::stream_cmd_t::STREAM_MODE_START_CONTINUOUS);
@@ -178,15 +374,48 @@ static bool uhd_init_rx(struct uhd_dev *dev, int64_t *ts)
 	dev->dev->issue_stream_cmd(cmd);
 
 	uhd::rx_metadata_t md;
-	while (!dev->stream->recv(pkt_ptrs, dev->spp, md, 1.0, true));
+	size_t num;
+	while (!(num = dev->stream->recv(dev->gap_ptrs, dev->spp, md, 1.0, true)));
 
 	*ts = md.time_spec.to_ticks(dev->rate);
 
+	/* First packet is discarded and buffering starts after it */
+	dev->rx_ts = *ts + num;
+
 	return true;
 }
 
+/*
+ * Receive thread
+ *
+ * Drain the device continuously into the sample buffers so that transport
+ * latency is absorbed here instead of on the synchronization thread.
+ */
+static void uhd_rx_loop(struct uhd_dev *dev)
+{
+	uhd::set_thread_priority_safe();
+
+	while (dev->rx_running.load()) {
+		if (uhd_reload(dev) < 0)
+			break;
+	}
+
+	dev->rx_running.store(false);
+}
+
+void uhd_go(struct uhd_dev *dev)
+{
+	dev->rx_running.store(true);
+	dev->rx_thread = std::thread(uhd_rx_loop, dev);
+}
+
 void uhd_stop_rx(struct uhd_dev *dev)
 {
+	if (dev->rx_thread.joinable()) {
+		dev->rx_running.store(false);
+		dev->rx_thread.join();
+	}
+
 	uhd::stream_cmd_t cmd(uhd::stream_cmd_t::STREAM_MODE_STOP_CONTINUOUS);
 	dev->dev->issue_stream_cmd(cmd);
 
@@ -249,10 +478,20 @@ static std::string get_dev_args(int type)
 }
 
 struct uhd_dev *uhd_init(int64_t *ts, double freq, const std::string &args,
-			 size_t rbs, size_t chans, double gain, int ref)
+			 size_t rbs, size_t chans, double gain, int ref,
+			 size_t oversamp, enum sample_format wire)
 {
 	struct uhd_dev *dev = new struct uhd_dev();
 
+	if ((wire != FORMAT_SC16) && (wire != FORMAT_SC8)) {
+		std::cerr << "** Unsupported wire format "
+			  << sample_format_str(wire) << std::endl;
+		delete dev;
+		return NULL;
+	}
+
+	dev->wire = wire;
+
 	uhd::device_addr_t addr(args);
 	uhd::device_addrs_t addrs = uhd::device::find(addr);
 	if (!addrs.size()) {
@@ -297,12 +536,14 @@ struct uhd_dev *uhd_init(int64_t *ts, double freq, const std::string &args,
 		break;
 	}
 
-	if (!uhd_init_rates(dev, rbs) || !uhd_init_freq(dev, freq))
+	if (!uhd_init_rates(dev, rbs, oversamp) || !uhd_init_freq(dev, freq))
 		return NULL;
 
 	if (!uhd_init_gains(dev, gain) || !uhd_init_rx(dev, ts))
 		return NULL;
 
+	uhd_go(dev);
+
 	return dev;
 }
 
@@ -361,81 +602,151 @@ int uhd_shift(struct uhd_dev *dev, double offset)
 
 int64_t uhd_get_ts_high(struct uhd_dev *dev)
 {
-	return dev->rx_bufs[0]->get_last_time();
+	return dev->rx_buf->get_last_time();
 }
 
 int64_t uhd_get_ts_low(struct uhd_dev *dev)
 {
-	return dev->rx_bufs[0]->get_first_time();
+	return dev->rx_buf->get_first_time();
 }
 
-bool dump = false;
+/* Release the outstanding receive window without publishing samples */
+static void uhd_cancel_wr(struct uhd_dev *dev)
+{
+	if (dev->wr_ptrs[0])
+		dev->rx_buf->commit_wr(dev->wr_ptrs, 0);
+
+	dev->wr_ptrs.assign(dev->chans, NULL);
+}
+
+/* Receive and drop a batch while lossless readers hold back the buffer */
+static int uhd_drop(struct uhd_dev *dev)
+{
+	uhd::rx_metadata_t md;
+	size_t len = RX_BATCH_PKTS * dev->spp;
+
+	size_t num = dev->stream->recv(dev->gap_ptrs, len, md, 1.0, false);
+	if (!num)
+		return 0;
+
+	int64_t ts = md.time_spec.to_ticks(dev->rate);
+	if (ts >= dev->rx_ts)
+		dev->rx_ts = ts + num;
+
+	stat_inc(dev->stats.buf_overflows);
+
+	return 0;
+}
 
+/*
+ * Receive a batch of packets directly into the sample buffers
+ *
+ * Windows are opened at the expected timestamp. If the device reports a
+ * different timestamp the samples are relocated through the gap buffers,
+ * since source and destination windows may alias in the mirrored ring. The
+ * sample buffer zero fills and records the skipped samples for the reader.
+ */
 int uhd_reload(struct uhd_dev *dev)
 {
-	int rc;
+	ssize_t rc;
 	uhd::rx_metadata_t md;
-	size_t total = 0;
+	std::ostringstream ost;
+	size_t len = RX_BATCH_PKTS * dev->spp;
+	struct uhd_stats *stats = &dev->stats;
 
-	std::vector<std::vector<int16_t> >
-		pkt_bufs(dev->chans, std::vector<int16_t>(2 * dev->spp));
+	auto start = std::chrono::steady_clock::now();
 
-	std::vector<int16_t *> pkt_ptrs;
-	for (size_t i = 0; i < pkt_bufs.size(); i++)
-		pkt_ptrs.push_back(&pkt_bufs[i].front());
+	rc = dev->rx_buf->get_wr_buf(dev->rx_ts, len, dev->wr_ptrs);
+	if (rc == -ts_buffer::ERR_OVERFLOW) {
+		return uhd_drop(dev);
+	} else if (rc < 0) {
+		ost << "DEV   : Receive buffer error - "
+		    << ts_buffer::str_code(-rc);
+		LOG_ERR(ost.str().c_str());
+		return -1;
+	}
 
-	for (;;) {
-		size_t num = dev->stream->recv(pkt_ptrs, dev->spp, md, 1.0, true);
-		if (num <= 0) {
-			std::cout << "Receive timed out " <<  std::endl;
-			dump = true;
-			continue;
-		} else if (num < dev->spp) {
-			std::cout << "Short packet" <<  std::endl;
+	size_t num = dev->stream->recv(dev->wr_ptrs, len, md, 1.0, false);
+	if (!num) {
+		uhd_cancel_wr(dev);
+
+		if (md.error_code == uhd::rx_metadata_t::ERROR_CODE_TIMEOUT) {
+			stat_inc(stats->timeouts);
+			LOG_ERR("DEV   : Receive timed out");
+		} else if (md.error_code == uhd::rx_metadata_t::ERROR_CODE_OVERFLOW) {
+			stat_inc(stats->dev_overflows);
 		}
 
-		total += num;
+		/* Allow the receive thread to check for shutdown */
+		return 0;
+	}
 
-		int64_t ts = md.time_spec.to_ticks(dev->rate);
+	int64_t ts = md.time_spec.to_ticks(dev->rate);
 
-		if (dump) {
-			std::cout << "ts : " << ts << std::endl;
-			dump = false;
-		}
+	/* Drop samples that would rewind the buffer */
+	if (ts < dev->rx_ts) {
+		uhd_cancel_wr(dev);
+		stat_inc(stats->non_monotonic);
 
-		if (ts < last) {
-			std::cout << "ts   : " << ts << std::endl;
-			std::cout << "last : " << last << std::endl;
-			std::cout << "Non-monotonic TIME" << std::endl;
-			exit(1);
-			continue;
-		}
+		ost << "DEV   : Non-monotonic timestamp " << ts
+		    << ", expected " << dev->rx_ts;
+		LOG_ERR(ost.str().c_str());
+		return 0;
+	}
 
-		if ((size_t) (ts - last) != dev->spp) {
-			std::cout << "UHD Timestamp Jump" << std::endl;
-			std::cout << "expected : " << dev->spp << std::endl;
-			std::cout << "got      : " << ts - last << std::endl;
-		}
+	bool jump = ts != dev->rx_ts;
+	if (jump) {
+		stat_inc(stats->jumps);
+		stat_hist(stats->gap_hist, ts - dev->rx_ts);
+
+		ost << "DEV   : Timestamp gap of " << ts - dev->rx_ts
+		    << " samples at " << dev->rx_ts;
+		LOG_ERR(ost.str().c_str());
 
-		for (size_t i = 0; i < pkt_ptrs.size(); i++) {
-			rc = dev->rx_bufs[i]->write(pkt_ptrs[i], num, ts);
-			if (rc < 0) {
-				if (rc == -2) {
-					std::cout << "Internal overflow" << std::endl;
-					continue;
-				}
-
-				std::cout << "Fatal buffer reload error " << rc << std::endl;
-				std::cout << "ts   : " << ts << std::endl;
-				std::cout << "last : " << last << std::endl;
-				exit(1);
-			}
+		for (size_t i = 0; i < dev->chans; i++) {
+			memcpy(dev->gap_ptrs[i], dev->wr_ptrs[i],
+			       num * dev->rx_buf->get_smpl_size());
 		}
 
-		last = ts;
+		uhd_cancel_wr(dev);
+		rc = dev->rx_buf->write(dev->gap_ptrs, num, ts);
+	} else {
+		rc = dev->rx_buf->commit_wr(dev->wr_ptrs, num);
+		dev->wr_ptrs.assign(dev->chans, NULL);
+	}
 
-		if (total >= dev->spp)
-			break;
+	if (rc == -ts_buffer::ERR_OVERFLOW) {
+		stat_inc(stats->buf_overflows);
+	} else if (rc < 0) {
+		ost << "DEV   : Receive buffer error at " << ts << " - "
+		    << ts_buffer::str_code(-rc);
+		LOG_ERR(ost.str().c_str());
+		return -1;
+	}
+
+	dev->rx_ts = ts + num;
+
+	uint64_t usec = std::chrono::duration_cast<std::chrono::microseconds>(
+				std::chrono::steady_clock::now() - start).count();
+
+	if (usec > stats->latency_max.load(std::memory_order_relaxed))
+		stats->latency_max.store(usec, std::memory_order_relaxed);
+
+	stat_hist(stats->latency_hist, usec);
+	stat_inc(stats->reloads);
+	stat_inc(stats->samples, num);
+
+	return 0;
+}
+
+/* Block until the receive thread advances the buffer head */
+int uhd_wait(struct uhd_dev *dev)
+{
+	int64_t ts = uhd_get_ts_high(dev);
+
+	while (!dev->rx_buf->wait_wr(ts, RX_WAIT_USEC)) {
+		if (!dev->rx_running.load())
+			return -1;
 	}
 
 	return 0;
@@ -445,44 +756,155 @@ int uhd_pull(struct uhd_dev *dev,
 	     std::vector<short *> &bufs,
 	     size_t len, int64_t ts)
 {
-	int err;
-
 	if (bufs.size() != dev->chans) {
 		std::cerr << "UHD: Invalid buffer " << bufs.size() << std::endl;
 		return -1;
 	}
 
-	if (dev->rx_bufs[0]->avail_smpls(ts) < len) {
+	if (dev->rx_buf->avail_smpls(ts) < len) {
 		std::cerr << "Insufficient samples in buffer " << std::endl;
 		return -1;
 	}
 
-	for (size_t i = 0; i < bufs.size(); i++) {
-		bufs[i] = (int16_t *) dev->rx_bufs[i]->get_rd_buf(ts, len, &err);
-		if (!bufs[i]) {
-			std::cerr << "Fatal buffer pull error " << err << std::endl;
+	if (dev->wire == FORMAT_SC8) {
+		int rc = dev->rx_buf->get_rd_buf(ts, len, dev->rd_ptrs);
+		if (rc == -ts_buffer::ERR_OVERFLOW) {
+			return -1;
+		} else if (rc < 0) {
+			std::cerr << "Fatal buffer pull error " << -rc << std::endl;
 			return -1;
-//			exit(1);
 		}
+
+		for (size_t i = 0; i < dev->chans; i++) {
+			if (dev->cvt_bufs[i].size() < 2 * len)
+				dev->cvt_bufs[i].resize(2 * len);
+
+			dev->cvt_ptrs[i] = &dev->cvt_bufs[i].front();
+			convert_sc8_short(dev->cvt_ptrs[i],
+					  (const int8_t *) dev->rd_ptrs[i],
+					  2 * len);
+		}
+
+		bufs = dev->cvt_ptrs;
+		return len;
+	}
+
+	/* Overwritten samples are recovered by the caller */
+	int rc = dev->rx_buf->get_rd_buf(ts, len, bufs);
+	if (rc == -ts_buffer::ERR_OVERFLOW) {
+		return -1;
+	} else if (rc < 0) {
+		std::cerr << "Fatal buffer pull error " << -rc << std::endl;
+		return -1;
 	}
 
 	return len;
 }
 
+int uhd_lookback(struct uhd_dev *dev, std::vector<short *> &bufs,
+		 size_t len, int64_t ts)
+{
+	if (dev->wire != FORMAT_SC8)
+		return dev->rx_buf->lookback(bufs, len, ts) < 0 ? -1 : len;
+
+	/* Copy out 8-bit samples, then widen into the caller buffers */
+	std::lock_guard<std::mutex> guard(dev->lb_mutex);
+
+	for (size_t n = 0; n < len; n += RX_LOOKBACK_LEN) {
+		size_t num = len - n;
+		if (num > RX_LOOKBACK_LEN)
+			num = RX_LOOKBACK_LEN;
+
+		if (dev->rx_buf->lookback(dev->lb_ptrs, num, ts + n) < 0)
+			return -1;
+
+		for (size_t i = 0; i < dev->chans; i++) {
+			convert_sc8_short(bufs[i] + 2 * n,
+					  &dev->lb_bufs[i].front(), 2 * num);
+		}
+	}
+
+	return len;
+}
+
+int64_t uhd_get_ts_history(struct uhd_dev *dev)
+{
+	return dev->rx_buf->get_history_time();
+}
+
+bool uhd_get_gap(struct uhd_dev *dev, int64_t end, int64_t *ts, int64_t *len)
+{
+	return dev->rx_buf->get_gap(end, ts, len);
+}
+
 int uhd_commit(struct uhd_dev *dev, std::vector<short *> &bufs)
 {
-	if (bufs.size() != dev->rx_bufs.size()) {
+	if (bufs.size() != dev->chans) {
 		std::cerr << "Fatal I/O error" << std::endl;
 		return -1;
 	}
 
-	for (size_t i = 0; i < bufs.size(); i++) {
-		if (!dev->rx_bufs[i]->commit_rd(bufs[i])) {
-			std::cerr << "Fatal commit error" << std::endl;
-			return -1;
-		}
+	if (!dev->rx_buf->commit_rd(dev->wire == FORMAT_SC8 ?
+				    dev->rd_ptrs : bufs)) {
+		std::cerr << "Fatal commit error" << std::endl;
+		return -1;
 	}
 
 	return 0;
 }
 
+/* Radio backend adapter */
+class uhd_radio : public radio_dev {
+public:
+	uhd_radio(struct uhd_dev *dev) : dev(dev) { }
+
+	void reset() { uhd_reset(dev); }
+	int reload() { return uhd_wait(dev); }
+
+	int pull(std::vector<short *> &bufs, size_t len, int64_t ts)
+	{
+		return uhd_pull(dev, bufs, len, ts);
+	}
+
+	int commit(std::vector<short *> &bufs)
+	{
+		return uhd_commit(dev, bufs);
+	}
+
+	int lookback(std::vector<short *> &bufs, size_t len, int64_t ts)
+	{
+		return uhd_lookback(dev, bufs, len, ts);
+	}
+
+	int64_t get_ts_high() { return uhd_get_ts_high(dev); }
+	int64_t get_ts_low() { return uhd_get_ts_low(dev); }
+	int64_t get_ts_history() { return uhd_get_ts_history(dev); }
+	ts_buffer *get_buffer() { return dev->rx_buf; }
+
+	bool get_gap(int64_t end, int64_t *ts, int64_t *len)
+	{
+		return uhd_get_gap(dev, end, ts, len);
+	}
+
+	bool tunable() { return true; }
+	int shift(double offset) { return uhd_shift(dev, offset); }
+	int freq_reset() { return uhd_freq_reset(dev); }
+
+	std::string str_stats() { return uhd_str_stats(dev); }
+	void reset_stats() { uhd_reset_stats(dev); }
+
+private:
+	struct uhd_dev *dev;
+};
+
+radio_dev *uhd_radio_init(int64_t *ts, double freq, const std::string &args,
+			  size_t rbs, size_t chans, double gain, int ref,
+			  size_t oversamp, enum sample_format wire)
+{
+	struct uhd_dev *dev = uhd_init(ts, freq, args, rbs,
+				       chans, gain, ref, oversamp, wire);
+	if (!dev)
+		return NULL;
+
+	return new uhd_radio(dev);
+}
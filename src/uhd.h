@@ -11,17 +11,27 @@ void uhd_go(struct uhd_dev *dev);
 void uhd_stop_rx(struct uhd_dev *dev);
 
 struct uhd_dev *uhd_init(int64_t *ts, double freq, const std::string &args,
-			 size_t rbs, size_t chans, double gain, int ref);
+			 size_t rbs, size_t chans, double gain, int ref,
+			 size_t oversamp = 1,
+			 enum sample_format wire = FORMAT_SC16);
 int uhd_pull(struct uhd_dev *dev,
 	     std::vector<short *> &buf,
 	     size_t len, int64_t ts);
 int uhd_commit(struct uhd_dev *dev, std::vector<short *> &bufs);
+int uhd_lookback(struct uhd_dev *dev, std::vector<short *> &bufs,
+		 size_t len, int64_t ts);
 
 int64_t uhd_get_ts_high(struct uhd_dev *dev);
 int64_t uhd_get_ts_low(struct uhd_dev *dev);
+int64_t uhd_get_ts_history(struct uhd_dev *dev);
+bool uhd_get_gap(struct uhd_dev *dev, int64_t end, int64_t *ts, int64_t *len);
 
 int uhd_reload(struct uhd_dev *dev);
+int uhd_wait(struct uhd_dev *dev);
 int uhd_write(struct uhd_dev *dev, int16_t *buf, size_t len, int64_t ts);
 
+void uhd_reset_stats(struct uhd_dev *dev);
+std::string uhd_str_stats(struct uhd_dev *dev);
+
 int uhd_shift(struct uhd_dev *dev, double offset);
 int uhd_freq_reset(struct uhd_dev *dev);